@@ -0,0 +1,272 @@
+/*
+ *    Copyright (C) 2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of lib45d.
+ *
+ *    lib45d is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    lib45d is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with lib45d.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Crawler benchmark. Generates deterministic trees (see tree_gen.hpp) and crawls each of them
+ * with every backend and thread count, printing one JSON object per run:
+ *
+ * {"shape":"wide-flat","entries_created":100000,"backend":"mtdircrawler","threads":4,
+ *  "entries":100002,"wall_s":0.12,"entries_per_s":833350,"user_cpu_s":0.1,"sys_cpu_s":0.3,
+ *  "peak_rss_kb":5120,"voluntary_ctxsw":812,"involuntary_ctxsw":3,"queue_lock_waits":40,
+ *  "queue_lock_wait_s":0.002,"queue_cv_waits":9,"queue_cv_wait_s":0.01}
+ *
+ * Each run happens in a forked child so peak RSS and CPU time are per run. The queue_* fields
+ * measure lock contention directly: how often and how long MTDirCrawler's workers blocked on
+ * the queue mutex, and waited on its condition variable for work (see FFD_CRAWLER_LOCK_STATS).
+ * They are null for backends that don't crawl with an MTDirCrawler in process.
+ * voluntary_ctxsw also counts sleeps on directory and inode reads that miss the cache.
+ */
+
+#define FFD_CRAWLER_LOCK_STATS
+
+#include "tree_gen.hpp"
+
+#include <45d/MTDirCrawler.hpp>
+#include <45d/crawler/OrderedDirCrawler.hpp>
+#include <45d/crawler/ShardedCrawl.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <sstream>
+
+extern "C" {
+#include <getopt.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+}
+
+typedef std::function<uint64_t(const fs::path &root, int threads)> backend_type;
+
+bool have_lock_stats = false;          ///< Whether the backend filled in lock_stats
+ffd::MTDirCrawler::LockStats lock_stats; ///< Queue waits of the run, in the forked child
+
+uint64_t crawl_mtdircrawler(const fs::path &root, int threads) {
+	std::atomic<uint64_t> count(0);
+	ffd::MTDirCrawler crawler;
+	crawler.crawl(
+		root,
+		[&count](const fs::directory_entry &e) {
+			++count;
+			return e.is_directory() && !e.is_symlink();
+		},
+		threads);
+	have_lock_stats = true;
+	lock_stats = crawler.lock_stats();
+	return count;
+}
+
+uint64_t crawl_statx(const fs::path &root, int threads) {
+	std::atomic<uint64_t> count(0);
+	ffd::MTDirCrawler crawler;
+	crawler.crawl(
+		root,
+		STATX_TYPE,
+		[&count](const ffd::CrawlEntry &e) {
+			++count;
+			return e.is_dir();
+		},
+		threads);
+	have_lock_stats = true;
+	lock_stats = crawler.lock_stats();
+	return count;
+}
+
+uint64_t crawl_ordered(const fs::path &root, int threads) {
+	uint64_t count = 0;
+	ffd::OrderedDirCrawler crawler(threads);
+	crawler.crawl(root, [&count](const fs::directory_entry &) { ++count; });
+	return count;
+}
+
+uint64_t crawl_sharded(const fs::path &root, int threads) {
+	std::string socket_path = "/tmp/crawl_bench." + std::to_string(getpid()) + ".socket";
+	uint64_t count = 0;
+	ffd::ShardedCrawlCoordinator coordinator(socket_path, threads);
+	coordinator.spawn_workers(threads, [](const fs::directory_entry &e, std::string &record) {
+		record = "1";
+		return e.is_directory() && !e.is_symlink();
+	});
+	coordinator.run({ root.string() }, [&count](const std::string &) { ++count; });
+	return count;
+}
+
+const std::vector<std::pair<std::string, backend_type>> backends = {
+	{ "mtdircrawler", crawl_mtdircrawler },
+	{ "statx", crawl_statx },
+	{ "ordered", crawl_ordered },
+	{ "sharded", crawl_sharded },
+};
+
+std::vector<std::string> split(const std::string &str) {
+	std::vector<std::string> res;
+	std::stringstream ss(str);
+	std::string item;
+	while (std::getline(ss, item, ','))
+		res.push_back(item);
+	return res;
+}
+
+void usage(void) {
+	std::cout << "crawl_bench [-s scratch dir] [-n entries per tree] [-S shape,...]\n"
+				 "            [-b backend,...] [-t threads,...] [-r repeats]\n"
+				 "shapes:";
+	for (const std::string &shape : tree_gen::shapes)
+		std::cout << " " << shape;
+	std::cout << "\nbackends:";
+	for (const auto &backend : backends)
+		std::cout << " " << backend.first;
+	std::cout << std::endl;
+}
+
+/* @brief Crawl in a forked child, reporting wall time and the child's rusage */
+void run(const std::string &shape,
+		 uint64_t created,
+		 const fs::path &root,
+		 const std::pair<std::string, backend_type> &backend,
+		 int threads) {
+	int fds[2];
+	if (pipe(fds) == -1) {
+		perror("pipe");
+		exit(1);
+	}
+	pid_t pid = fork();
+	if (pid == -1) {
+		perror("fork");
+		exit(1);
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		uint64_t entries = backend.second(root, threads);
+		double wall =
+			std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::string res = std::to_string(entries) + " " + std::to_string(wall) + " "
+						  + std::to_string(have_lock_stats) + " "
+						  + std::to_string(lock_stats.lock_waits) + " "
+						  + std::to_string(lock_stats.lock_wait_ns) + " "
+						  + std::to_string(lock_stats.cv_waits) + " "
+						  + std::to_string(lock_stats.cv_wait_ns);
+		if (write(fds[1], res.c_str(), res.length()) == -1)
+			_exit(1);
+		_exit(0);
+	}
+	close(fds[1]);
+	char buff[256] = { 0 };
+	ssize_t len = read(fds[0], buff, sizeof(buff) - 1);
+	close(fds[0]);
+	int status;
+	struct rusage ru;
+	wait4(pid, &status, 0, &ru);
+	if (len <= 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		std::cerr << shape << "/" << backend.first << "/" << threads << ": run failed"
+				  << std::endl;
+		return;
+	}
+	uint64_t entries;
+	double wall;
+	bool locks;
+	ffd::MTDirCrawler::LockStats stats;
+	std::stringstream(buff) >> entries >> wall >> locks >> stats.lock_waits >> stats.lock_wait_ns
+		>> stats.cv_waits >> stats.cv_wait_ns;
+	std::cout << "{\"shape\":\"" << shape << "\",\"entries_created\":" << created
+			  << ",\"backend\":\"" << backend.first << "\",\"threads\":" << threads
+			  << ",\"entries\":" << entries << ",\"wall_s\":" << wall
+			  << ",\"entries_per_s\":" << uint64_t(entries / wall)
+			  << ",\"user_cpu_s\":" << ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6
+			  << ",\"sys_cpu_s\":" << ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6
+			  << ",\"peak_rss_kb\":" << ru.ru_maxrss << ",\"voluntary_ctxsw\":" << ru.ru_nvcsw
+			  << ",\"involuntary_ctxsw\":" << ru.ru_nivcsw;
+	if (locks) {
+		std::cout << ",\"queue_lock_waits\":" << stats.lock_waits
+				  << ",\"queue_lock_wait_s\":" << stats.lock_wait_ns / 1e9
+				  << ",\"queue_cv_waits\":" << stats.cv_waits
+				  << ",\"queue_cv_wait_s\":" << stats.cv_wait_ns / 1e9;
+	} else {
+		std::cout << ",\"queue_lock_waits\":null,\"queue_lock_wait_s\":null"
+					 ",\"queue_cv_waits\":null,\"queue_cv_wait_s\":null";
+	}
+	std::cout << "}" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+	fs::path scratch = fs::exists("/dev/shm") ? "/dev/shm/crawl_bench" : "/tmp/crawl_bench";
+	uint64_t entries = 100000;
+	std::vector<std::string> shapes = tree_gen::shapes;
+	std::vector<std::string> backend_names;
+	std::vector<int> thread_counts = { 1, 2, 4, 8 };
+	int repeats = 1;
+	int opt;
+	try {
+		while ((opt = getopt(argc, argv, "s:n:S:b:t:r:h")) != -1) {
+			switch (opt) {
+				case 's':
+					scratch = optarg;
+					break;
+				case 'n':
+					entries = std::stoull(optarg);
+					break;
+				case 'S':
+					shapes = split(optarg);
+					break;
+				case 'b':
+					backend_names = split(optarg);
+					break;
+				case 't':
+					thread_counts.clear();
+					for (const std::string &t : split(optarg))
+						thread_counts.push_back(std::stoi(t));
+					break;
+				case 'r':
+					repeats = std::stoi(optarg);
+					break;
+				default:
+					usage();
+					return opt == 'h' ? 0 : 1;
+			}
+		}
+	} catch (const std::exception &) {
+		usage();
+		return 1;
+	}
+
+	for (const std::string &shape : shapes) {
+		fs::path root;
+		try {
+			root = tree_gen::generate(scratch, shape, entries);
+		} catch (const std::exception &e) {
+			std::cerr << e.what() << std::endl;
+			return 1;
+		}
+		for (const auto &backend : backends) {
+			if (!backend_names.empty()
+				&& std::find(backend_names.begin(), backend_names.end(), backend.first)
+					   == backend_names.end())
+				continue;
+			for (int threads : thread_counts) {
+				for (int i = 0; i < repeats; ++i)
+					run(shape, entries, root, backend, threads);
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,197 @@
+/*
+ *    Copyright (C) 2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of lib45d.
+ *
+ *    lib45d is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    lib45d is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with lib45d.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+namespace fs = std::filesystem;
+
+/**
+ * @brief Deterministic synthetic directory trees for crawler benchmarks.
+ *
+ * Every shape is generated from a fixed seed with raw std::mt19937_64 output, so the same
+ * shape and scale always produce the same names, layout and file contents.
+ */
+namespace tree_gen {
+	/**
+	 * @brief Names of the shapes generate() knows
+	 *
+	 */
+	const std::vector<std::string> shapes = {
+		"wide-flat", "deep-narrow", "many-tiny", "mixed-symlink", "hardlink-heavy"
+	};
+
+	/**
+	 * @brief Generator state for one tree
+	 *
+	 */
+	class Generator {
+	public:
+		Generator(const fs::path &root, uint64_t seed) : root_(root), rng_(seed), count_(0) {}
+		/**
+		 * @brief Get number of entries created so far, directories included
+		 *
+		 */
+		uint64_t count(void) const {
+			return count_;
+		}
+		/**
+		 * @brief One directory holding every file
+		 *
+		 */
+		void wide_flat(uint64_t entries) {
+			fs::path dir = mkdir(root_ / "flat");
+			while (count_ < entries)
+				file(dir / name("f", count_), 0);
+		}
+		/**
+		 * @brief Chains of 256 nested directories with a few files at each level
+		 *
+		 */
+		void deep_narrow(uint64_t entries) {
+			for (uint64_t chain = 0; count_ < entries; ++chain) {
+				fs::path dir = mkdir(root_ / name("chain", chain));
+				for (int depth = 0; depth < 256 && count_ < entries; ++depth) {
+					for (int f = 0; f < 3; ++f)
+						file(dir / name("f", f), 0);
+					dir = mkdir(dir / "d");
+				}
+			}
+		}
+		/**
+		 * @brief Balanced tree with 16 subdirectories and 32 files of 1-64 bytes per directory
+		 *
+		 */
+		void many_tiny(uint64_t entries) {
+			std::vector<fs::path> frontier{ mkdir(root_ / "tiny") };
+			for (size_t i = 0; i < frontier.size() && count_ < entries; ++i) {
+				for (int f = 0; f < 32 && count_ < entries; ++f)
+					file(frontier[i] / name("f", f), 1 + rng_() % 64);
+				for (int d = 0; d < 16 && count_ < entries; ++d)
+					frontier.push_back(mkdir(frontier[i] / name("d", d)));
+			}
+		}
+		/**
+		 * @brief Tree where about a third of the entries are symlinks to random files and
+		 * directories, some of them ancestors, so following them would loop
+		 *
+		 */
+		void mixed_symlink(uint64_t entries) {
+			std::vector<fs::path> dirs{ mkdir(root_ / "mixed") };
+			std::vector<fs::path> files;
+			while (count_ < entries) {
+				const fs::path &parent = dirs[rng_() % dirs.size()];
+				uint64_t roll = rng_() % 10;
+				fs::path target = parent / name("e", count_);
+				if (roll < 2) {
+					dirs.push_back(mkdir(target));
+				} else if (roll < 7 || files.empty()) {
+					file(target, rng_() % 512);
+					files.push_back(target);
+				} else if (roll < 9) {
+					fs::create_symlink(files[rng_() % files.size()], target);
+					++count_;
+				} else {
+					fs::create_directory_symlink(dirs[rng_() % dirs.size()], target);
+					++count_;
+				}
+			}
+		}
+		/**
+		 * @brief Directories full of hard links into a small pool of files, ten links per
+		 * inode on average
+		 *
+		 */
+		void hardlink_heavy(uint64_t entries) {
+			fs::path pool_dir = mkdir(root_ / "pool");
+			std::vector<fs::path> pool;
+			for (uint64_t i = 0; i < entries / 10 + 1; ++i) {
+				pool.push_back(pool_dir / name("p", i));
+				file(pool.back(), rng_() % 128);
+			}
+			fs::path dir;
+			for (uint64_t i = 0; count_ < entries; ++i) {
+				if (i % 1000 == 0)
+					dir = mkdir(root_ / name("links", i / 1000));
+				fs::create_hard_link(pool[rng_() % pool.size()], dir / name("l", i));
+				++count_;
+			}
+		}
+	private:
+		fs::path root_;
+		std::mt19937_64 rng_;
+		uint64_t count_;
+		static std::string name(const char *prefix, uint64_t i) {
+			return prefix + std::to_string(i);
+		}
+		fs::path mkdir(const fs::path &path) {
+			fs::create_directory(path);
+			++count_;
+			return path;
+		}
+		void file(const fs::path &path, size_t size) {
+			std::ofstream f(path, std::ios::binary);
+			for (size_t i = 0; i < size; ++i)
+				f.put(char('a' + rng_() % 26));
+			++count_;
+		}
+	};
+
+	/**
+	 * @brief Generate a tree of roughly the given number of entries, unless a complete one
+	 * is already there from an earlier run
+	 *
+	 * @param scratch Directory to generate trees in, ideally on tmpfs
+	 * @param shape One of tree_gen::shapes
+	 * @param entries Approximate number of entries to create
+	 * @return fs::path Root of the generated tree
+	 */
+	inline fs::path generate(const fs::path &scratch, const std::string &shape, uint64_t entries) {
+		fs::path root = scratch / (shape + "-" + std::to_string(entries));
+		fs::path marker = root / ".complete";
+		if (fs::exists(marker))
+			return root;
+		fs::remove_all(root);
+		fs::create_directories(root);
+		uint64_t seed = 0x45D0000000000000ULL;
+		for (char c : shape)
+			seed = seed * 31 + static_cast<unsigned char>(c);
+		Generator gen(root, seed);
+		if (shape == "wide-flat")
+			gen.wide_flat(entries);
+		else if (shape == "deep-narrow")
+			gen.deep_narrow(entries);
+		else if (shape == "many-tiny")
+			gen.many_tiny(entries);
+		else if (shape == "mixed-symlink")
+			gen.mixed_symlink(entries);
+		else if (shape == "hardlink-heavy")
+			gen.hardlink_heavy(entries);
+		else
+			throw std::invalid_argument("unknown shape: " + shape);
+		std::ofstream(marker) << gen.count() << std::endl;
+		return root;
+	}
+} // namespace tree_gen
@@ -21,11 +21,16 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <deque>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 #if __cplusplus >= 201703L
 #	include <filesystem>
@@ -35,19 +40,259 @@ namespace ffd_internal_fs = std::filesystem;
 namespace ffd_internal_fs = boost::filesystem;
 #endif
 
+extern "C" {
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+}
+
 namespace ffd {
+	/**
+	 * @brief Directory entry with metadata fetched up front by the crawler, see
+	 * MTDirCrawler::crawl(ffd_internal_fs::path, unsigned int, statx_callback_type, int).
+	 *
+	 * The crawler fills in the fields of the requested STATX_* mask with a single
+	 * statx(AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC) call, so callbacks can check type, size
+	 * and times without another round trip to the filesystem. The accessors fall back to
+	 * lstat() for fields that were not requested or that the filesystem did not return.
+	 *
+	 */
+	class CrawlEntry : public ffd_internal_fs::directory_entry {
+	public:
+		/**
+		 * @brief Construct an empty CrawlEntry object
+		 *
+		 */
+		CrawlEntry() : ffd_internal_fs::directory_entry(), stx_() {
+			stx_.stx_mask = 0;
+		}
+		/**
+		 * @brief Construct a new CrawlEntry object without metadata
+		 *
+		 * @param entry Directory entry to wrap
+		 */
+		CrawlEntry(const ffd_internal_fs::directory_entry &entry)
+			: ffd_internal_fs::directory_entry(entry)
+			, stx_() {
+			stx_.stx_mask = 0;
+		}
+		/**
+		 * @brief Construct a new CrawlEntry object without metadata, taking over entry
+		 *
+		 * @param entry Directory entry to wrap
+		 */
+		CrawlEntry(ffd_internal_fs::directory_entry &&entry)
+			: ffd_internal_fs::directory_entry(std::move(entry))
+			, stx_() {
+			stx_.stx_mask = 0;
+		}
+		/**
+		 * @brief Fetch metadata with statx(). Symlinks are not followed.
+		 *
+		 * @param mask STATX_* fields wanted
+		 * @return true if statx() succeeded
+		 * @return false if it failed, no fields are set
+		 */
+		bool load(unsigned int mask) {
+			if (statx(AT_FDCWD,
+					  path().c_str(),
+					  AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC,
+					  mask,
+					  &stx_)
+				== -1) {
+				stx_.stx_mask = 0;
+				return false;
+			}
+			return true;
+		}
+		/**
+		 * @brief Fetch only STATX_TYPE. Directories, regular files and symlinks are answered
+		 * from the file type readdir() reported, without a statx(); anything else falls back
+		 * to load(). Symlinks are not followed.
+		 *
+		 * @return true if the type is known
+		 * @return false if the entry is gone, no fields are set
+		 */
+		bool load_type(void) {
+#if __cplusplus >= 201703L
+			std::error_code ec;
+			mode_t type;
+			if (is_symlink(ec))
+				type = S_IFLNK;
+			else if (!ec && is_directory(ec))
+				type = S_IFDIR;
+			else if (!ec && is_regular_file(ec))
+				type = S_IFREG;
+			else
+				return load(STATX_TYPE);
+			stx_.stx_mask = STATX_TYPE;
+			stx_.stx_mode = type;
+			return true;
+#else
+			return load(STATX_TYPE);
+#endif
+		}
+		/**
+		 * @brief Check whether fields were fetched
+		 *
+		 * @param fields STATX_* mask
+		 * @return true if every field in fields is set in stx()
+		 */
+		bool has(unsigned int fields) const {
+			return (stx_.stx_mask & fields) == fields;
+		}
+		/**
+		 * @brief Get the raw statx result. Only fields covered by stx().stx_mask are valid.
+		 *
+		 * @return const struct statx&
+		 */
+		const struct statx &stx(void) const {
+			return stx_;
+		}
+		/**
+		 * @brief Check for a directory, not following symlinks
+		 *
+		 */
+		bool is_dir(void) const {
+			return S_ISDIR(type());
+		}
+		/**
+		 * @brief Check for a symlink
+		 *
+		 */
+		bool is_link(void) const {
+			return S_ISLNK(type());
+		}
+		/**
+		 * @brief Check for a regular file, not following symlinks
+		 *
+		 */
+		bool is_file(void) const {
+			return S_ISREG(type());
+		}
+		/**
+		 * @brief Get the file type and permission bits, not following symlinks
+		 *
+		 * @return mode_t 0 if the entry is gone
+		 */
+		mode_t mode(void) const {
+			if (has(STATX_TYPE | STATX_MODE))
+				return stx_.stx_mode;
+			struct stat st;
+			return fallback(st) ? st.st_mode : 0;
+		}
+		/**
+		 * @brief Get the size in bytes, not following symlinks
+		 *
+		 * @return unsigned long long 0 if the entry is gone
+		 */
+		unsigned long long size(void) const {
+			if (has(STATX_SIZE))
+				return stx_.stx_size;
+			struct stat st;
+			return fallback(st) ? st.st_size : 0;
+		}
+		/**
+		 * @brief Get the modification time, not following symlinks
+		 *
+		 * @return struct timespec zero if the entry is gone
+		 */
+		struct timespec mtime(void) const {
+			struct timespec ts = { 0, 0 };
+			if (has(STATX_MTIME)) {
+				ts.tv_sec = stx_.stx_mtime.tv_sec;
+				ts.tv_nsec = stx_.stx_mtime.tv_nsec;
+				return ts;
+			}
+			struct stat st;
+			if (fallback(st))
+				ts = st.st_mtim;
+			return ts;
+		}
+	private:
+		struct statx stx_; ///< Result of load()
+		mode_t type(void) const {
+			if (has(STATX_TYPE))
+				return stx_.stx_mode & S_IFMT;
+			return mode() & S_IFMT;
+		}
+		bool fallback(struct stat &st) const {
+			return lstat(path().c_str(), &st) == 0;
+		}
+	};
+
 	/**
 	 * @brief Crawls through a directory with multiple worker threads, calling a
 	 * calback function on each directory entry found.
 	 *
+	 * Several roots can be crawled at once by the same workers, see
+	 * MTDirCrawler::crawl(const std::vector<ffd_internal_fs::path> &, tagged_callback_type, int).
+	 *
 	 */
 	class MTDirCrawler {
 	public:
+		/**
+		 * @brief Callback type for multi-root crawls, receiving the index of the root the
+		 * entry was found under
+		 *
+		 */
+		typedef std::function<bool(const ffd_internal_fs::directory_entry &, size_t root)>
+			tagged_callback_type;
+		/**
+		 * @brief Callback type for crawls that fetch metadata up front
+		 *
+		 */
+		typedef std::function<bool(const CrawlEntry &)> statx_callback_type;
+		/**
+		 * @brief Snapshot of crawl progress, see MTDirCrawler::progress()
+		 *
+		 */
+		struct Progress {
+			unsigned long dirs_completed; ///< Directories fully expanded
+			unsigned long entries_seen;   ///< Entries passed to the callback
+			unsigned long pending;        ///< Entries queued but not yet visited
+			unsigned long long bytes_seen; ///< Size of regular files seen, see set_count_bytes()
+		};
+#ifdef FFD_CRAWLER_LOCK_STATS
+		/**
+		 * @brief Time the workers of the last crawl spent waiting on the shared queue, see
+		 * MTDirCrawler::lock_stats(). Only collected when FFD_CRAWLER_LOCK_STATS is defined
+		 * before including the header, since timing every contended lock costs a clock read.
+		 *
+		 */
+		struct LockStats {
+			unsigned long long lock_waits;   ///< Queue lock acquisitions that had to block
+			unsigned long long lock_wait_ns; ///< Time blocked on the queue lock
+			unsigned long long cv_waits;     ///< Waits for the queue to fill
+			unsigned long long cv_wait_ns;   ///< Time spent waiting for the queue to fill
+			LockStats() : lock_waits(0), lock_wait_ns(0), cv_waits(0), cv_wait_ns(0) {}
+		};
+#endif
 		/**
 		 * @brief Construct a new MTDirCrawler object
 		 *
 		 */
-		MTDirCrawler() : done_(false), queue_(), workers_(), threads_running_(0), mutex_(), cv_() {}
+		MTDirCrawler()
+			: done_(false)
+			, queue_()
+			, workers_()
+			, threads_running_(0)
+			, mutex_()
+			, cv_()
+			, cancelled_(false)
+			, has_deadline_(false)
+			, deadline_()
+			, count_bytes_(false)
+			, pending_(0)
+			, counters_()
+			, n_counters_(0)
+			, counters_capacity_(0)
+			, counters_mutex_()
+			, dedup_(false)
+			, statx_mask_(0)
+			, root_keys_()
+			, visited_()
+			, visited_mutex_() {}
 		/**
 		 * @brief Destroy the MTDirCrawler object
 		 *
@@ -88,11 +333,104 @@ namespace ffd {
 		void crawl_async(ffd_internal_fs::path base_path,
 						 std::function<bool(const ffd_internal_fs::directory_entry &)> callback,
 						 int threads) {
-			seed(base_path);
-			threads_running_ = threads;
-			for (int i = 0; i < threads; ++i) {
-				workers_.emplace_back(&MTDirCrawler::worker, this, callback);
+			dedup_ = false;
+			statx_mask_ = 0;
+			start(std::vector<ffd_internal_fs::path>{ base_path },
+				  [callback](const CrawlEntry &entry, size_t) { return callback(entry); },
+				  threads);
+		}
+		/**
+		 * @brief Crawl, fetching the metadata the callback needs with one statx() per entry,
+		 * and wait for the workers to finish.
+		 *
+		 * Checking fs::is_directory(), fs::is_symlink(), fs::file_size() etc. from a callback
+		 * costs a stat() each, which adds up on network filesystems. Declare the fields needed
+		 * as a STATX_* mask instead and read them from the CrawlEntry. STATX_TYPE is always
+		 * fetched, since the crawler needs it to decide whether to recurse. Unlike the
+		 * directory_entry crawl, symlinks to directories are never followed.
+		 *
+		 * @param base_path Path to start the traversal from
+		 * @param statx_mask STATX_* fields to fetch for each entry
+		 * @param callback Function to call on each entry,
+		 * should return true if the entry should be recursed into
+		 * @param threads Number of worker threads to spawn
+		 */
+		void crawl(ffd_internal_fs::path base_path,
+				   unsigned int statx_mask,
+				   statx_callback_type callback,
+				   int threads) {
+			crawl_async(base_path, statx_mask, callback, threads);
+			wait();
+		}
+		/**
+		 * @brief Version of MTDirCrawler::crawl(ffd_internal_fs::path, unsigned int,
+		 * statx_callback_type, int) that does not wait. MTDirCrawler::wait() must be called at
+		 * some point to join threads.
+		 *
+		 * @param base_path Path to start the traversal from
+		 * @param statx_mask STATX_* fields to fetch for each entry
+		 * @param callback Function to call on each entry,
+		 * should return true if the entry should be recursed into
+		 * @param threads Number of worker threads to spawn
+		 */
+		void crawl_async(ffd_internal_fs::path base_path,
+						 unsigned int statx_mask,
+						 statx_callback_type callback,
+						 int threads) {
+			dedup_ = false;
+			statx_mask_ = statx_mask | STATX_TYPE;
+			start(std::vector<ffd_internal_fs::path>{ base_path },
+				  [callback](const CrawlEntry &entry, size_t) { return callback(entry); },
+				  threads);
+		}
+		/**
+		 * @brief Crawl several roots with one shared pool of workers and wait for them to
+		 * finish.
+		 *
+		 * Roots may overlap, e.g. one export nested inside or bind mounted onto another.
+		 * Directories are identified by (st_dev, st_ino) and expanded only once: a directory
+		 * that is itself one of the roots is left to that root, so its entries are tagged with
+		 * the most specific root, and a directory reached again through another path or a
+		 * duplicate root is not expanded again. The callback is called with the index into
+		 * roots of the root each entry was found under.
+		 *
+		 * @param roots Paths to start the traversal from
+		 * @param callback Function to call on each directory entry with its root index,
+		 * should return true if the directory entry should be recursed into
+		 * @param threads Number of worker threads to spawn
+		 */
+		void crawl(const std::vector<ffd_internal_fs::path> &roots,
+				   tagged_callback_type callback,
+				   int threads) {
+			crawl_async(roots, callback, threads);
+			wait();
+		}
+		/**
+		 * @brief Multi-root version of MTDirCrawler::crawl_async(). MTDirCrawler::wait() must
+		 * be called at some point to join threads.
+		 *
+		 * @param roots Paths to start the traversal from
+		 * @param callback Function to call on each directory entry with its root index,
+		 * should return true if the directory entry should be recursed into
+		 * @param threads Number of worker threads to spawn
+		 */
+		void crawl_async(const std::vector<ffd_internal_fs::path> &roots,
+						 tagged_callback_type callback,
+						 int threads) {
+			dedup_ = true;
+			statx_mask_ = 0;
+			root_keys_.clear();
+			visited_.clear();
+			for (size_t i = 0; i < roots.size(); ++i) {
+				Key key;
+				if (get_key(roots[i], key))
+					root_keys_.insert(std::make_pair(key, i)); // first of duplicates wins
 			}
+			start(roots,
+				  [callback](const CrawlEntry &entry, size_t root) {
+					  return callback(entry, root);
+				  },
+				  threads);
 		}
 		/**
 		 * @brief Wait for threads to finish. Must be called at some point after
@@ -104,39 +442,320 @@ namespace ffd {
 				t.join();
 			}
 			workers_.clear();
+			queue_.clear(); // left over if cancelled
+			pending_ = 0;
 			done_ = false;
 		}
+		/**
+		 * @brief Stop the crawl as soon as possible. Workers finish the entry they are on,
+		 * stop queuing new entries and exit, dropping whatever is still queued. Safe to call
+		 * from any thread, including from inside the callback. MTDirCrawler::wait() must
+		 * still be called.
+		 *
+		 */
+		void cancel(void) {
+			cancelled_ = true;
+			std::lock_guard<std::mutex> lk(mutex_);
+			cv_.notify_all();
+		}
+		/**
+		 * @brief Check whether the last crawl was stopped early by cancel() or the deadline
+		 *
+		 * @return true if stopped early
+		 * @return false if the crawl ran to completion or is still running
+		 */
+		bool cancelled(void) const {
+			return cancelled_;
+		}
+		/**
+		 * @brief Cancel crawls still running at the given time. Applies to every following
+		 * crawl until clear_deadline() is called.
+		 *
+		 * @param deadline Time point to stop at
+		 */
+		void set_deadline(std::chrono::steady_clock::time_point deadline) {
+			deadline_ = deadline;
+			has_deadline_ = true;
+		}
+		/**
+		 * @brief Remove the deadline set with set_deadline()
+		 *
+		 */
+		void clear_deadline(void) {
+			has_deadline_ = false;
+		}
+		/**
+		 * @brief Sum the sizes of regular files into Progress::bytes_seen. This costs a stat()
+		 * per file, so it is off by default, unless the crawl already fetches STATX_SIZE.
+		 *
+		 * @param count_bytes true to count bytes
+		 */
+		void set_count_bytes(bool count_bytes) {
+			count_bytes_ = count_bytes;
+		}
+		/**
+		 * @brief Get a snapshot of the crawl's progress. Meant to be polled from another
+		 * thread while a crawl is running; it only takes a lock shared with the start of a
+		 * crawl, never the lock the workers queue entries under. After wait() the figures
+		 * are those of the finished crawl until the next crawl starts and resets them.
+		 *
+		 * @return Progress
+		 */
+		Progress progress(void) const {
+			Progress p = { 0, 0, 0, 0 };
+			std::lock_guard<std::mutex> lk(counters_mutex_);
+			for (int i = 0; i < n_counters_; ++i) {
+				p.dirs_completed += counters_[i].dirs.load(std::memory_order_relaxed);
+				p.entries_seen += counters_[i].entries.load(std::memory_order_relaxed);
+				p.bytes_seen += counters_[i].bytes.load(std::memory_order_relaxed);
+			}
+			p.pending = pending_.load(std::memory_order_relaxed);
+			return p;
+		}
+#ifdef FFD_CRAWLER_LOCK_STATS
+		/**
+		 * @brief Get the queue lock waits of the last crawl. Only valid after wait().
+		 *
+		 * @return const LockStats&
+		 */
+		const LockStats &lock_stats(void) const {
+			return lock_stats_;
+		}
+#endif
 	private:
-		bool done_;
-		std::deque<ffd_internal_fs::directory_entry> queue_;
+		/**
+		 * @brief Callback type used by the workers
+		 *
+		 */
+		typedef std::function<bool(const CrawlEntry &, size_t root)> entry_callback_type;
+		/**
+		 * @brief Queued entry with the index of the root it was found under. Only the
+		 * directory_entry is queued; the worker that pops it builds the CrawlEntry, so the
+		 * statx buffer isn't carried through the queue.
+		 *
+		 */
+		struct Node {
+			ffd_internal_fs::directory_entry entry;
+			size_t root;
+			Node() : entry(), root(0) {}
+			Node(const ffd_internal_fs::directory_entry &e, size_t r) : entry(e), root(r) {}
+		};
+		typedef std::pair<dev_t, ino_t> Key; ///< Identity of a directory
+		/**
+		 * @brief Hash for Key
+		 *
+		 */
+		struct KeyHash {
+			size_t operator()(const Key &key) const {
+				return std::hash<dev_t>()(key.first) * 31 + std::hash<ino_t>()(key.second);
+			}
+		};
+		/**
+		 * @brief Progress counters of one worker, written only by that worker and padded to
+		 * keep workers off each other's cache lines
+		 *
+		 */
+		struct Counters {
+			std::atomic<unsigned long> dirs;
+			std::atomic<unsigned long> entries;
+			std::atomic<unsigned long long> bytes;
+			char pad[64 - sizeof(std::atomic<unsigned long>) * 2
+					 - sizeof(std::atomic<unsigned long long>)];
+			Counters() : dirs(0), entries(0), bytes(0) {}
+		};
+		std::atomic<bool> done_;
+		std::deque<Node> queue_;
 		std::vector<std::thread> workers_;
 		std::atomic<int> threads_running_;
 		std::mutex mutex_;
 		std::condition_variable cv_;
-		void seed(const ffd_internal_fs::path &base_path) {
-			queue_.emplace_back(base_path);
+		std::atomic<bool> cancelled_; ///< Set by cancel() or when the deadline passes
+		bool has_deadline_;           ///< Whether deadline_ applies
+		std::chrono::steady_clock::time_point deadline_; ///< When to cancel the crawl
+		bool count_bytes_;                 ///< Whether to stat files for Progress::bytes_seen
+		std::atomic<unsigned long> pending_; ///< Mirror of queue_.size() for progress()
+		std::unique_ptr<Counters[]> counters_; ///< One per worker, only grown between crawls
+		int n_counters_;                       ///< Counters in use by the current crawl
+		int counters_capacity_;                ///< Length of counters_
+		mutable std::mutex counters_mutex_;    ///< Guards counters_ against start()
+		bool dedup_;                           ///< Multi-root crawl, expand directories once
+		unsigned int statx_mask_;              ///< Fields to fetch per entry, 0 for none
+		std::unordered_map<Key, size_t, KeyHash> root_keys_; ///< Root directories
+		std::unordered_set<Key, KeyHash> visited_;           ///< Directories expanded so far
+		std::mutex visited_mutex_;                           ///< Guards visited_
+#ifdef FFD_CRAWLER_LOCK_STATS
+		LockStats lock_stats_; ///< Guarded by mutex_, see lock_stats()
+#endif
+		void start(const std::vector<ffd_internal_fs::path> &roots,
+				   entry_callback_type callback,
+				   int threads) {
+			cancelled_ = false;
+			{
+				std::lock_guard<std::mutex> lk(counters_mutex_);
+				if (threads > counters_capacity_) {
+					counters_.reset(new Counters[threads]);
+					counters_capacity_ = threads;
+				}
+				for (int i = 0; i < threads; ++i) {
+					counters_[i].dirs = 0;
+					counters_[i].entries = 0;
+					counters_[i].bytes = 0;
+				}
+				n_counters_ = threads;
+			}
+#ifdef FFD_CRAWLER_LOCK_STATS
+			lock_stats_ = LockStats();
+#endif
+			for (size_t i = 0; i < roots.size(); ++i)
+				seed(roots[i], i);
+			threads_running_ = threads;
+			for (int i = 0; i < threads; ++i) {
+				workers_.emplace_back(&MTDirCrawler::worker, this, callback, &counters_[i]);
+			}
+		}
+		void seed(const ffd_internal_fs::path &base_path, size_t root) {
+			queue_.emplace_back(ffd_internal_fs::directory_entry(base_path), root);
+			pending_ = queue_.size();
+		}
+		static bool get_key(const ffd_internal_fs::path &path, Key &key) {
+			struct stat st;
+			if (stat(path.c_str(), &st) == -1)
+				return false;
+			key = Key(st.st_dev, st.st_ino);
+			return true;
+		}
+		/**
+		 * @brief Check whether a directory is one of the other roots, which will crawl it
+		 *
+		 */
+		bool belongs_to_other_root(const Key &key, size_t root) const {
+			std::unordered_map<Key, size_t, KeyHash>::const_iterator itr = root_keys_.find(key);
+			return itr != root_keys_.end() && itr->second != root;
+		}
+		/**
+		 * @brief Mark a directory as expanded
+		 *
+		 * @return true if it was not expanded before
+		 */
+		bool claim(const Key &key) {
+			std::lock_guard<std::mutex> lk(visited_mutex_);
+			return visited_.insert(key).second;
 		}
-		void worker(std::function<bool(const ffd_internal_fs::directory_entry &)> callback) {
-			ffd_internal_fs::directory_entry node;
+		/**
+		 * @brief Check for cancellation and the deadline
+		 *
+		 * @return true if workers should stop
+		 */
+		bool should_stop(void) {
+			if (cancelled_.load(std::memory_order_relaxed))
+				return true;
+			if (has_deadline_ && std::chrono::steady_clock::now() >= deadline_) {
+				cancelled_ = true;
+				return true;
+			}
+			return false;
+		}
+		/**
+		 * @brief Check whether to recurse into an entry. Uses the statx() result if there is
+		 * one, which does not follow symlinks.
+		 *
+		 */
+		static bool is_directory(const CrawlEntry &entry) {
+			if (entry.has(STATX_TYPE))
+				return S_ISDIR(entry.stx().stx_mode);
+			return ffd_internal_fs::is_directory(entry);
+		}
+		/**
+		 * @brief Lock the queue, timing the wait when FFD_CRAWLER_LOCK_STATS is defined
+		 *
+		 */
+		std::unique_lock<std::mutex> lock_queue(void) {
+#ifdef FFD_CRAWLER_LOCK_STATS
+			std::unique_lock<std::mutex> lk(mutex_, std::try_to_lock);
+			if (!lk.owns_lock()) {
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				lk.lock();
+				++lock_stats_.lock_waits;
+				lock_stats_.lock_wait_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+												std::chrono::steady_clock::now() - start)
+												.count();
+			}
+			return lk;
+#else
+			return std::unique_lock<std::mutex>(mutex_);
+#endif
+		}
+		void worker(entry_callback_type callback, Counters *counters) {
+			Node next;
 			while (!done_) {
 				{
-					std::unique_lock<std::mutex> lk(mutex_);
+					std::unique_lock<std::mutex> lk = lock_queue();
 					--threads_running_;
-					if (threads_running_ <= 0 && queue_.empty()) {
+					if ((threads_running_ <= 0 && queue_.empty()) || should_stop()) {
 						done_ = true;
 						cv_.notify_all();
 						return;
 					}
 					while (queue_.empty() && !done_) {
-						cv_.wait(lk);
+#ifdef FFD_CRAWLER_LOCK_STATS
+						std::chrono::steady_clock::time_point start =
+							std::chrono::steady_clock::now();
+#endif
+						if (has_deadline_)
+							cv_.wait_until(lk, deadline_);
+						else
+							cv_.wait(lk);
+#ifdef FFD_CRAWLER_LOCK_STATS
+						++lock_stats_.cv_waits;
+						lock_stats_.cv_wait_ns +=
+							std::chrono::duration_cast<std::chrono::nanoseconds>(
+								std::chrono::steady_clock::now() - start)
+								.count();
+#endif
+						if (should_stop()) {
+							done_ = true;
+							cv_.notify_all();
+							return;
+						}
 					}
-					if (done_ && queue_.empty())
+					if (done_)
 						return;
-					node = queue_.front();
+					next = std::move(queue_.front());
 					queue_.pop_front();
+					pending_.store(queue_.size(), std::memory_order_relaxed);
 					++threads_running_;
 				}
-				if (callback(node) && ffd_internal_fs::is_directory(node)) {
+				CrawlEntry node(std::move(next.entry));
+				if (statx_mask_ == STATX_TYPE)
+					node.load_type(); // the crawler's own need, answered by readdir()
+				else if (statx_mask_)
+					node.load(statx_mask_);
+				Key key;
+				bool have_key = false;
+				if (dedup_ && is_directory(node)) {
+					have_key = get_key(node.path(), key);
+					if (have_key && belongs_to_other_root(key, next.root))
+						continue;
+				}
+				counters->entries.store(counters->entries.load(std::memory_order_relaxed) + 1,
+										std::memory_order_relaxed);
+				if (count_bytes_ && node.has(STATX_TYPE | STATX_SIZE)) {
+					if (S_ISREG(node.stx().stx_mode))
+						counters->bytes.store(counters->bytes.load(std::memory_order_relaxed)
+												  + node.stx().stx_size,
+											  std::memory_order_relaxed);
+				} else if (count_bytes_
+						   && ffd_internal_fs::is_regular_file(node.symlink_status())) {
+					try {
+						counters->bytes.store(counters->bytes.load(std::memory_order_relaxed)
+												  + ffd_internal_fs::file_size(node.path()),
+											  std::memory_order_relaxed);
+					} catch (const ffd_internal_fs::filesystem_error &) {
+						// gone since it was listed
+					}
+				}
+				if (callback(node, next.root) && is_directory(node)
+					&& (!have_key || claim(key))) {
 #if __cplusplus >= 201703L
 					for (auto const &node : ffd_internal_fs::directory_iterator{ node }) {
 #else
@@ -144,16 +763,21 @@ namespace ffd {
 						 ditr != ffd_internal_fs::directory_iterator{};
 						 *ditr++) {
 #endif
+						if (should_stop())
+							break;
 						{
-							std::lock_guard<std::mutex> lk(mutex_);
+							std::unique_lock<std::mutex> lk = lock_queue();
 #if __cplusplus >= 201703L
-							queue_.emplace_back(node);
+							queue_.emplace_back(node, next.root);
 #else
-							queue_.emplace_back(*ditr);
+							queue_.emplace_back(*ditr, next.root);
 #endif
+							pending_.store(queue_.size(), std::memory_order_relaxed);
 						}
 						cv_.notify_one();
 					}
+					counters->dirs.store(counters->dirs.load(std::memory_order_relaxed) + 1,
+										 std::memory_order_relaxed);
 				}
 			}
 		}
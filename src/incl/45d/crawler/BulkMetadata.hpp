@@ -0,0 +1,334 @@
+// -*- C++ -*-
+/*
+ *    Copyright (C) 2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of lib45d.
+ *
+ *    lib45d is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    lib45d is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with lib45d.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <45d/MTDirCrawler.hpp>
+#include <45d/crawler/DirFdCache.hpp>
+#include <45d/crawler/Exceptions.hpp>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+}
+
+namespace ffd {
+	/**
+	 * @brief Applies owner, mode, timestamp and POSIX ACL changes to every entry of a tree on
+	 * all MTDirCrawler workers, like chown -R, chmod -R, touch and setfacl -R.
+	 *
+	 * Each entry is opened with O_PATH | O_NOFOLLOW relative to its parent directory fd (see
+	 * DirFdCache) and looked at with fstat() on that fd. Only the attributes that differ from
+	 * the target are changed, through the same fd, so an entry swapped for a symlink after it
+	 * was checked is never followed. Symlinks are chowned and touched (by name, with
+	 * AT_SYMLINK_NOFOLLOW) but never followed, and their mode and ACLs are left alone. In dry
+	 * run mode nothing is changed, only counted.
+	 *
+	 * Modes are applied before a directory is recursed into, so a directory mode that takes
+	 * away the owner's search permission stops the crawl there, same as chmod -R.
+	 *
+	 * Example:
+	 * @include tests/MTDirCrawler/bulk_metadata.cpp
+	 */
+	class BulkMetadataUpdater {
+	public:
+		/**
+		 * @brief Counters of work done, see BulkMetadataUpdater::stats()
+		 *
+		 */
+		struct Stats {
+			unsigned long examined;  ///< Entries looked at
+			unsigned long changed;   ///< Entries with at least one attribute changed
+			unsigned long unchanged; ///< Entries already matching the targets
+			unsigned long errors;    ///< Entries where a stat or change failed
+		};
+		/**
+		 * @brief Construct a new Bulk Metadata Updater object with nothing to change
+		 *
+		 */
+		BulkMetadataUpdater()
+			: uid_(-1)
+			, gid_(-1)
+			, file_mode_(-1)
+			, dir_mode_(-1)
+			, set_times_(false)
+			, set_acl_(false)
+			, access_acl_()
+			, default_acl_()
+			, dry_run_(false)
+			, examined_(0)
+			, changed_(0)
+			, unchanged_(0)
+			, errors_(0) {
+			times_[0].tv_sec = times_[1].tv_sec = 0;
+			times_[0].tv_nsec = times_[1].tv_nsec = UTIME_OMIT;
+		}
+		/**
+		 * @brief Set owner and group, (uid_t)-1 or (gid_t)-1 to leave either alone
+		 *
+		 * @param uid New owner
+		 * @param gid New group
+		 */
+		void set_owner(uid_t uid, gid_t gid) {
+			uid_ = uid;
+			gid_ = gid;
+		}
+		/**
+		 * @brief Set permission bits (including setuid, setgid and sticky) of non-directories
+		 * and directories, (mode_t)-1 to leave either alone
+		 *
+		 * @param file_mode Mode for everything but directories and symlinks
+		 * @param dir_mode Mode for directories
+		 */
+		void set_mode(mode_t file_mode, mode_t dir_mode) {
+			file_mode_ = file_mode;
+			dir_mode_ = dir_mode;
+		}
+		/**
+		 * @brief Set access and modification times. tv_nsec may be UTIME_OMIT or UTIME_NOW,
+		 * see utimensat(2).
+		 *
+		 * @param atime New access time
+		 * @param mtime New modification time
+		 */
+		void set_times(const struct timespec &atime, const struct timespec &mtime) {
+			times_[0] = atime;
+			times_[1] = mtime;
+			set_times_ = atime.tv_nsec != UTIME_OMIT || mtime.tv_nsec != UTIME_OMIT;
+		}
+		/**
+		 * @brief Set POSIX ACLs from raw system.posix_acl_access and system.posix_acl_default
+		 * xattr values. An empty default ACL leaves directory default ACLs alone.
+		 *
+		 * @param access_acl Access ACL for every entry
+		 * @param default_acl Default ACL for directories
+		 */
+		void set_acl(const std::string &access_acl, const std::string &default_acl) {
+			access_acl_ = access_acl;
+			default_acl_ = default_acl;
+			set_acl_ = !access_acl_.empty() || !default_acl_.empty();
+		}
+		/**
+		 * @brief Copy POSIX ACLs from a reference file or directory, like
+		 * getfacl ref | setfacl --set-file=-
+		 *
+		 * @param reference_path Path to take ACLs from
+		 */
+		void set_acl_from(const std::string &reference_path) {
+			set_acl(read_xattr(reference_path, "system.posix_acl_access"),
+					read_xattr(reference_path, "system.posix_acl_default"));
+		}
+		/**
+		 * @brief Only count what would change, without changing anything
+		 *
+		 * @param dry_run true for dry run
+		 */
+		void set_dry_run(bool dry_run) {
+			dry_run_ = dry_run;
+		}
+		/**
+		 * @brief Apply the changes to one entry. Thread safe, meant to be called from a crawl
+		 * callback. The entry's path must not go through symlinks, see DirFdCache.
+		 *
+		 * @param entry Directory entry to update
+		 * @return true if anything was (or in dry run mode would have been) changed
+		 */
+		bool apply(const ffd_internal_fs::directory_entry &entry) {
+			++examined_;
+			ffd_internal_fs::path norm =
+				entry.path().has_filename() ? entry.path() : entry.path().parent_path();
+			int dirfd = DirFdCache::local().get(norm.parent_path().string());
+			if (dirfd == -1) {
+				++errors_;
+				return false;
+			}
+			std::string name = norm.filename().string();
+			int fd = openat(dirfd, name.c_str(), O_PATH | O_NOFOLLOW | O_CLOEXEC);
+			struct stat st;
+			if (fd == -1 || fstat(fd, &st) == -1) {
+				if (fd != -1)
+					close(fd);
+				++errors_;
+				return false;
+			}
+			// O_PATH fds can't be fchmod()ed or have xattrs set, but their /proc link can,
+			// and it leads to the inode checked above whatever happens to its name
+			std::string fd_path = "/proc/self/fd/" + std::to_string(fd);
+			bool changed = false, failed = false;
+			if ((uid_ != uid_t(-1) && st.st_uid != uid_)
+				|| (gid_ != gid_t(-1) && st.st_gid != gid_)) {
+				changed = true;
+				if (!dry_run_ && fchownat(fd, "", uid_, gid_, AT_EMPTY_PATH) == -1)
+					failed = true;
+			}
+			if (!S_ISLNK(st.st_mode)) {
+				mode_t mode = S_ISDIR(st.st_mode) ? dir_mode_ : file_mode_;
+				if (mode != mode_t(-1) && (st.st_mode & 07777) != (mode & 07777)) {
+					changed = true;
+					if (!dry_run_ && chmod(fd_path.c_str(), mode & 07777) == -1)
+						failed = true;
+				}
+			}
+			if (set_times_ && times_differ(st)) {
+				changed = true;
+				// a symlink's /proc link would be followed, so symlinks are touched by name
+				if (!dry_run_
+					&& (S_ISLNK(st.st_mode)
+							? utimensat(dirfd, name.c_str(), times_, AT_SYMLINK_NOFOLLOW)
+							: utimensat(AT_FDCWD, fd_path.c_str(), times_, 0))
+						   == -1)
+					failed = true;
+			}
+			if (set_acl_ && !S_ISLNK(st.st_mode)) {
+				if (!access_acl_.empty())
+					changed |= apply_xattr(fd_path, "system.posix_acl_access", access_acl_, failed);
+				if (!default_acl_.empty() && S_ISDIR(st.st_mode))
+					changed |=
+						apply_xattr(fd_path, "system.posix_acl_default", default_acl_, failed);
+			}
+			close(fd);
+			if (failed)
+				++errors_;
+			if (changed)
+				++changed_;
+			else
+				++unchanged_;
+			return changed;
+		}
+		/**
+		 * @brief Crawl a tree and apply the changes to every entry in it, including the root.
+		 * Symlinks to directories are not followed. Symlinks in the path leading to root are
+		 * resolved first.
+		 *
+		 * @param root Path to start the traversal from
+		 * @param threads Number of worker threads to spawn
+		 * @return Stats Counters for this run
+		 */
+		Stats run(const ffd_internal_fs::path &root, int threads) {
+			reset_stats();
+			ffd_internal_fs::path norm = root.has_filename() ? root : root.parent_path();
+			ffd_internal_fs::path start = norm;
+			try {
+				ffd_internal_fs::path parent = norm.parent_path();
+				start = ffd_internal_fs::canonical(parent.empty() ? "." : parent) / norm.filename();
+			} catch (const ffd_internal_fs::filesystem_error &) {
+				// parent missing, apply() counts the root as an error
+			}
+			MTDirCrawler crawler;
+			crawler.crawl(
+				start,
+				[this](const ffd_internal_fs::directory_entry &entry) {
+					apply(entry);
+					return ffd_internal_fs::is_directory(entry.symlink_status());
+				},
+				threads);
+			return stats();
+		}
+		/**
+		 * @brief Get counters, safe to call while a run is in progress
+		 *
+		 * @return Stats
+		 */
+		Stats stats(void) const {
+			Stats s;
+			s.examined = examined_;
+			s.changed = changed_;
+			s.unchanged = unchanged_;
+			s.errors = errors_;
+			return s;
+		}
+		/**
+		 * @brief Zero the counters
+		 *
+		 */
+		void reset_stats(void) {
+			examined_ = changed_ = unchanged_ = errors_ = 0;
+		}
+	private:
+		uid_t uid_;                ///< Target owner or -1
+		gid_t gid_;                ///< Target group or -1
+		mode_t file_mode_;         ///< Target mode of non-directories or -1
+		mode_t dir_mode_;          ///< Target mode of directories or -1
+		bool set_times_;           ///< Whether times_ has anything to set
+		struct timespec times_[2]; ///< Target atime and mtime
+		bool set_acl_;             ///< Whether any ACL is set
+		std::string access_acl_;   ///< Raw system.posix_acl_access value
+		std::string default_acl_;  ///< Raw system.posix_acl_default value
+		bool dry_run_;             ///< Count only
+		std::atomic<unsigned long> examined_;
+		std::atomic<unsigned long> changed_;
+		std::atomic<unsigned long> unchanged_;
+		std::atomic<unsigned long> errors_;
+		bool times_differ(const struct stat &st) const {
+			const struct timespec *cur[2] = { &st.st_atim, &st.st_mtim };
+			for (int i = 0; i < 2; ++i) {
+				if (times_[i].tv_nsec == UTIME_OMIT)
+					continue;
+				if (times_[i].tv_nsec == UTIME_NOW || times_[i].tv_sec != cur[i]->tv_sec
+					|| times_[i].tv_nsec != cur[i]->tv_nsec)
+					return true;
+			}
+			return false;
+		}
+		/**
+		 * @brief Set an xattr on a /proc/self/fd path unless it already holds value. The
+		 * current value is only read when its size matches, so ACLs of any size compare.
+		 *
+		 */
+		bool apply_xattr(const std::string &path,
+						 const char *name,
+						 const std::string &value,
+						 bool &failed) {
+			ssize_t len = getxattr(path.c_str(), name, nullptr, 0);
+			if (len == ssize_t(value.length())) {
+				std::string cur(len, '\0');
+				if (getxattr(path.c_str(), name, &cur[0], cur.length()) == len && cur == value)
+					return false;
+			}
+			if (!dry_run_ && setxattr(path.c_str(), name, value.data(), value.length(), 0) == -1)
+				failed = true;
+			return true;
+		}
+		static std::string read_xattr(const std::string &path, const char *name) {
+			ssize_t len = lgetxattr(path.c_str(), name, nullptr, 0);
+			if (len == -1) {
+				int error = errno;
+				if (error == ENODATA || error == ENOTSUP)
+					return std::string();
+				throw CrawlerException(path + ": " + strerror(error), error);
+			}
+			std::string value(len, '\0');
+			len = lgetxattr(path.c_str(), name, &value[0], value.length());
+			if (len == -1) {
+				int error = errno;
+				throw CrawlerException(path + ": " + strerror(error), error);
+			}
+			value.resize(len);
+			return value;
+		}
+	};
+} // namespace ffd
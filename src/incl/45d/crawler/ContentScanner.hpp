@@ -0,0 +1,397 @@
+// -*- C++ -*-
+/*
+ *    Copyright (C) 2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of lib45d.
+ *
+ *    lib45d is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    lib45d is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with lib45d.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <45d/crawler/Exceptions.hpp>
+#include <45d/low_overhead_string.hpp>
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#if __cplusplus >= 201703L
+#	include <filesystem>
+namespace ffd_internal_fs = std::filesystem;
+#else
+#	include <boost/filesystem.hpp>
+namespace ffd_internal_fs = boost::filesystem;
+#endif
+
+extern "C" {
+#include <fcntl.h>
+#include <string.h> // for memmem
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+namespace ffd {
+	/**
+	 * @brief Default parameters for ContentScanner
+	 *
+	 */
+	namespace ContentScan {
+		const size_t _queue_default = 4096; ///< Paths queued before submit() blocks
+		/**
+		 * @brief Files larger than this are mmap()ed, smaller ones are read() into a reused
+		 * buffer. Can be overridden by defining FFD_CONTENT_SCAN_MMAP_MIN before including
+		 * header.
+		 *
+		 */
+		const size_t _mmap_min =
+#ifndef FFD_CONTENT_SCAN_MMAP_MIN
+			256 * 1024;
+#else
+			FFD_CONTENT_SCAN_MMAP_MIN;
+#endif
+		const size_t _stream_chunk = 1024 * 1024; ///< read() size when mmap() fails
+		/**
+		 * @brief Longest unfinished line carried from one chunk to the next when mmap()
+		 * fails. Longer lines are matched against wildcard patterns in pieces.
+		 *
+		 */
+		const size_t _stream_max_line = 64 * 1024;
+	} // namespace ContentScan
+
+	/**
+	 * @brief Searches file contents for literal or wildcard patterns on a pool of I/O threads,
+	 * fed by an MTDirCrawler callback so the crawl keeps going while files are scanned.
+	 *
+	 * Patterns without '*' or '?' are literals found anywhere in the file with memmem(), which
+	 * glibc implements with vectorized scanning. Patterns with wildcards are matched line by
+	 * line with ffd::pattern_match(), using the longest literal run of the pattern to skip
+	 * straight to candidate lines.
+	 *
+	 * The match callback is called from the scanner threads, once per file and pattern, with
+	 * the offset of the first match (the start of the line for wildcard patterns).
+	 *
+	 * Example:
+	 * @include tests/MTDirCrawler/content_scan.cpp
+	 */
+	class ContentScanner {
+	public:
+		typedef std::function<void(const std::string &path, size_t pattern, size_t offset)>
+			match_callback_type; ///< Match callback type
+		/**
+		 * @brief Construct a new Content Scanner object and start the scanner threads
+		 *
+		 * @param patterns Literal or wildcard patterns to search for
+		 * @param on_match Called for each file and pattern that matches
+		 * @param threads Number of scanner threads
+		 * @param max_queued Number of paths to queue before submit() blocks
+		 */
+		ContentScanner(const std::vector<std::string> &patterns,
+					   match_callback_type on_match,
+					   int threads,
+					   size_t max_queued = ContentScan::_queue_default)
+			: patterns_()
+			, on_match_(on_match)
+			, max_queued_(max_queued ? max_queued : 1)
+			, done_(false)
+			, queue_()
+			, workers_()
+			, mutex_()
+			, not_empty_()
+			, not_full_() {
+			for (const std::string &pattern : patterns)
+				patterns_.push_back(Pattern(pattern));
+			for (int i = 0; i < threads; ++i)
+				workers_.emplace_back(&ContentScanner::worker, this);
+		}
+		ContentScanner(const ContentScanner &) = delete;
+		ContentScanner &operator=(const ContentScanner &) = delete;
+		/**
+		 * @brief Destroy the Content Scanner object, finishing queued work first
+		 *
+		 */
+		~ContentScanner() {
+			finish();
+		}
+		/**
+		 * @brief Queue a file to be scanned. Blocks while the queue is full so a fast crawl
+		 * can't outrun the scanners without bound.
+		 *
+		 * @param path Path to file
+		 */
+		void submit(const std::string &path) {
+			{
+				std::unique_lock<std::mutex> lk(mutex_);
+				while (queue_.size() >= max_queued_)
+					not_full_.wait(lk);
+				queue_.push_back(path);
+			}
+			not_empty_.notify_one();
+		}
+		/**
+		 * @brief Wrap a crawl callback so regular files it returns true for are submitted to
+		 * the scanner. Directories are still recursed into according to the return value.
+		 *
+		 * @param callback MTDirCrawler callback to wrap
+		 * @return std::function<bool(const ffd_internal_fs::directory_entry &)>
+		 */
+		std::function<bool(const ffd_internal_fs::directory_entry &)>
+		wrap(std::function<bool(const ffd_internal_fs::directory_entry &)> callback) {
+			return [this, callback](const ffd_internal_fs::directory_entry &entry) {
+				bool accept = callback(entry);
+				if (accept && ffd_internal_fs::is_regular_file(entry.symlink_status()))
+					submit(entry.path().string());
+				return accept;
+			};
+		}
+		/**
+		 * @brief Wait for the queue to drain and join the scanner threads. No files may be
+		 * submitted afterwards.
+		 *
+		 */
+		void finish(void) {
+			{
+				std::lock_guard<std::mutex> lk(mutex_);
+				done_ = true;
+			}
+			not_empty_.notify_all();
+			for (std::thread &t : workers_)
+				t.join();
+			workers_.clear();
+		}
+	private:
+		/**
+		 * @brief A search pattern, with the literal used to find candidates
+		 *
+		 */
+		struct Pattern {
+			bool glob;           ///< Whether to match line by line with pattern_match()
+			std::string literal; ///< Whole literal, or longest literal run of a glob
+			std::string line_pattern; ///< Glob wrapped in '*' to match anywhere in a line
+			Pattern(const std::string &pattern)
+				: glob(pattern.find_first_of("*?") != std::string::npos)
+				, literal()
+				, line_pattern() {
+				if (!glob) {
+					literal = pattern;
+					return;
+				}
+				line_pattern = "*" + pattern + "*";
+				size_t pos = 0;
+				while (pos < pattern.length()) {
+					size_t end = pattern.find_first_of("*?", pos);
+					if (end == std::string::npos)
+						end = pattern.length();
+					if (end - pos > literal.length())
+						literal = pattern.substr(pos, end - pos);
+					pos = end + 1;
+				}
+			}
+		};
+		std::vector<Pattern> patterns_;   ///< Patterns to search for
+		match_callback_type on_match_;    ///< Called on matches
+		size_t max_queued_;               ///< Queue length that blocks submit()
+		bool done_;                       ///< Set by finish()
+		std::deque<std::string> queue_;   ///< Paths waiting to be scanned
+		std::vector<std::thread> workers_; ///< Scanner threads
+		std::mutex mutex_;                ///< Guards queue_ and done_
+		std::condition_variable not_empty_; ///< Signalled on submit() and finish()
+		std::condition_variable not_full_;  ///< Signalled when a path is taken off the queue
+		void worker(void) {
+			std::vector<char> buff;
+			std::string line;
+			std::string path;
+			while (true) {
+				{
+					std::unique_lock<std::mutex> lk(mutex_);
+					while (queue_.empty() && !done_)
+						not_empty_.wait(lk);
+					if (queue_.empty())
+						return;
+					path.swap(queue_.front());
+					queue_.pop_front();
+				}
+				not_full_.notify_one();
+				scan(path, buff, line);
+			}
+		}
+		/**
+		 * @brief Map or read a file and search it for every pattern. Files that can't be
+		 * opened are skipped.
+		 *
+		 * @param path Path to file
+		 * @param buff Read buffer reused between files
+		 * @param line Line buffer reused between files
+		 */
+		void scan(const std::string &path, std::vector<char> &buff, std::string &line) {
+			int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC | O_NOATIME);
+			if (fd == -1 && errno == EPERM)
+				fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+			if (fd == -1)
+				return;
+			struct stat st;
+			if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+				close(fd);
+				return;
+			}
+			size_t size = st.st_size;
+			const char *data = nullptr;
+			void *map = MAP_FAILED;
+			if (size >= ContentScan::_mmap_min) {
+				map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (map != MAP_FAILED) {
+					madvise(map, size, MADV_SEQUENTIAL);
+					data = static_cast<const char *>(map);
+				} else {
+					stream(path, fd, buff, line);
+					close(fd);
+					return;
+				}
+			}
+			if (data == nullptr) {
+				posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+				if (buff.size() < size)
+					buff.resize(size);
+				size_t total = 0;
+				ssize_t res;
+				while (total < size && (res = read(fd, buff.data() + total, size - total)) > 0)
+					total += res;
+				size = total;
+				data = buff.data();
+			}
+			close(fd);
+			for (size_t i = 0; i < patterns_.size(); ++i) {
+				size_t offset;
+				if (search(patterns_[i], data, size, line, offset))
+					on_match_(path, i, offset);
+			}
+			if (map != MAP_FAILED)
+				munmap(map, st.st_size);
+		}
+		/**
+		 * @brief Search a file too big to read whole, for when mmap() fails. The file is read
+		 * ContentScan::_stream_chunk bytes at a time and each chunk is searched together with
+		 * the tail of the one before, so matches straddling two chunks are still found: the
+		 * longest literal's length - 1 bytes, or the unfinished last line while wildcard
+		 * patterns are left. A line longer than ContentScan::_stream_max_line is not carried
+		 * over but searched as it is, so buff holds at most a chunk plus that much.
+		 *
+		 * @param path Path to file, passed to the match callback
+		 * @param fd Open file
+		 * @param buff Read buffer reused between files
+		 * @param line Line buffer reused between files
+		 */
+		void stream(const std::string &path, int fd, std::vector<char> &buff, std::string &line) {
+			posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+			std::vector<bool> found(patterns_.size(), false);
+			size_t left = patterns_.size();
+			size_t overlap = 0;
+			for (const Pattern &pattern : patterns_) {
+				if (pattern.literal.length() > overlap + 1)
+					overlap = pattern.literal.length() - 1;
+			}
+			size_t base = 0; // file offset of buff[0]
+			size_t len = 0;  // bytes held in buff
+			while (left > 0) {
+				if (buff.size() < len + ContentScan::_stream_chunk)
+					buff.resize(len + ContentScan::_stream_chunk);
+				size_t got = 0;
+				while (got < ContentScan::_stream_chunk) {
+					ssize_t res =
+						read(fd, buff.data() + len + got, ContentScan::_stream_chunk - got);
+					if (res <= 0)
+						break;
+					got += res;
+				}
+				bool eof = got < ContentScan::_stream_chunk; // or a read error, stop either way
+				len += got;
+				// wildcards match whole lines, so leave the unfinished last one for next time
+				size_t lines = len;
+				if (!eof) {
+					const char *nl = static_cast<const char *>(memrchr(buff.data(), '\n', len));
+					lines = nl == nullptr ? 0 : nl - buff.data() + 1;
+					if (len - lines > ContentScan::_stream_max_line)
+						lines = len;
+				}
+				bool globs_left = false;
+				for (size_t i = 0; i < patterns_.size(); ++i) {
+					if (found[i])
+						continue;
+					size_t offset;
+					size_t n = patterns_[i].glob ? lines : len;
+					if (search(patterns_[i], buff.data(), n, line, offset)) {
+						on_match_(path, i, base + offset);
+						found[i] = true;
+						--left;
+					} else if (patterns_[i].glob) {
+						globs_left = true;
+					}
+				}
+				if (eof)
+					break;
+				size_t keep = std::min(len, overlap);
+				if (globs_left)
+					keep = std::max(keep, len - lines);
+				memmove(buff.data(), buff.data() + len - keep, keep);
+				base += len - keep;
+				len = keep;
+			}
+		}
+		/**
+		 * @brief Search a buffer for a pattern
+		 *
+		 * @return true and offset of first match set if found
+		 */
+		static bool search(const Pattern &pattern,
+						   const char *data,
+						   size_t size,
+						   std::string &line,
+						   size_t &offset) {
+			const char *end = data + size;
+			const char *cur = data;
+			while (cur < end) {
+				const char *hit = cur;
+				if (!pattern.literal.empty()) {
+					hit = static_cast<const char *>(
+						memmem(cur, end - cur, pattern.literal.data(), pattern.literal.length()));
+					if (hit == nullptr)
+						return false;
+				}
+				if (!pattern.glob) {
+					offset = hit - data;
+					return true;
+				}
+				const char *line_start = hit;
+				while (line_start > data && line_start[-1] != '\n')
+					--line_start;
+				const char *line_end =
+					static_cast<const char *>(memchr(hit, '\n', end - hit));
+				if (line_end == nullptr)
+					line_end = end;
+				line.assign(line_start, line_end);
+				if (ffd::pattern_match(line.c_str(), pattern.line_pattern.c_str())) {
+					offset = line_start - data;
+					return true;
+				}
+				cur = line_end + 1;
+			}
+			return false;
+		}
+	};
+} // namespace ffd
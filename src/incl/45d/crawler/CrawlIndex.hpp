@@ -0,0 +1,671 @@
+// -*- C++ -*-
+/*
+ *    Copyright (C) 2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of lib45d.
+ *
+ *    lib45d is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    lib45d is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with lib45d.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <45d/crawler/Exceptions.hpp>
+#include <45d/low_overhead_string.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#if __cplusplus >= 201703L
+#	include <filesystem>
+namespace ffd_internal_fs = std::filesystem;
+#else
+#	include <boost/filesystem.hpp>
+namespace ffd_internal_fs = boost::filesystem;
+#endif
+
+extern "C" {
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+namespace ffd {
+	/**
+	 * @brief On-disk layout of a crawl index file.
+	 *
+	 * The file is a header followed by four sections, each 8-byte aligned:
+	 * - records: fixed-width CrawlIndex::Record structs in depth-first order with the children
+	 * of every directory sorted by name, so the subtree of record i is the range [i, end).
+	 * - names: nul-terminated base names. Only the root records hold a full path, every other
+	 * path is rebuilt by following parent links, so shared path prefixes are stored once.
+	 * - name index: record numbers sorted by name
+	 * - size and mtime indices: record numbers sorted by size and by mtime
+	 *
+	 * Integers are stored in host byte order. The index is meant to be read back on the host
+	 * that wrote it.
+	 */
+	namespace CrawlIndex {
+		const char _magic[8] = { '4', '5', 'D', 'C', 'I', 'D', 'X', '\0' }; ///< File magic
+		const uint32_t _version = 1;                                        ///< Format version
+		const uint32_t _no_parent = UINT32_MAX; ///< Parent of a root record
+
+		/**
+		 * @brief Fixed-width entry record
+		 *
+		 */
+		struct Record {
+			uint64_t ino;        ///< Inode number
+			uint64_t size;       ///< Size in bytes
+			int64_t mtime_sec;   ///< Modification time, seconds
+			uint32_t mtime_nsec; ///< Modification time, nanoseconds
+			uint32_t mode;       ///< st_mode, file type and permissions
+			uint32_t parent;     ///< Record number of parent directory, or _no_parent
+			uint32_t end;        ///< One past the last record in this entry's subtree
+			uint64_t name_off;   ///< Offset of nul-terminated name in name table
+		};
+		static_assert(sizeof(Record) == 48, "CrawlIndex::Record must be 48 bytes");
+
+		/**
+		 * @brief File header
+		 *
+		 */
+		struct Header {
+			char magic[8];             ///< CrawlIndex::_magic
+			uint32_t version;          ///< CrawlIndex::_version
+			uint32_t record_size;      ///< sizeof(CrawlIndex::Record)
+			uint64_t record_count;     ///< Number of records
+			uint64_t records_off;      ///< Offset of records section
+			uint64_t names_off;        ///< Offset of name table
+			uint64_t names_size;       ///< Size of name table in bytes
+			uint64_t name_index_off;   ///< Offset of uint32_t[record_count] sorted by name
+			uint64_t size_index_off;   ///< Offset of uint32_t[record_count] sorted by size
+			uint64_t mtime_index_off;  ///< Offset of uint32_t[record_count] sorted by mtime
+		};
+	} // namespace CrawlIndex
+
+	/**
+	 * @brief Collects directory entries during a crawl and writes them out as a crawl index
+	 * that CrawlIndexReader can query through mmap.
+	 *
+	 * add() is thread safe and can be called straight from an MTDirCrawler callback. Entries
+	 * are kept as compact records until finish() lays them out on disk. Every directory must be
+	 * added before its children, which MTDirCrawler guarantees for the directories it recurses
+	 * into; entries whose parent was never added become roots holding their full path.
+	 *
+	 * Example:
+	 * @include tests/MTDirCrawler/crawl_index.cpp
+	 */
+	class CrawlIndexWriter {
+	public:
+		/**
+		 * @brief Construct a new Crawl Index Writer object
+		 *
+		 * @param path Where to write the index when finish() is called
+		 */
+		CrawlIndexWriter(const std::string &path)
+			: path_(path)
+			, records_()
+			, names_()
+			, dirs_()
+			, mutex_() {}
+		/**
+		 * @brief Add an entry, calling lstat() on its path
+		 *
+		 * @param entry Directory entry to add
+		 */
+		void add(const ffd_internal_fs::directory_entry &entry) {
+			struct stat st;
+			if (lstat(entry.path().c_str(), &st) == -1) {
+				int error = errno;
+				throw CrawlIndexException(entry.path().string() + ": " + strerror(error), error);
+			}
+			add(entry.path(), st);
+		}
+		/**
+		 * @brief Add an entry with already known stat info
+		 *
+		 * @param path Path of entry
+		 * @param st Stat info of entry
+		 */
+		void add(const ffd_internal_fs::path &path, const struct stat &st) {
+			ffd_internal_fs::path norm = path.has_filename() ? path : path.parent_path();
+			std::string parent_key = norm.parent_path().string();
+			std::string name = norm.filename().string();
+			std::lock_guard<std::mutex> lk(mutex_);
+			TmpRecord rec;
+			rec.ino = st.st_ino;
+			rec.size = st.st_size;
+			rec.mtime_sec = st.st_mtim.tv_sec;
+			rec.mtime_nsec = st.st_mtim.tv_nsec;
+			rec.mode = st.st_mode;
+			std::unordered_map<std::string, uint32_t>::const_iterator parent =
+				dirs_.find(parent_key);
+			if (parent == dirs_.end()) {
+				rec.parent = CrawlIndex::_no_parent;
+				name = norm.string();
+			} else {
+				rec.parent = parent->second;
+			}
+			rec.name_off = names_.size();
+			names_.append(name.c_str(), name.length() + 1);
+			if (records_.size() >= CrawlIndex::_no_parent)
+				throw CrawlIndexException("Too many entries for crawl index");
+			if (S_ISDIR(st.st_mode))
+				dirs_[norm.string()] = records_.size();
+			records_.push_back(rec);
+		}
+		/**
+		 * @brief Wrap a crawl callback so every entry it sees is added to the index
+		 *
+		 * @param callback MTDirCrawler callback to wrap
+		 * @return std::function<bool(const ffd_internal_fs::directory_entry &)>
+		 */
+		std::function<bool(const ffd_internal_fs::directory_entry &)>
+		wrap(std::function<bool(const ffd_internal_fs::directory_entry &)> callback) {
+			return [this, callback](const ffd_internal_fs::directory_entry &entry) {
+				add(entry);
+				return callback(entry);
+			};
+		}
+		/**
+		 * @brief Get number of entries added so far
+		 *
+		 * @return size_t
+		 */
+		size_t size(void) {
+			std::lock_guard<std::mutex> lk(mutex_);
+			return records_.size();
+		}
+		/**
+		 * @brief Lay out and write the index file. The file is written next to the target path
+		 * and renamed into place, so readers never see a partial index.
+		 *
+		 */
+		void finish(void) {
+			std::lock_guard<std::mutex> lk(mutex_);
+			const uint32_t count = records_.size();
+			// children lists in CSR form, sorted by name
+			std::vector<uint32_t> child_start(count + 2, 0);
+			for (const TmpRecord &rec : records_)
+				++child_start[parent_slot(rec.parent) + 1];
+			for (uint32_t i = 1; i < child_start.size(); ++i)
+				child_start[i] += child_start[i - 1];
+			std::vector<uint32_t> children(count);
+			{
+				std::vector<uint32_t> fill(child_start.begin(), child_start.end() - 1);
+				for (uint32_t i = 0; i < count; ++i)
+					children[fill[parent_slot(records_[i].parent)]++] = i;
+			}
+			const char *names = names_.data();
+			for (uint32_t i = 0; i + 1 < child_start.size(); ++i) {
+				std::sort(children.begin() + child_start[i],
+						  children.begin() + child_start[i + 1],
+						  [this, names](uint32_t a, uint32_t b) {
+							  return strcmp(names + records_[a].name_off,
+											names + records_[b].name_off)
+								   < 0;
+						  });
+			}
+			// depth first layout
+			std::vector<CrawlIndex::Record> out(count);
+			std::vector<uint32_t> new_index(count);
+			std::vector<std::pair<uint32_t, uint32_t>> stack; // (tmp index, next child cursor)
+			uint32_t next = 0;
+			for (uint32_t r = child_start[0]; r < child_start[1]; ++r) {
+				stack.emplace_back(children[r], child_start[children[r] + 1]);
+				new_index[children[r]] = next++;
+				while (!stack.empty()) {
+					uint32_t tmp = stack.back().first;
+					uint32_t &cursor = stack.back().second;
+					if (cursor < child_start[tmp + 2]) {
+						uint32_t child = children[cursor++];
+						new_index[child] = next++;
+						stack.emplace_back(child, child_start[child + 1]);
+					} else {
+						const TmpRecord &rec = records_[tmp];
+						CrawlIndex::Record &dst = out[new_index[tmp]];
+						dst.ino = rec.ino;
+						dst.size = rec.size;
+						dst.mtime_sec = rec.mtime_sec;
+						dst.mtime_nsec = rec.mtime_nsec;
+						dst.mode = rec.mode;
+						dst.parent = (rec.parent == CrawlIndex::_no_parent)
+									   ? CrawlIndex::_no_parent
+									   : new_index[rec.parent];
+						dst.end = next;
+						dst.name_off = rec.name_off;
+						stack.pop_back();
+					}
+				}
+			}
+			// secondary indices
+			std::vector<uint32_t> name_index(count), size_index(count), mtime_index(count);
+			for (uint32_t i = 0; i < count; ++i)
+				name_index[i] = size_index[i] = mtime_index[i] = i;
+			std::sort(name_index.begin(), name_index.end(), [&out, names](uint32_t a, uint32_t b) {
+				int cmp = strcmp(names + out[a].name_off, names + out[b].name_off);
+				return cmp < 0 || (cmp == 0 && a < b);
+			});
+			std::sort(size_index.begin(), size_index.end(), [&out](uint32_t a, uint32_t b) {
+				return out[a].size < out[b].size || (out[a].size == out[b].size && a < b);
+			});
+			std::sort(mtime_index.begin(), mtime_index.end(), [&out](uint32_t a, uint32_t b) {
+				if (out[a].mtime_sec != out[b].mtime_sec)
+					return out[a].mtime_sec < out[b].mtime_sec;
+				if (out[a].mtime_nsec != out[b].mtime_nsec)
+					return out[a].mtime_nsec < out[b].mtime_nsec;
+				return a < b;
+			});
+
+			CrawlIndex::Header header;
+			memset(&header, 0, sizeof(header));
+			memcpy(header.magic, CrawlIndex::_magic, sizeof(header.magic));
+			header.version = CrawlIndex::_version;
+			header.record_size = sizeof(CrawlIndex::Record);
+			header.record_count = count;
+			header.records_off = align(sizeof(header));
+			header.names_off = align(header.records_off + count * sizeof(CrawlIndex::Record));
+			header.names_size = names_.size();
+			header.name_index_off = align(header.names_off + header.names_size);
+			header.size_index_off = align(header.name_index_off + count * sizeof(uint32_t));
+			header.mtime_index_off = align(header.size_index_off + count * sizeof(uint32_t));
+
+			std::string tmp_path = path_ + ".tmp";
+			std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+			if (!file)
+				throw CrawlIndexException("Failed to open " + tmp_path + " for writing");
+			write_section(file, 0, &header, sizeof(header));
+			write_section(
+				file, header.records_off, out.data(), count * sizeof(CrawlIndex::Record));
+			write_section(file, header.names_off, names_.data(), names_.size());
+			write_section(
+				file, header.name_index_off, name_index.data(), count * sizeof(uint32_t));
+			write_section(
+				file, header.size_index_off, size_index.data(), count * sizeof(uint32_t));
+			write_section(
+				file, header.mtime_index_off, mtime_index.data(), count * sizeof(uint32_t));
+			file.close();
+			if (!file) {
+				unlink(tmp_path.c_str());
+				throw CrawlIndexException("Failed to write " + tmp_path);
+			}
+			if (rename(tmp_path.c_str(), path_.c_str()) == -1) {
+				int error = errno;
+				unlink(tmp_path.c_str());
+				throw CrawlIndexException(strerror(error), error);
+			}
+		}
+	private:
+		/**
+		 * @brief Record as collected, before depth first layout
+		 *
+		 */
+		struct TmpRecord {
+			uint64_t ino;
+			uint64_t size;
+			int64_t mtime_sec;
+			uint32_t mtime_nsec;
+			uint32_t mode;
+			uint32_t parent;
+			uint64_t name_off;
+		};
+		std::string path_;                               ///< Destination of index file
+		std::vector<TmpRecord> records_;                 ///< Records in order of addition
+		std::string names_;                              ///< Name table
+		std::unordered_map<std::string, uint32_t> dirs_; ///< Directory path to record number
+		std::mutex mutex_;                               ///< Guards all of the above
+		/**
+		 * @brief Slot in the children table, slot 0 holding the roots
+		 *
+		 */
+		static uint32_t parent_slot(uint32_t parent) {
+			return (parent == CrawlIndex::_no_parent) ? 0 : parent + 1;
+		}
+		static uint64_t align(uint64_t off) {
+			return (off + 7) & ~uint64_t(7);
+		}
+		static void write_section(std::ofstream &file, uint64_t off, const void *data, size_t len) {
+			static const char zeros[8] = { 0 };
+			uint64_t pos = file.tellp();
+			file.write(zeros, off - pos);
+			file.write(static_cast<const char *>(data), len);
+		}
+	};
+
+	/**
+	 * @brief Memory maps a crawl index written by CrawlIndexWriter and answers queries against
+	 * it. Only the pages touched by a query are read from disk.
+	 *
+	 * Opening checks the header and section bounds. Records and lookup table entries are
+	 * range-checked as queries reach them, so a damaged index throws CrawlIndexException from
+	 * the query instead of being read out of bounds.
+	 *
+	 * Queries return record numbers; use CrawlIndexReader::record() and
+	 * CrawlIndexReader::path() to look at the results.
+	 */
+	class CrawlIndexReader {
+	public:
+		/**
+		 * @brief Open and map an index file
+		 *
+		 * @param path Path to index written by CrawlIndexWriter
+		 */
+		CrawlIndexReader(const std::string &path) : base_(nullptr), length_(0) {
+			int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+			if (fd == -1) {
+				int error = errno;
+				throw CrawlIndexException(path + ": " + strerror(error), error);
+			}
+			struct stat st;
+			if (fstat(fd, &st) == -1) {
+				int error = errno;
+				close(fd);
+				throw CrawlIndexException(path + ": " + strerror(error), error);
+			}
+			length_ = st.st_size;
+			if (length_ < sizeof(CrawlIndex::Header)) {
+				close(fd);
+				throw CrawlIndexException(path + ": not a crawl index");
+			}
+			void *map = mmap(nullptr, length_, PROT_READ, MAP_SHARED, fd, 0);
+			int error = errno;
+			close(fd);
+			if (map == MAP_FAILED)
+				throw CrawlIndexException(path + ": " + strerror(error), error);
+			base_ = static_cast<const char *>(map);
+			try {
+				validate(path);
+			} catch (...) {
+				munmap(const_cast<char *>(base_), length_);
+				throw;
+			}
+		}
+		CrawlIndexReader(const CrawlIndexReader &) = delete;
+		CrawlIndexReader &operator=(const CrawlIndexReader &) = delete;
+		/**
+		 * @brief Destroy the Crawl Index Reader object, unmapping the file
+		 *
+		 */
+		~CrawlIndexReader() {
+			munmap(const_cast<char *>(base_), length_);
+		}
+		/**
+		 * @brief Get number of records in the index
+		 *
+		 * @return size_t
+		 */
+		size_t size(void) const {
+			return header_->record_count;
+		}
+		/**
+		 * @brief Get a record by number
+		 *
+		 * @param i Record number
+		 * @return const CrawlIndex::Record&
+		 */
+		const CrawlIndex::Record &record(uint32_t i) const {
+			return checked(i);
+		}
+		/**
+		 * @brief Get the base name of a record, or the full path for a root record
+		 *
+		 * @param i Record number
+		 * @return const char*
+		 */
+		const char *name(uint32_t i) const {
+			return names_ + checked(i).name_off;
+		}
+		/**
+		 * @brief Rebuild the full path of a record from its parent links
+		 *
+		 * @param i Record number
+		 * @return std::string
+		 */
+		std::string path(uint32_t i) const {
+			std::vector<uint32_t> chain;
+			for (uint32_t cur = i; cur != CrawlIndex::_no_parent; cur = checked(cur).parent)
+				chain.push_back(cur);
+			std::string res;
+			for (std::vector<uint32_t>::reverse_iterator itr = chain.rbegin(); itr != chain.rend();
+				 ++itr) {
+				if (!res.empty() && res.back() != '/')
+					res += '/';
+				res += name(*itr);
+			}
+			return res;
+		}
+		/**
+		 * @brief Find every record whose full path starts with prefix.
+		 * "/a/b/" yields everything under /a/b, "/a/b" also matches /a/bc and its subtree.
+		 *
+		 * @param prefix Path prefix to look for
+		 * @param out Record numbers returned by reference, in depth first order
+		 */
+		void find_prefix(const std::string &prefix, std::vector<uint32_t> &out) const {
+			out.clear();
+			for (uint32_t root = 0; root < size(); root = checked(root).end) {
+				std::string root_name = name(root);
+				if (root_name.compare(0, prefix.length(), prefix) == 0) {
+					append_range(root, checked(root).end, out);
+					continue;
+				}
+				if (prefix.compare(0, root_name.length(), root_name) != 0)
+					continue;
+				size_t pos = root_name.length();
+				if (root_name.back() != '/') {
+					if (prefix[pos] != '/')
+						continue;
+					++pos;
+				}
+				uint32_t dir = root;
+				size_t slash;
+				while ((slash = prefix.find('/', pos)) != std::string::npos) {
+					dir = find_child(dir, prefix.substr(pos, slash - pos));
+					if (dir == CrawlIndex::_no_parent)
+						break;
+					pos = slash + 1;
+				}
+				if (dir == CrawlIndex::_no_parent)
+					continue;
+				std::string fragment = prefix.substr(pos);
+				if (fragment.empty()) {
+					append_range(dir + 1, checked(dir).end, out);
+					continue;
+				}
+				for (uint32_t child = dir + 1; child < checked(dir).end;
+					 child = checked(child).end) {
+					if (strncmp(name(child), fragment.c_str(), fragment.length()) == 0)
+						append_range(child, checked(child).end, out);
+				}
+			}
+		}
+		/**
+		 * @brief Find every record whose base name matches a wildcard pattern (see
+		 * ffd::pattern_match()). The literal part of the pattern before the first wildcard is
+		 * looked up in the sorted name index, so "foo*" does not scan the whole index.
+		 *
+		 * @param pattern Wildcard pattern to match names against
+		 * @param out Record numbers returned by reference, sorted by name
+		 */
+		void find_name(const std::string &pattern, std::vector<uint32_t> &out) const {
+			out.clear();
+			std::string literal = pattern.substr(0, pattern.find_first_of("*?"));
+			const uint32_t *itr =
+				std::lower_bound(name_index_,
+								 name_index_ + size(),
+								 literal,
+								 [this](uint32_t i, const std::string &s) {
+									 return strcmp(name(entry(i)), s.c_str()) < 0;
+								 });
+			for (; itr != name_index_ + size(); ++itr) {
+				const char *n = name(entry(*itr));
+				if (strncmp(n, literal.c_str(), literal.length()) != 0)
+					break;
+				if (ffd::pattern_match(n, pattern.c_str()))
+					out.push_back(*itr);
+			}
+		}
+		/**
+		 * @brief Find every record with min <= size <= max
+		 *
+		 * @param min Smallest size to match
+		 * @param max Largest size to match
+		 * @param out Record numbers returned by reference, sorted by size
+		 */
+		void find_size(uint64_t min, uint64_t max, std::vector<uint32_t> &out) const {
+			out.clear();
+			const uint32_t *itr = std::lower_bound(
+				size_index_, size_index_ + size(), min, [this](uint32_t i, uint64_t val) {
+					return checked(entry(i)).size < val;
+				});
+			for (; itr != size_index_ + size() && checked(entry(*itr)).size <= max; ++itr)
+				out.push_back(*itr);
+		}
+		/**
+		 * @brief Find every record with min <= mtime <= max, in seconds since the epoch
+		 *
+		 * @param min Oldest mtime to match
+		 * @param max Newest mtime to match
+		 * @param out Record numbers returned by reference, sorted by mtime
+		 */
+		void find_mtime(int64_t min, int64_t max, std::vector<uint32_t> &out) const {
+			out.clear();
+			const uint32_t *itr = std::lower_bound(
+				mtime_index_, mtime_index_ + size(), min, [this](uint32_t i, int64_t val) {
+					return checked(entry(i)).mtime_sec < val;
+				});
+			for (; itr != mtime_index_ + size() && checked(entry(*itr)).mtime_sec <= max;
+				 ++itr)
+				out.push_back(*itr);
+		}
+	private:
+		const char *base_;                     ///< Start of mapping
+		size_t length_;                        ///< Length of mapping
+		const CrawlIndex::Header *header_;     ///< File header
+		const CrawlIndex::Record *records_;    ///< Records section
+		const char *names_;                    ///< Name table
+		const uint32_t *name_index_;           ///< Record numbers sorted by name
+		const uint32_t *size_index_;           ///< Record numbers sorted by size
+		const uint32_t *mtime_index_;          ///< Record numbers sorted by mtime
+		/**
+		 * @brief Check the header and section bounds and set up section pointers. Records and
+		 * lookup table entries are left to checked() and entry(), so opening a large index
+		 * doesn't read it all in.
+		 *
+		 * @param path Path of index for error messages
+		 */
+		void validate(const std::string &path) {
+			header_ = reinterpret_cast<const CrawlIndex::Header *>(base_);
+			if (memcmp(header_->magic, CrawlIndex::_magic, sizeof(header_->magic)) != 0
+				|| header_->version != CrawlIndex::_version
+				|| header_->record_size != sizeof(CrawlIndex::Record))
+				throw CrawlIndexException(path + ": not a crawl index or wrong version");
+			uint64_t count = header_->record_count;
+			// bound count before multiplying so a crafted count can't wrap the section sizes
+			if (count > length_ / sizeof(CrawlIndex::Record) || count >= CrawlIndex::_no_parent
+				|| header_->records_off % alignof(CrawlIndex::Record) != 0
+				|| header_->name_index_off % alignof(uint32_t) != 0
+				|| header_->size_index_off % alignof(uint32_t) != 0
+				|| header_->mtime_index_off % alignof(uint32_t) != 0
+				|| !in_bounds(header_->records_off, count * sizeof(CrawlIndex::Record))
+				|| !in_bounds(header_->names_off, header_->names_size)
+				|| !in_bounds(header_->name_index_off, count * sizeof(uint32_t))
+				|| !in_bounds(header_->size_index_off, count * sizeof(uint32_t))
+				|| !in_bounds(header_->mtime_index_off, count * sizeof(uint32_t))
+				|| (count
+					&& (header_->names_size == 0
+						|| base_[header_->names_off + header_->names_size - 1] != '\0')))
+				throw CrawlIndexException(path + ": truncated or corrupt crawl index");
+			records_ = reinterpret_cast<const CrawlIndex::Record *>(base_ + header_->records_off);
+			names_ = base_ + header_->names_off;
+			name_index_ = reinterpret_cast<const uint32_t *>(base_ + header_->name_index_off);
+			size_index_ = reinterpret_cast<const uint32_t *>(base_ + header_->size_index_off);
+			mtime_index_ = reinterpret_cast<const uint32_t *>(base_ + header_->mtime_index_off);
+		}
+		bool in_bounds(uint64_t off, uint64_t len) const {
+			return off <= length_ && len <= length_ - off;
+		}
+		/**
+		 * @brief Get a record, checking it as it is read. A parent must come before its child
+		 * and a subtree must end after the record that starts it, which keeps parent walks and
+		 * subtree skips finite and in range.
+		 *
+		 * @param i Record number
+		 * @return const CrawlIndex::Record&
+		 */
+		const CrawlIndex::Record &checked(uint32_t i) const {
+			if (i >= size())
+				throw CrawlIndexException("crawl index record " + std::to_string(i)
+										  + " out of range");
+			const CrawlIndex::Record &rec = records_[i];
+			if (rec.name_off >= header_->names_size || rec.end <= i || rec.end > size()
+				|| (rec.parent != CrawlIndex::_no_parent && rec.parent >= i))
+				throw CrawlIndexException("corrupt crawl index record " + std::to_string(i));
+			return rec;
+		}
+		/**
+		 * @brief Check a record number read from one of the lookup tables
+		 *
+		 * @param i Lookup table entry
+		 * @return uint32_t i
+		 */
+		uint32_t entry(uint32_t i) const {
+			if (i >= size())
+				throw CrawlIndexException("corrupt crawl index lookup table");
+			return i;
+		}
+		/**
+		 * @brief Find the direct child of dir with the given name. The name index is sorted by
+		 * name then record number, so the first entry with that name past dir is found by
+		 * binary search. If it is deeper in the tree, the search resumes past the subtree of
+		 * the child of dir that holds it.
+		 *
+		 * @return uint32_t record number, or CrawlIndex::_no_parent if not found
+		 */
+		uint32_t find_child(uint32_t dir, const std::string &child_name) const {
+			const uint32_t end = checked(dir).end;
+			uint32_t after = dir;
+			while (after + 1 < end) {
+				const uint32_t *itr =
+					std::lower_bound(name_index_,
+									 name_index_ + size(),
+									 after,
+									 [this, &child_name](uint32_t i, uint32_t key) {
+										 int cmp = strcmp(name(entry(i)), child_name.c_str());
+										 return cmp < 0 || (cmp == 0 && i <= key);
+									 });
+				if (itr == name_index_ + size() || *itr >= end || child_name != name(*itr))
+					break;
+				uint32_t cur = *itr;
+				while (checked(cur).parent != dir)
+					cur = checked(cur).parent;
+				if (cur == *itr)
+					return cur;
+				after = checked(cur).end - 1;
+			}
+			return CrawlIndex::_no_parent;
+		}
+		static void append_range(uint32_t first, uint32_t last, std::vector<uint32_t> &out) {
+			for (uint32_t i = first; i < last; ++i)
+				out.push_back(i);
+		}
+	};
+} // namespace ffd
@@ -0,0 +1,150 @@
+// -*- C++ -*-
+/*
+ *    Copyright (C) 2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of lib45d.
+ *
+ *    lib45d is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    lib45d is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with lib45d.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <fcntl.h>
+#include <unistd.h>
+}
+
+namespace ffd {
+	/**
+	 * @brief Small per-thread LRU cache of O_PATH directory fds, so *at() syscalls on the
+	 * entries of a directory don't each resolve the directory's path from the root again.
+	 *
+	 * MTDirCrawler queues the entries of a directory next to each other, so a handful of slots
+	 * per thread catches almost every lookup. Use DirFdCache::local() from crawl callbacks.
+	 *
+	 * A directory is opened with openat() on its parent's fd, itself looked up in the cache,
+	 * with O_NOFOLLOW, so a directory swapped for a symlink mid-crawl fails with ELOOP or
+	 * ENOTDIR instead of leading out of the tree. No component of a path is followed, so crawl
+	 * from a root without symlinks in it, e.g. canonical().
+	 */
+	class DirFdCache {
+	public:
+		/**
+		 * @brief Construct a new Dir Fd Cache object
+		 *
+		 * @param capacity Number of directory fds to keep open
+		 */
+		DirFdCache(size_t capacity = 8) : slots_(capacity ? capacity : 1), tick_(0) {}
+		DirFdCache(const DirFdCache &) = delete;
+		DirFdCache &operator=(const DirFdCache &) = delete;
+		/**
+		 * @brief Destroy the Dir Fd Cache object, closing all cached fds
+		 *
+		 */
+		~DirFdCache() {
+			for (Slot &slot : slots_) {
+				if (slot.fd != -1)
+					close(slot.fd);
+			}
+		}
+		/**
+		 * @brief Get an fd for a directory, opening it if it isn't cached. The fd belongs
+		 * to the cache and stays valid until it is evicted by another get() call.
+		 *
+		 * @param dir Path to directory, "" meaning the current working directory
+		 * @return int fd, or -1 with errno set if the directory could not be opened
+		 */
+		int get(const std::string &dir) {
+			size_t len = dir.find_last_not_of('/');
+			if (len == std::string::npos)
+				return get_key(dir.empty() ? dot() : root());
+			return len + 1 == dir.length() ? get_key(dir) : get_key(dir.substr(0, len + 1));
+		}
+		/**
+		 * @brief Get the calling thread's cache
+		 *
+		 * @return DirFdCache&
+		 */
+		static DirFdCache &local(void) {
+			static thread_local DirFdCache cache;
+			return cache;
+		}
+	private:
+		/**
+		 * @brief Cached directory fd
+		 *
+		 */
+		struct Slot {
+			std::string path;
+			int fd;
+			uint64_t last_use;
+			Slot() : path(), fd(-1), last_use(0) {}
+		};
+		std::vector<Slot> slots_; ///< Cache slots
+		uint64_t tick_;           ///< Use counter for LRU eviction
+		static const std::string &dot(void) {
+			static const std::string d(".");
+			return d;
+		}
+		static const std::string &root(void) {
+			static const std::string r("/");
+			return r;
+		}
+		/**
+		 * @brief get() for a path without trailing slashes
+		 *
+		 */
+		int get_key(const std::string &key) {
+			for (Slot &slot : slots_) {
+				if (slot.fd != -1 && slot.path == key) {
+					slot.last_use = ++tick_;
+					return slot.fd;
+				}
+			}
+			int fd = open_child(key);
+			if (fd == -1)
+				return -1;
+			Slot *victim = &slots_[0]; // picked now, opening the parent may have used a slot
+			for (Slot &slot : slots_) {
+				if (slot.last_use < victim->last_use)
+					victim = &slot;
+			}
+			if (victim->fd != -1)
+				close(victim->fd);
+			victim->fd = fd;
+			victim->path = key;
+			victim->last_use = ++tick_;
+			return fd;
+		}
+		/**
+		 * @brief Open a directory relative to its parent's cached fd without following it.
+		 * "/" and single relative components are the top of the walk.
+		 *
+		 */
+		int open_child(const std::string &key) {
+			const int flags = O_PATH | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC;
+			size_t slash = key.find_last_of('/');
+			if (slash == std::string::npos || key == root())
+				return open(key.c_str(), flags);
+			int parent_fd = get(slash == 0 ? root() : key.substr(0, slash));
+			if (parent_fd == -1)
+				return -1;
+			return openat(parent_fd, key.c_str() + slash + 1, flags);
+		}
+	};
+} // namespace ffd
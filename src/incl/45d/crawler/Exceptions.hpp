@@ -0,0 +1,43 @@
+// -*- C++ -*-
+/*
+ *    Copyright (C) 2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of lib45d.
+ *
+ *    lib45d is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    lib45d is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with lib45d.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <45d/Exceptions.hpp>
+
+namespace ffd {
+	/**
+	 * @brief General exception for all MTDirCrawler add-on related issues
+	 *
+	 */
+	class CrawlerException : public Exception {
+	public:
+		CrawlerException(const std::string &what, int err = 0) : Exception(what, err) {}
+	};
+
+	/**
+	 * @brief Thrown when a crawl index fails to be written, opened, or validated
+	 *
+	 */
+	class CrawlIndexException : public CrawlerException {
+	public:
+		CrawlIndexException(const std::string &what, int err = 0) : CrawlerException(what, err) {}
+	};
+} // namespace ffd
@@ -0,0 +1,293 @@
+// -*- C++ -*-
+/*
+ *    Copyright (C) 2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of lib45d.
+ *
+ *    lib45d is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    lib45d is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with lib45d.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#if __cplusplus >= 201703L
+#	include <filesystem>
+namespace ffd_internal_fs = std::filesystem;
+#else
+#	include <boost/filesystem.hpp>
+namespace ffd_internal_fs = boost::filesystem;
+#endif
+
+namespace ffd {
+	/**
+	 * @brief Default parameters for OrderedDirCrawler
+	 *
+	 */
+	namespace OrderedCrawl {
+		const size_t _buffer_default = 65536; ///< Entries listed ahead of the sink
+	} // namespace OrderedCrawl
+
+	/**
+	 * @brief Crawls a directory tree with multiple worker threads like MTDirCrawler, but
+	 * delivers entries to a single sink in a deterministic order: depth first, with siblings
+	 * sorted by name (byte-wise), i.e. the order of sorting every path element by element.
+	 *
+	 * Workers list and sort whole directories ahead of the sink. Directories waiting to be
+	 * listed are handed out in the order the sink will need them, and listings that are done
+	 * wait in a reorder buffer until the sink reaches them, so output streams out as the crawl
+	 * runs with no sort at the end. Once the buffer holds max_buffered entries, workers only
+	 * list the directory the sink is blocked on, which keeps memory bounded by max_buffered
+	 * plus the listings along the sink's current path.
+	 *
+	 * Which entries are recursed into is decided by a predicate called from the workers, since
+	 * they need to know before the sink gets there. Directories that can't be listed are
+	 * treated as empty.
+	 *
+	 * Example:
+	 * @include tests/MTDirCrawler/ordered_output.cpp
+	 */
+	class OrderedDirCrawler {
+	public:
+		typedef std::function<void(const ffd_internal_fs::directory_entry &)>
+			sink_type; ///< Sink type, called in order from the crawling thread
+		typedef std::function<bool(const ffd_internal_fs::directory_entry &)>
+			recurse_type; ///< Recursion predicate type, called from the workers
+		/**
+		 * @brief Construct a new Ordered Dir Crawler object
+		 *
+		 * @param threads Number of worker threads to spawn for each crawl
+		 * @param max_buffered Number of listed entries to hold ahead of the sink
+		 */
+		OrderedDirCrawler(int threads, size_t max_buffered = OrderedCrawl::_buffer_default)
+			: threads_(threads > 0 ? threads : 1)
+			, max_buffered_(max_buffered ? max_buffered : 1)
+			, recurse_()
+			, done_(false)
+			, pending_()
+			, ready_()
+			, buffered_(0)
+			, peak_buffered_(0)
+			, sink_waiting_(false)
+			, waiting_for_()
+			, mutex_()
+			, work_cv_()
+			, ready_cv_() {}
+		OrderedDirCrawler(const OrderedDirCrawler &) = delete;
+		OrderedDirCrawler &operator=(const OrderedDirCrawler &) = delete;
+		/**
+		 * @brief Destroy the Ordered Dir Crawler object
+		 *
+		 */
+		~OrderedDirCrawler() = default;
+		/**
+		 * @brief Crawl base_path, calling sink on each entry in order from this thread.
+		 * Returns once every entry has been delivered.
+		 *
+		 * @param base_path Path to start the traversal from, delivered first
+		 * @param sink Called on each entry in depth first, sorted order
+		 * @param recurse Should return true if a directory entry should be recursed into,
+		 * defaults to directories that are not symlinks
+		 */
+		void crawl(const ffd_internal_fs::path &base_path,
+				   sink_type sink,
+				   recurse_type recurse = default_recurse) {
+			recurse_ = recurse;
+			done_ = false;
+			buffered_ = 0;
+			peak_buffered_ = 0;
+			ffd_internal_fs::directory_entry root(base_path);
+			sink(root);
+			if (!recurse_(root))
+				return;
+			pending_.push(base_path);
+			std::vector<std::thread> workers;
+			for (int i = 0; i < threads_; ++i)
+				workers.emplace_back(&OrderedDirCrawler::worker, this);
+			try {
+				merge(base_path, sink);
+			} catch (...) {
+				stop(workers);
+				throw;
+			}
+			stop(workers);
+		}
+		/**
+		 * @brief Get the largest number of entries held in the reorder buffer during the last
+		 * crawl
+		 *
+		 * @return size_t
+		 */
+		size_t peak_buffered(void) const {
+			return peak_buffered_;
+		}
+		/**
+		 * @brief Default recursion predicate, directories that are not symlinks
+		 *
+		 */
+		static bool default_recurse(const ffd_internal_fs::directory_entry &entry) {
+			return ffd_internal_fs::is_directory(entry.symlink_status());
+		}
+	private:
+		/**
+		 * @brief Sorted contents of one directory, with the recursion decision for each entry
+		 *
+		 */
+		struct Listing {
+			std::vector<ffd_internal_fs::directory_entry> entries;
+			std::vector<bool> recurse;
+		};
+		/**
+		 * @brief Orders the pending heap so the directory the sink needs next is on top
+		 *
+		 */
+		struct Later {
+			bool operator()(const ffd_internal_fs::path &a, const ffd_internal_fs::path &b) const {
+				return a.compare(b) > 0;
+			}
+		};
+		int threads_;
+		size_t max_buffered_;
+		recurse_type recurse_;
+		bool done_;
+		std::priority_queue<ffd_internal_fs::path, std::vector<ffd_internal_fs::path>, Later>
+			pending_;                                         ///< Directories to list
+		std::unordered_map<std::string, Listing> ready_;    ///< Reorder buffer
+		size_t buffered_;                                   ///< Entries in ready_
+		size_t peak_buffered_;                              ///< High water mark of buffered_
+		bool sink_waiting_;                                 ///< Sink is blocked on waiting_for_
+		ffd_internal_fs::path waiting_for_;                 ///< Directory the sink needs
+		std::mutex mutex_;
+		std::condition_variable work_cv_;  ///< Wakes workers
+		std::condition_variable ready_cv_; ///< Wakes the sink
+		/**
+		 * @brief Check whether a worker may list the next pending directory
+		 *
+		 */
+		bool can_list(void) const {
+			return !pending_.empty()
+				   && (buffered_ < max_buffered_
+					   || (sink_waiting_ && pending_.top() == waiting_for_));
+		}
+		void worker(void) {
+			std::unique_lock<std::mutex> lk(mutex_);
+			while (!done_) {
+				if (!can_list()) {
+					work_cv_.wait(lk);
+					continue;
+				}
+				ffd_internal_fs::path dir = pending_.top();
+				pending_.pop();
+				lk.unlock();
+				Listing listing = list(dir);
+				lk.lock();
+				for (size_t i = 0; i < listing.entries.size(); ++i)
+					if (listing.recurse[i])
+						pending_.push(listing.entries[i].path());
+				buffered_ += listing.entries.size();
+				if (buffered_ > peak_buffered_)
+					peak_buffered_ = buffered_;
+				ready_[dir.native()] = std::move(listing);
+				ready_cv_.notify_one();
+				if (!pending_.empty())
+					work_cv_.notify_all();
+			}
+		}
+		Listing list(const ffd_internal_fs::path &dir) {
+			Listing listing;
+			try {
+				for (ffd_internal_fs::directory_iterator ditr{ dir };
+					 ditr != ffd_internal_fs::directory_iterator{};
+					 ++ditr)
+					listing.entries.push_back(*ditr);
+			} catch (const ffd_internal_fs::filesystem_error &) {
+				// unreadable or gone, deliver what was listed
+			}
+			std::sort(listing.entries.begin(),
+					  listing.entries.end(),
+					  [](const ffd_internal_fs::directory_entry &a,
+						 const ffd_internal_fs::directory_entry &b) {
+						  return a.path().filename().native() < b.path().filename().native();
+					  });
+			listing.recurse.reserve(listing.entries.size());
+			for (const ffd_internal_fs::directory_entry &entry : listing.entries)
+				listing.recurse.push_back(recurse_(entry));
+			return listing;
+		}
+		/**
+		 * @brief Take a directory's listing out of the reorder buffer, waiting for it if need
+		 * be
+		 *
+		 */
+		Listing take(const ffd_internal_fs::path &dir) {
+			std::unique_lock<std::mutex> lk(mutex_);
+			std::unordered_map<std::string, Listing>::iterator itr;
+			while ((itr = ready_.find(dir.native())) == ready_.end()) {
+				if (!sink_waiting_) {
+					sink_waiting_ = true;
+					waiting_for_ = dir;
+					work_cv_.notify_all();
+				}
+				ready_cv_.wait(lk);
+			}
+			sink_waiting_ = false;
+			Listing listing = std::move(itr->second);
+			ready_.erase(itr);
+			buffered_ -= listing.entries.size();
+			work_cv_.notify_all();
+			return listing;
+		}
+		/**
+		 * @brief Walk listings depth first, delivering entries to the sink
+		 *
+		 */
+		void merge(const ffd_internal_fs::path &base_path, sink_type &sink) {
+			std::vector<std::pair<Listing, size_t>> stack;
+			stack.emplace_back(take(base_path), 0);
+			while (!stack.empty()) {
+				std::pair<Listing, size_t> &top = stack.back();
+				if (top.second == top.first.entries.size()) {
+					stack.pop_back();
+					continue;
+				}
+				size_t i = top.second++;
+				sink(top.first.entries[i]);
+				if (top.first.recurse[i]) {
+					ffd_internal_fs::path dir = top.first.entries[i].path();
+					stack.emplace_back(take(dir), 0); // invalidates top
+				}
+			}
+		}
+		void stop(std::vector<std::thread> &workers) {
+			{
+				std::lock_guard<std::mutex> lk(mutex_);
+				done_ = true;
+				work_cv_.notify_all();
+			}
+			for (std::thread &t : workers)
+				t.join();
+			pending_ = decltype(pending_)();
+			ready_.clear();
+			sink_waiting_ = false;
+		}
+	};
+} // namespace ffd
@@ -0,0 +1,397 @@
+// -*- C++ -*-
+/*
+ *    Copyright (C) 2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of lib45d.
+ *
+ *    lib45d is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    lib45d is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with lib45d.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <45d/crawler/Exceptions.hpp>
+#include <45d/socket/UnixSocketClient.hpp>
+#include <45d/socket/UnixSocketServer.hpp>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+#if __cplusplus >= 201703L
+#	include <filesystem>
+namespace ffd_internal_fs = std::filesystem;
+#else
+#	include <boost/filesystem.hpp>
+namespace ffd_internal_fs = boost::filesystem;
+#endif
+
+extern "C" {
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+}
+
+namespace ffd {
+	/**
+	 * @brief Defaults and message verbs for the sharded crawl protocol.
+	 *
+	 * Every message is a record separator delimited vector sent framed (see
+	 * SocketBase::set_framing()) with SocketBase::send_data_async() and MSG_NOSIGNAL, the
+	 * first record being the verb. Every request gets a reply, so there are no ACKs, and a
+	 * worker dying mid-crawl is reported as a CrawlerException instead of a SIGPIPE. A worker
+	 * asks for work with NEXT, streams results with RESULTS, and hands part of its pending
+	 * directories back with DIRS when the coordinator replies SPLIT to a RESULTS check-in.
+	 */
+	namespace ShardedCrawl {
+		const size_t _batch_default = 256;  ///< Records per RESULTS message
+		const size_t _checkin_default = 64; ///< Directories expanded between check-ins
+		const char *const _next = "NEXT";       ///< worker -> coordinator: request work
+		const char *const _results = "RESULTS"; ///< worker -> coordinator: result records
+		const char *const _dirs = "DIRS";       ///< worker -> coordinator: donated directories
+		const char *const _work = "WORK";       ///< coordinator -> worker: unit of work
+		const char *const _root = "ROOT"; ///< WORK kind: call callback on path, then expand
+		const char *const _dir = "DIR";   ///< WORK kind: expand only
+		const char *const _ok = "OK";       ///< coordinator -> worker: carry on
+		const char *const _split = "SPLIT"; ///< coordinator -> worker: donate pending dirs
+		const char *const _done = "DONE";   ///< coordinator -> worker: no work left
+	} // namespace ShardedCrawl
+
+	/**
+	 * @brief Worker side of a multi-process crawl. Connects to a ShardedCrawlCoordinator,
+	 * crawls the subtrees handed to it and streams result records back.
+	 *
+	 * The callback is called on every directory entry found, like with MTDirCrawler. It
+	 * returns true to recurse into the entry, and may fill in record with a string to send
+	 * back to the coordinator's merge callback. Empty records are not sent, and records must
+	 * not contain the record separator (0x1E).
+	 */
+	class ShardedCrawlWorker {
+	public:
+		typedef std::function<bool(const ffd_internal_fs::directory_entry &, std::string &)>
+			callback_type; ///< Worker callback type
+		/**
+		 * @brief Construct a new Sharded Crawl Worker object
+		 *
+		 * @param socket_path Path to coordinator's socket inode
+		 */
+		ShardedCrawlWorker(const std::string &socket_path)
+			: client_(socket_path)
+			, batch_size_(ShardedCrawl::_batch_default)
+			, checkin_interval_(ShardedCrawl::_checkin_default) {
+			client_.set_framing(true);
+		}
+		/**
+		 * @brief Set how many records to collect before sending them to the coordinator
+		 *
+		 * @param records Number of records per RESULTS message
+		 */
+		void set_batch_size(size_t records) {
+			batch_size_ = records ? records : 1;
+		}
+		/**
+		 * @brief Set how many directories to expand between check-ins with the coordinator.
+		 * Check-ins are where long running shards get split, so lower values rebalance sooner.
+		 *
+		 * @param dirs Number of directories
+		 */
+		void set_checkin_interval(size_t dirs) {
+			checkin_interval_ = dirs ? dirs : 1;
+		}
+		/**
+		 * @brief Connect to the coordinator and crawl until it says there is no work left
+		 *
+		 * @param callback Function to call on each directory entry
+		 */
+		void run(callback_type callback) {
+			client_.connect();
+			std::vector<std::string> msg;
+			while (true) {
+				send({ ShardedCrawl::_next });
+				client_.receive_data_async(msg);
+				if (msg.empty() || msg[0] == ShardedCrawl::_done)
+					break;
+				if (msg[0] != ShardedCrawl::_work || msg.size() != 3)
+					throw CrawlerException("Unexpected message from coordinator: " + msg[0]);
+				if (msg[1] == ShardedCrawl::_root) {
+					ffd_internal_fs::directory_entry root(msg[2]);
+					visit(root, callback);
+				} else {
+					pending_.push_back(msg[2]);
+				}
+				size_t dirs_since_checkin = 0;
+				while (!pending_.empty()) {
+					ffd_internal_fs::path dir = pending_.back();
+					pending_.pop_back();
+					expand(dir, callback);
+					if (++dirs_since_checkin >= checkin_interval_ || batch_.size() >= batch_size_) {
+						checkin();
+						dirs_since_checkin = 0;
+					}
+				}
+				if (!batch_.empty())
+					checkin();
+			}
+			client_.close_connection();
+		}
+	private:
+		UnixSocketClient client_;                  ///< Connection to coordinator
+		size_t batch_size_;                        ///< Records per RESULTS message
+		size_t checkin_interval_;                  ///< Directories between check-ins
+		std::deque<ffd_internal_fs::path> pending_; ///< Directories left to expand
+		std::vector<std::string> batch_;           ///< Records waiting to be sent
+		void send(const std::vector<std::string> &msg) {
+			client_.send_data_async(msg, MSG_NOSIGNAL);
+		}
+		void visit(const ffd_internal_fs::directory_entry &entry, callback_type &callback) {
+			std::string record;
+			bool recurse = callback(entry, record);
+			if (!record.empty())
+				batch_.push_back(record);
+			if (recurse && ffd_internal_fs::is_directory(entry))
+				pending_.push_back(entry.path());
+		}
+		void expand(const ffd_internal_fs::path &dir, callback_type &callback) {
+			try {
+#if __cplusplus >= 201703L
+				for (auto const &node : ffd_internal_fs::directory_iterator{ dir }) {
+					visit(node, callback);
+				}
+#else
+				for (ffd_internal_fs::directory_iterator ditr{ dir };
+					 ditr != ffd_internal_fs::directory_iterator{};
+					 ++ditr) {
+					visit(*ditr, callback);
+				}
+#endif
+			} catch (const ffd_internal_fs::filesystem_error &) {
+				// unreadable directory, skip it like find(1) would
+			}
+		}
+		/**
+		 * @brief Send pending records, then donate the shallowest half of the pending
+		 * directories if the coordinator has idle workers
+		 *
+		 */
+		void checkin(void) {
+			std::vector<std::string> msg;
+			msg.reserve(batch_.size() + 1);
+			msg.push_back(ShardedCrawl::_results);
+			msg.insert(msg.end(), batch_.begin(), batch_.end());
+			batch_.clear();
+			send(msg);
+			client_.receive_data_async(msg);
+			if (msg.empty() || msg[0] != ShardedCrawl::_split || pending_.size() < 2)
+				return;
+			size_t give = pending_.size() / 2;
+			msg.clear();
+			msg.push_back(ShardedCrawl::_dirs);
+			for (size_t i = 0; i < give; ++i) {
+				msg.push_back(pending_.front().string());
+				pending_.pop_front();
+			}
+			send(msg);
+			client_.receive_data_async(msg);
+		}
+	};
+
+	/**
+	 * @brief Coordinator side of a multi-process crawl. Hands subtrees out to
+	 * ShardedCrawlWorker processes over a Unix socket, asks busy workers to split their work
+	 * whenever another worker goes idle, and merges the streamed results on the calling
+	 * thread.
+	 *
+	 * Workers can be started with spawn_workers() or be separate programs connecting to the
+	 * same socket path.
+	 *
+	 * Example:
+	 * @include tests/MTDirCrawler/sharded_count.cpp
+	 */
+	class ShardedCrawlCoordinator {
+	public:
+		/**
+		 * @brief Construct a new Sharded Crawl Coordinator object, creating the socket
+		 *
+		 * @param socket_path Path to socket inode to create
+		 * @param workers Number of workers that will connect
+		 */
+		ShardedCrawlCoordinator(const std::string &socket_path, int workers)
+			: socket_path_(socket_path)
+			, server_(socket_path)
+			, workers_(workers)
+			, children_() {
+			server_.set_framing(true);
+		}
+		/**
+		 * @brief fork() worker processes running ShardedCrawlWorker::run() with callback.
+		 * Must be called before the calling process starts any threads.
+		 *
+		 * @param n Number of workers to fork
+		 * @param callback Worker callback, see ShardedCrawlWorker
+		 */
+		void spawn_workers(int n, ShardedCrawlWorker::callback_type callback) {
+			for (int i = 0; i < n; ++i) {
+				pid_t pid = fork();
+				if (pid == -1) {
+					int error = errno;
+					throw CrawlerException(strerror(error), error);
+				}
+				if (pid == 0) {
+					int status = 0;
+					try {
+						ShardedCrawlWorker worker(socket_path_);
+						worker.run(callback);
+					} catch (...) {
+						status = 1;
+					}
+					_exit(status);
+				}
+				children_.push_back(pid);
+			}
+		}
+		/**
+		 * @brief Crawl roots with the connected workers, calling merge on each result record
+		 * as it arrives. Returns once every worker has been told there is no work left, after
+		 * reaping any workers started with spawn_workers().
+		 *
+		 * @param roots Paths to start the traversal from
+		 * @param merge Function to call on each record sent back by the workers
+		 */
+		void run(const std::vector<std::string> &roots,
+				 std::function<void(const std::string &)> merge) {
+			std::deque<Unit> queue;
+			for (const std::string &root : roots)
+				queue.push_back(Unit{ ShardedCrawl::_root, root });
+			std::vector<Worker> workers;
+			std::vector<pollfd> pfds;
+			std::vector<size_t> polled; // index into workers for each pfds entry after listener
+			int busy = 0, finished = 0, accepted = 0;
+			std::vector<std::string> msg;
+			while (finished < workers_) {
+				pfds.clear();
+				polled.clear();
+				if (accepted < workers_)
+					pfds.push_back(pollfd{ server_.get_fd(), POLLIN, 0 });
+				for (size_t i = 0; i < workers.size(); ++i) {
+					if (workers[i].state == Worker::DONE)
+						continue;
+					pfds.push_back(pollfd{ workers[i].fd, POLLIN, 0 });
+					polled.push_back(i);
+				}
+				if (poll(pfds.data(), pfds.size(), -1) == -1) {
+					int error = errno;
+					if (error == EINTR)
+						continue;
+					throw CrawlerException(strerror(error), error);
+				}
+				size_t p = 0;
+				if (accepted < workers_) {
+					if (pfds[p].revents & POLLIN) {
+						workers.push_back(Worker{ server_.wait_for_connection(), Worker::BUSY });
+						++accepted;
+						++busy; // counts as busy until its first NEXT
+					}
+					++p;
+				}
+				for (size_t i = 0; p < pfds.size(); ++p, ++i) {
+					if (!pfds[p].revents)
+						continue;
+					Worker &w = workers[polled[i]];
+					server_.receive_data_async(msg, 0, w.fd);
+					if (msg.empty()) {
+						if (w.state == Worker::BUSY)
+							throw CrawlerException("Crawl worker disconnected while busy");
+						w.state = Worker::DONE;
+						++finished;
+						server_.close_connection(w.fd);
+						continue;
+					}
+					if (msg[0] == ShardedCrawl::_next) {
+						w.state = Worker::IDLE;
+						--busy;
+					} else if (msg[0] == ShardedCrawl::_results) {
+						for (size_t r = 1; r < msg.size(); ++r)
+							merge(msg[r]);
+						bool idle = false;
+						for (const Worker &o : workers)
+							idle |= o.state == Worker::IDLE;
+						reply(w.fd,
+							  (idle && queue.empty()) ? ShardedCrawl::_split : ShardedCrawl::_ok);
+					} else if (msg[0] == ShardedCrawl::_dirs) {
+						for (size_t r = 1; r < msg.size(); ++r)
+							queue.push_back(Unit{ ShardedCrawl::_dir, msg[r] });
+						reply(w.fd, ShardedCrawl::_ok);
+					} else {
+						throw CrawlerException("Unexpected message from crawl worker: " + msg[0]);
+					}
+				}
+				// hand out work to idle workers, or tell them to stop once everyone is idle
+				for (Worker &w : workers) {
+					if (w.state != Worker::IDLE)
+						continue;
+					if (!queue.empty()) {
+						server_.send_data_async(
+							std::vector<std::string>{
+								ShardedCrawl::_work, queue.front().kind, queue.front().path },
+							MSG_NOSIGNAL,
+							w.fd);
+						queue.pop_front();
+						w.state = Worker::BUSY;
+						++busy;
+					} else if (busy == 0 && accepted == workers_) {
+						reply(w.fd, ShardedCrawl::_done);
+						w.state = Worker::DONE;
+						++finished;
+						server_.close_connection(w.fd);
+					}
+				}
+			}
+			reap_children();
+		}
+	private:
+		/**
+		 * @brief Unit of work waiting to be handed out
+		 *
+		 */
+		struct Unit {
+			const char *kind; ///< ShardedCrawl::_root or ShardedCrawl::_dir
+			std::string path; ///< Path to crawl
+		};
+		/**
+		 * @brief Connected worker
+		 *
+		 */
+		struct Worker {
+			int fd; ///< Connection fd
+			enum { BUSY, IDLE, DONE } state;
+		};
+		std::string socket_path_;   ///< Path to socket inode
+		UnixSocketServer server_;   ///< Listening socket
+		int workers_;               ///< Number of workers expected to connect
+		std::vector<pid_t> children_; ///< Workers started with spawn_workers()
+		void reply(int fd, const char *verb) {
+			server_.send_data_async(std::vector<std::string>{ verb }, MSG_NOSIGNAL, fd);
+		}
+		void reap_children(void) {
+			bool failed = false;
+			for (pid_t pid : children_) {
+				int status;
+				if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status)
+					|| WEXITSTATUS(status) != 0)
+					failed = true;
+			}
+			children_.clear();
+			if (failed)
+				throw CrawlerException("Crawl worker process failed");
+		}
+	};
+} // namespace ffd
@@ -0,0 +1,322 @@
+// -*- C++ -*-
+/*
+ *    Copyright (C) 2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of lib45d.
+ *
+ *    lib45d is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    lib45d is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with lib45d.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <45d/crawler/DirFdCache.hpp>
+#include <45d/low_overhead_string.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#if __cplusplus >= 201703L
+#	include <filesystem>
+namespace ffd_internal_fs = std::filesystem;
+#else
+#	include <boost/filesystem.hpp>
+namespace ffd_internal_fs = boost::filesystem;
+#endif
+
+extern "C" {
+#include <sys/xattr.h>
+}
+
+namespace ffd {
+	/**
+	 * @brief Default parameters for XattrCollector
+	 *
+	 */
+	namespace XattrCollect {
+		const size_t _max_shared_default = 65536; ///< Interned values kept, see XattrCollector
+		const size_t _max_names = 4096;           ///< Interned names kept per thread
+	} // namespace XattrCollect
+
+	/**
+	 * @brief Collects extended attributes of crawled entries as an optional stage in front of
+	 * an MTDirCrawler callback.
+	 *
+	 * Attributes are read with llistxattr() and lgetxattr() through the parent directory fd
+	 * (see DirFdCache) into per-thread buffers that are reused between entries. Values of
+	 * attributes matching the shared patterns, ACLs by default, are interned by content hash:
+	 * entries with the same ACL get the same std::shared_ptr, and a value that was seen before
+	 * costs no allocation. Consumers can compare the pointers to process each distinct ACL
+	 * once. The table holds at most max_shared values; when it fills up, values no consumer
+	 * holds any more are dropped first.
+	 *
+	 * Names are interned per thread, and wrap() hands the callback a per-thread list whose
+	 * entries are overwritten in place, so a crawl allocates only for values that are neither
+	 * shared nor fit in a value the callback let go of.
+	 *
+	 * Example:
+	 * @include tests/MTDirCrawler/xattr_collect.cpp
+	 */
+	class XattrCollector {
+	public:
+		/**
+		 * @brief An extended attribute of an entry
+		 *
+		 */
+		struct Xattr {
+			std::shared_ptr<const std::string> name;  ///< Attribute name, e.g. "user.foo"
+			std::shared_ptr<const std::string> value; ///< Attribute value
+		};
+		typedef std::vector<Xattr> xattr_list; ///< Attributes of one entry
+		/**
+		 * @brief Construct a new Xattr Collector object
+		 *
+		 * @param name_patterns Wildcard patterns of attribute names to collect
+		 * @param shared_patterns Wildcard patterns of attribute names whose values are
+		 * interned
+		 * @param max_shared Most interned values to keep
+		 */
+		XattrCollector(const std::vector<std::string> &name_patterns = { "*" },
+					   const std::vector<std::string> &shared_patterns = { "system.posix_acl_*",
+																		   "system.nfs4_acl",
+																		   "security.NTACL" },
+					   size_t max_shared = XattrCollect::_max_shared_default)
+			: name_patterns_(name_patterns)
+			, shared_patterns_(shared_patterns)
+			, blobs_()
+			, blob_count_(0)
+			, max_shared_(max_shared)
+			, mutex_()
+			, shared_hits_(0) {}
+		/**
+		 * @brief Collect the attributes of one entry. Thread safe, meant to be called from a
+		 * crawl callback. Entries whose attributes can't be listed yield an empty list.
+		 *
+		 * @param entry Directory entry to read attributes of
+		 * @param out Attributes returned by reference. Its entries are overwritten in place,
+		 * and a value only out holds is reused for the new one.
+		 */
+		void collect(const ffd_internal_fs::directory_entry &entry, xattr_list &out) {
+			out.resize(read(entry, out));
+		}
+		/**
+		 * @brief Wrap a callback taking the entry's attributes into an MTDirCrawler callback
+		 *
+		 * @param callback Function to call on each directory entry and its attributes,
+		 * should return true if the directory entry should be recursed into
+		 * @return std::function<bool(const ffd_internal_fs::directory_entry &)>
+		 */
+		std::function<bool(const ffd_internal_fs::directory_entry &)>
+		wrap(std::function<bool(const ffd_internal_fs::directory_entry &, const xattr_list &)>
+				 callback) {
+			return [this, callback](const ffd_internal_fs::directory_entry &entry) {
+				xattr_list &attrs = buffers().attrs;
+				collect(entry, attrs);
+				return callback(entry, attrs);
+			};
+		}
+		/**
+		 * @brief Get number of distinct shared values interned
+		 *
+		 * @return size_t
+		 */
+		size_t unique_blobs(void) {
+			std::lock_guard<std::mutex> lk(mutex_);
+			return blob_count_;
+		}
+		/**
+		 * @brief Get number of shared values that were found in the cache
+		 *
+		 * @return unsigned long
+		 */
+		unsigned long shared_hits(void) const {
+			return shared_hits_;
+		}
+	private:
+		/**
+		 * @brief Per-thread buffers reused between entries
+		 *
+		 */
+		struct Buffers {
+			std::string path;        ///< /proc/self/fd/N/name
+			std::vector<char> list;  ///< llistxattr() result
+			std::vector<char> value; ///< lgetxattr() result
+			std::string name;        ///< Lookup key for names
+			/// Interned attribute names
+			std::unordered_map<std::string, std::shared_ptr<const std::string>> names;
+			xattr_list attrs; ///< List handed to wrap()'s callback
+			Buffers() : path(), list(1024), value(4096), name(), names(), attrs() {}
+		};
+		std::vector<std::string> name_patterns_;   ///< Names to collect
+		std::vector<std::string> shared_patterns_; ///< Names whose values are interned
+		/**
+		 * @brief Interned values by FNV-1a hash
+		 *
+		 */
+		std::unordered_map<uint64_t, std::vector<std::shared_ptr<const std::string>>> blobs_;
+		size_t blob_count_;                      ///< Values in blobs_
+		size_t max_shared_;                      ///< Most values to keep in blobs_
+		std::mutex mutex_;                       ///< Guards blobs_ and blob_count_
+		std::atomic<unsigned long> shared_hits_; ///< Values found in blobs_
+		static Buffers &buffers(void) {
+			static thread_local Buffers buff;
+			return buff;
+		}
+		/**
+		 * @brief Read the matching attributes of an entry into the first slots of out,
+		 * growing it if need be
+		 *
+		 * @return size_t Number of attributes read
+		 */
+		size_t read(const ffd_internal_fs::directory_entry &entry, xattr_list &out) {
+			ffd_internal_fs::path norm =
+				entry.path().has_filename() ? entry.path() : entry.path().parent_path();
+			int dirfd = DirFdCache::local().get(norm.parent_path().string());
+			if (dirfd == -1)
+				return 0;
+			Buffers &buff = buffers();
+			std::string &fd_path = buff.path;
+			fd_path = "/proc/self/fd/";
+			fd_path += std::to_string(dirfd);
+			fd_path += '/';
+			fd_path += norm.filename().string();
+			ssize_t len;
+			while ((len = llistxattr(fd_path.c_str(), buff.list.data(), buff.list.size())) == -1
+				   && errno == ERANGE) {
+				if (!grow(buff.list, llistxattr(fd_path.c_str(), nullptr, 0)))
+					return 0;
+			}
+			if (len <= 0)
+				return 0;
+			size_t n = 0;
+			for (const char *name = buff.list.data(); name < buff.list.data() + len;
+				 name += strlen(name) + 1) {
+				if (!matches(name, name_patterns_))
+					continue;
+				ssize_t vlen;
+				while ((vlen = lgetxattr(
+							fd_path.c_str(), name, buff.value.data(), buff.value.size()))
+						   == -1
+					   && errno == ERANGE) {
+					if (!grow(buff.value, lgetxattr(fd_path.c_str(), name, nullptr, 0)))
+						break;
+				}
+				if (vlen < 0)
+					continue;
+				if (n == out.size())
+					out.emplace_back();
+				Xattr &attr = out[n++];
+				attr.name = intern_name(buff, name);
+				if (matches(name, shared_patterns_)) {
+					attr.value = intern(buff.value.data(), vlen);
+				} else if (attr.value && attr.value.use_count() == 1) {
+					// values are created non-const, so one nobody else holds can be refilled
+					const_cast<std::string &>(*attr.value).assign(buff.value.data(), vlen);
+				} else {
+					attr.value = std::make_shared<std::string>(buff.value.data(), vlen);
+				}
+			}
+			return n;
+		}
+		/**
+		 * @brief Get the per-thread shared copy of an attribute name, starting over when the
+		 * table holds XattrCollect::_max_names
+		 *
+		 */
+		static const std::shared_ptr<const std::string> &intern_name(Buffers &buff,
+																	   const char *name) {
+			buff.name = name;
+			std::unordered_map<std::string, std::shared_ptr<const std::string>>::iterator itr =
+				buff.names.find(buff.name);
+			if (itr != buff.names.end())
+				return itr->second;
+			if (buff.names.size() >= XattrCollect::_max_names)
+				buff.names.clear();
+			return buff.names
+				.emplace(buff.name, std::make_shared<const std::string>(buff.name))
+				.first->second;
+		}
+		static bool matches(const char *name, const std::vector<std::string> &patterns) {
+			for (const std::string &pattern : patterns) {
+				if (ffd::pattern_match(name, pattern.c_str()))
+					return true;
+			}
+			return false;
+		}
+		static bool grow(std::vector<char> &buff, ssize_t needed) {
+			if (needed < 0)
+				return false;
+			buff.resize(std::max(size_t(needed), buff.size() * 2));
+			return true;
+		}
+		static uint64_t hash(const char *data, size_t len) {
+			uint64_t h = 14695981039346656037ULL;
+			for (size_t i = 0; i < len; ++i) {
+				h ^= static_cast<unsigned char>(data[i]);
+				h *= 1099511628211ULL;
+			}
+			return h;
+		}
+		/**
+		 * @brief Make room in a full blobs_, dropping values only the table holds, or every
+		 * value if they are all still in use. Values handed out stay valid either way.
+		 *
+		 */
+		void evict(void) {
+			for (auto itr = blobs_.begin(); itr != blobs_.end();) {
+				std::vector<std::shared_ptr<const std::string>> &bucket = itr->second;
+				size_t before = bucket.size();
+				bucket.erase(std::remove_if(bucket.begin(),
+											bucket.end(),
+											[](const std::shared_ptr<const std::string> &blob) {
+												return blob.use_count() == 1;
+											}),
+							 bucket.end());
+				blob_count_ -= before - bucket.size();
+				if (bucket.empty())
+					itr = blobs_.erase(itr);
+				else
+					++itr;
+			}
+			if (blob_count_ >= max_shared_) {
+				blobs_.clear();
+				blob_count_ = 0;
+			}
+		}
+		std::shared_ptr<const std::string> intern(const char *data, size_t len) {
+			uint64_t h = hash(data, len);
+			std::lock_guard<std::mutex> lk(mutex_);
+			std::vector<std::shared_ptr<const std::string>> *bucket = &blobs_[h];
+			for (const std::shared_ptr<const std::string> &blob : *bucket) {
+				if (blob->length() == len && memcmp(blob->data(), data, len) == 0) {
+					++shared_hits_;
+					return blob;
+				}
+			}
+			if (blob_count_ >= max_shared_) {
+				evict();
+				bucket = &blobs_[h]; // evict() may have erased it
+			}
+			bucket->push_back(std::make_shared<std::string>(data, len));
+			++blob_count_;
+			return bucket->back();
+		}
+	};
+} // namespace ffd
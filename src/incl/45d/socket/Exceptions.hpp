@@ -91,6 +91,15 @@ namespace ffd {
 		SocketConnectException(const std::string &what, int err = 0) : SocketException(what, err) {}
 	};
 
+	/**
+	 * @brief Thrown when setsockopt() fails
+	 *
+	 */
+	class SocketOptionException : public SocketException {
+	public:
+		SocketOptionException(const std::string &what, int err = 0) : SocketException(what, err) {}
+	};
+
 	/**
 	 * @brief Thrown when write() fails
 	 *
@@ -118,4 +127,44 @@ namespace ffd {
 		SocketShutdownException(const std::string &what, int err = 0)
 			: SocketException(what, err) {}
 	};
+
+	/**
+	 * @brief Thrown when setting up or waiting on the SocketReactor's epoll instance fails
+	 *
+	 */
+	class SocketReactorException : public SocketException {
+	public:
+		SocketReactorException(const std::string &what, int err = 0)
+			: SocketException(what, err) {}
+	};
+
+	/**
+	 * @brief Thrown for RPC calls that failed, either in the server's handler or because the
+	 * connection closed before the reply arrived
+	 *
+	 */
+	class RpcException : public SocketException {
+	public:
+		RpcException(const std::string &what, int err = 0) : SocketException(what, err) {}
+	};
+
+	/**
+	 * @brief Thrown when a binary record message is malformed or a field is read as the wrong
+	 * type, see RecordView
+	 *
+	 */
+	class RecordDecodeException : public SocketException {
+	public:
+		RecordDecodeException(const std::string &what, int err = 0)
+			: SocketException(what, err) {}
+	};
+
+	/**
+	 * @brief Thrown when setting up or using a shared memory ring fails, see ShmRingProducer
+	 *
+	 */
+	class ShmRingException : public SocketException {
+	public:
+		ShmRingException(const std::string &what, int err = 0) : SocketException(what, err) {}
+	};
 } // namespace ffd
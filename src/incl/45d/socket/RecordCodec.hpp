@@ -0,0 +1,327 @@
+// -*- C++ -*-
+/*
+ *    Copyright (C) 2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of lib45d.
+ *
+ *    lib45d is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    lib45d is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with lib45d.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <45d/Bytes.hpp>
+#include <45d/socket/Exceptions.hpp>
+#include <45d/socket/SocketBase.hpp>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace ffd {
+	/**
+	 * @brief Binary record encoding, an alternative to record separator delimited vectors
+	 * that is binary safe and can be read field by field in place.
+	 *
+	 * A message is laid out as, all integers little endian:
+	 *
+	 *     uint32 count
+	 *     uint8  type[count]        Records::Type of each field
+	 *     padding to 4 bytes
+	 *     uint32 end[count]         End offset of each field in data
+	 *     data                      Field contents back to back
+	 *
+	 * Field i spans data[end[i - 1], end[i]), so any field is found in constant time.
+	 * Integers and Bytes are stored as 8 byte little endian values, strings as raw bytes.
+	 */
+	namespace Records {
+		/**
+		 * @brief Field type tags
+		 *
+		 */
+		enum Type : uint8_t {
+			STRING = 0, ///< Raw bytes
+			INT64 = 1,  ///< Signed 64 bit integer
+			BYTES = 2,  ///< ffd::Bytes, stored as its byte count
+		};
+		/**
+		 * @brief Store a little endian integer
+		 *
+		 */
+		template<typename T>
+		inline void store_le(char *dst, T val) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+			for (size_t i = 0; i < sizeof(T); ++i, val >>= 8)
+				dst[i] = (char)(val & 0xFF);
+#else
+			memcpy(dst, &val, sizeof(T));
+#endif
+		}
+		/**
+		 * @brief Load a little endian integer
+		 *
+		 */
+		template<typename T>
+		inline T load_le(const char *src) {
+			T val;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+			val = 0;
+			for (size_t i = sizeof(T); i > 0; --i)
+				val = (val << 8) | (unsigned char)src[i - 1];
+#else
+			memcpy(&val, src, sizeof(T));
+#endif
+			return val;
+		}
+		/**
+		 * @brief Size of the count, type and offset tables for count fields
+		 *
+		 */
+		inline size_t header_size(size_t count) {
+			return ((4 + count + 3) & ~(size_t)3) + 4 * count;
+		}
+	} // namespace Records
+
+	/**
+	 * @brief Builds binary record messages, see namespace Records for the layout. Reuse one
+	 * encoder to avoid allocating per message.
+	 *
+	 * Example:
+	 * @include tests/classes/records.cpp
+	 */
+	class RecordEncoder {
+	public:
+		/**
+		 * @brief Construct a new empty Record Encoder object
+		 *
+		 */
+		RecordEncoder() : types_(), ends_(), data_(), out_() {}
+		/**
+		 * @brief Append a string field
+		 *
+		 * @param str Field contents, may contain any bytes
+		 * @return RecordEncoder& *this
+		 */
+		RecordEncoder &add(const std::string &str) {
+			return add(str.data(), str.size());
+		}
+		/**
+		 * @brief Append a string field
+		 *
+		 * @param data Field contents
+		 * @param len Length of data
+		 * @return RecordEncoder& *this
+		 */
+		RecordEncoder &add(const char *data, size_t len) {
+			data_.append(data, len);
+			return push(Records::STRING);
+		}
+		/**
+		 * @brief Append an integer field
+		 *
+		 * @param val Value
+		 * @return RecordEncoder& *this
+		 */
+		RecordEncoder &add(int64_t val) {
+			char buff[8];
+			Records::store_le<uint64_t>(buff, (uint64_t)val);
+			data_.append(buff, sizeof(buff));
+			return push(Records::INT64);
+		}
+		/**
+		 * @brief Append a Bytes field
+		 *
+		 * @param bytes Value
+		 * @return RecordEncoder& *this
+		 */
+		RecordEncoder &add(const Bytes &bytes) {
+			char buff[8];
+			Records::store_le<uint64_t>(buff, (uint64_t)bytes.get());
+			data_.append(buff, sizeof(buff));
+			return push(Records::BYTES);
+		}
+		/**
+		 * @brief Get the number of fields added so far
+		 *
+		 * @return size_t
+		 */
+		size_t size(void) const {
+			return types_.size();
+		}
+		/**
+		 * @brief Remove all fields, keeping allocated memory
+		 *
+		 */
+		void clear(void) {
+			types_.clear();
+			ends_.clear();
+			data_.clear();
+		}
+		/**
+		 * @brief Lay out the message. The returned string is owned by the encoder and is
+		 * overwritten by the next call.
+		 *
+		 * @return const std::string& Encoded message, e.g. for SocketBase::send_data()
+		 */
+		const std::string &encode(void) {
+			size_t count = types_.size();
+			size_t header = Records::header_size(count);
+			out_.assign(header + data_.size(), '\0');
+			char *p = &out_[0];
+			Records::store_le<uint32_t>(p, count);
+			if (count)
+				memcpy(p + 4, types_.data(), count);
+			char *ends = p + header - 4 * count;
+			for (size_t i = 0; i < count; ++i)
+				Records::store_le<uint32_t>(ends + 4 * i, ends_[i]);
+			if (!data_.empty())
+				memcpy(p + header, data_.data(), data_.size());
+			return out_;
+		}
+	private:
+		std::vector<uint8_t> types_;
+		std::vector<uint32_t> ends_;
+		std::string data_;
+		std::string out_; ///< Result of encode()
+		RecordEncoder &push(Records::Type type) {
+			if (data_.size() > UINT32_MAX)
+				throw SocketWriteException("Record message too large", EMSGSIZE);
+			types_.push_back(type);
+			ends_.push_back(data_.size());
+			return *this;
+		}
+	};
+
+	/**
+	 * @brief Reads a binary record message in place, e.g. straight from the BufferView
+	 * returned by SocketBase::receive_view_async(). The layout is checked once on
+	 * construction; after that each field is found in constant time without copying. The
+	 * message must outlive the view.
+	 *
+	 */
+	class RecordView {
+	public:
+		/**
+		 * @brief Construct a new Record View object over an encoded message
+		 *
+		 * @param data Encoded message
+		 * @param len Length of data
+		 */
+		RecordView(const char *data, size_t len) : base_(data), count_(0), ends_(), data_() {
+			parse(len);
+		}
+		/**
+		 * @brief Construct a new Record View object over an encoded message
+		 *
+		 * @param message Encoded message
+		 */
+		RecordView(BufferView message) : base_(message.data()), count_(0), ends_(), data_() {
+			parse(message.size());
+		}
+		/**
+		 * @brief Get the number of fields
+		 *
+		 * @return size_t
+		 */
+		size_t size(void) const {
+			return count_;
+		}
+		/**
+		 * @brief Get a field's type
+		 *
+		 * @param i Field index
+		 * @return Records::Type
+		 */
+		Records::Type type(size_t i) const {
+			check_index(i);
+			return (Records::Type)(uint8_t)base_[4 + i];
+		}
+		/**
+		 * @brief Get a string field without copying
+		 *
+		 * @param i Field index
+		 * @return BufferView Field contents, pointing into the message
+		 */
+		BufferView string(size_t i) const {
+			check_type(i, Records::STRING);
+			size_t begin = start(i);
+			return BufferView(data_ + begin, end(i) - begin);
+		}
+		/**
+		 * @brief Get an integer field
+		 *
+		 * @param i Field index
+		 * @return int64_t
+		 */
+		int64_t int64(size_t i) const {
+			check_type(i, Records::INT64);
+			return fixed(i);
+		}
+		/**
+		 * @brief Get a Bytes field
+		 *
+		 * @param i Field index
+		 * @return Bytes
+		 */
+		Bytes bytes(size_t i) const {
+			check_type(i, Records::BYTES);
+			return Bytes((Bytes::bytes_type)fixed(i));
+		}
+	private:
+		const char *base_; ///< Start of message
+		size_t count_;     ///< Number of fields
+		const char *ends_; ///< End offset table
+		const char *data_; ///< Start of field data
+		void parse(size_t len) {
+			if (len < 4)
+				throw RecordDecodeException("Record message truncated", EBADMSG);
+			count_ = Records::load_le<uint32_t>(base_);
+			if (count_ > len) // at least a type byte per field
+				throw RecordDecodeException("Record message truncated", EBADMSG);
+			size_t header = Records::header_size(count_);
+			if (header > len)
+				throw RecordDecodeException("Record message truncated", EBADMSG);
+			ends_ = base_ + header - 4 * count_;
+			data_ = base_ + header;
+			size_t data_len = len - header;
+			uint32_t prev = 0;
+			for (size_t i = 0; i < count_; ++i) {
+				uint32_t end = Records::load_le<uint32_t>(ends_ + 4 * i);
+				uint8_t type = (uint8_t)base_[4 + i];
+				if (end < prev || end > data_len)
+					throw RecordDecodeException("Record offsets out of range", EBADMSG);
+				if (type > Records::BYTES
+					|| (type != Records::STRING && end - prev != sizeof(int64_t)))
+					throw RecordDecodeException("Bad record field type", EBADMSG);
+				prev = end;
+			}
+		}
+		size_t start(size_t i) const {
+			return i == 0 ? 0 : end(i - 1);
+		}
+		size_t end(size_t i) const {
+			return Records::load_le<uint32_t>(ends_ + 4 * i);
+		}
+		int64_t fixed(size_t i) const {
+			return (int64_t)Records::load_le<uint64_t>(data_ + start(i));
+		}
+		void check_index(size_t i) const {
+			if (i >= count_)
+				throw RecordDecodeException("Record index out of range", ERANGE);
+		}
+		void check_type(size_t i, Records::Type type) const {
+			if (this->type(i) != type)
+				throw RecordDecodeException("Record field has a different type", EINVAL);
+		}
+	};
+} // namespace ffd
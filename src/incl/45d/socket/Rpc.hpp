@@ -0,0 +1,387 @@
+// -*- C++ -*-
+/*
+ *    Copyright (C) 2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of lib45d.
+ *
+ *    lib45d is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    lib45d is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with lib45d.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <45d/Exceptions.hpp>
+#include <45d/socket/SocketReactor.hpp>
+#include <45d/socket/UnixSocketClient.hpp>
+#include <45d/socket/UnixSocketServer.hpp>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace ffd {
+	/**
+	 * @brief Defaults and wire format of the RPC layer.
+	 *
+	 * Requests and replies are framed messages (see SocketBase::set_framing()). A request's
+	 * payload is an 8 byte big endian request id followed by the request body. A reply's
+	 * payload is the id of the request it answers, a status byte, and the reply body, or the
+	 * error message if the status is Rpc::_error.
+	 */
+	namespace Rpc {
+		const int _threads_default = 4; ///< Server handler threads
+		const size_t _id_sz = 8;        ///< Bytes of request id
+		const char _ok = 0;             ///< Reply status: body is the handler's return value
+		const char _error = 1;          ///< Reply status: body is the error message
+	} // namespace Rpc
+
+	/**
+	 * @brief RPC client multiplexing any number of outstanding requests over one Unix socket
+	 * connection. Replies may come back in any order and complete a future or a callback.
+	 * Thread safe.
+	 *
+	 * Example:
+	 * @include tests/sockets/unix_rpc/client.cpp
+	 */
+	class RpcClient {
+	public:
+		/**
+		 * @brief Reply callback type. ok is false if the call failed, in which case reply is
+		 * the error message. Called from the client's reader thread, so it must not block.
+		 *
+		 */
+		typedef std::function<void(const std::string &reply, bool ok)> callback_type;
+		/**
+		 * @brief Construct a new Rpc Client object and connect to the server
+		 *
+		 * @param path Path to the RpcServer's socket inode
+		 */
+		RpcClient(const std::string &path)
+			: socket_(path)
+			, send_mutex_()
+			, pending_mutex_()
+			, pending_()
+			, next_id_(0)
+			, closed_(false)
+			, reader_() {
+			socket_.set_framing(true);
+			socket_.connect();
+			reader_ = std::thread(&RpcClient::reader, this);
+		}
+		RpcClient(const RpcClient &) = delete;
+		RpcClient &operator=(const RpcClient &) = delete;
+		/**
+		 * @brief Destroy the Rpc Client object. Calls still outstanding fail with
+		 * RpcException.
+		 *
+		 */
+		~RpcClient() {
+			try {
+				socket_.shutdown();
+			} catch (const SocketShutdownException &) {
+				// already disconnected
+			}
+			reader_.join();
+		}
+		/**
+		 * @brief Send a request
+		 *
+		 * @param request Request body
+		 * @return std::future<std::string> Reply body, or RpcException if the handler failed
+		 * or the connection closed
+		 */
+		std::future<std::string> call(const std::string &request) {
+			Pending pending;
+			std::future<std::string> reply = pending.promise.get_future();
+			send_request(request, pending);
+			return reply;
+		}
+		/**
+		 * @brief Send a request, calling callback with the reply
+		 *
+		 * @param request Request body
+		 * @param callback Called with the reply from the reader thread
+		 */
+		void call(const std::string &request, callback_type callback) {
+			Pending pending;
+			pending.callback = callback;
+			send_request(request, pending);
+		}
+		/**
+		 * @brief Get the number of calls waiting for a reply
+		 *
+		 * @return size_t
+		 */
+		size_t pending(void) {
+			std::lock_guard<std::mutex> lk(pending_mutex_);
+			return pending_.size();
+		}
+	private:
+		/**
+		 * @brief Outstanding call, completed through either promise or callback
+		 *
+		 */
+		struct Pending {
+			std::promise<std::string> promise;
+			callback_type callback;
+			void complete(const std::string &reply, bool ok) {
+				if (callback)
+					callback(reply, ok);
+				else if (ok)
+					promise.set_value(reply);
+				else
+					promise.set_exception(std::make_exception_ptr(RpcException(reply)));
+			}
+		};
+		UnixSocketClient socket_;
+		std::mutex send_mutex_;    ///< Keeps requests from interleaving on the socket
+		std::mutex pending_mutex_; ///< Guards pending_, next_id_ and closed_
+		std::unordered_map<uint64_t, Pending> pending_;
+		uint64_t next_id_;
+		bool closed_; ///< Reader saw the connection close, calls fail right away
+		std::thread reader_;
+		void send_request(const std::string &request, Pending &pending) {
+			uint64_t id;
+			{
+				std::lock_guard<std::mutex> lk(pending_mutex_);
+				if (closed_)
+					throw RpcException("Connection closed", ENOTCONN);
+				id = next_id_++;
+				pending_.emplace(id, std::move(pending));
+			}
+			std::string payload(Rpc::_id_sz, '\0');
+			Socket::encode_length(id, &payload[0]);
+			payload += request;
+			try {
+				std::lock_guard<std::mutex> lk(send_mutex_);
+				socket_.send_data_async(payload, MSG_NOSIGNAL);
+			} catch (const SocketException &) {
+				std::lock_guard<std::mutex> lk(pending_mutex_);
+				pending_.erase(id);
+				throw;
+			}
+		}
+		void reader(void) {
+			std::string reason = "Connection closed";
+			try {
+				for (;;) {
+					BufferView reply = socket_.receive_view_async();
+					if (reply.empty())
+						break;
+					if (reply.size() < Rpc::_id_sz + 1) {
+						reason = "Malformed reply";
+						break;
+					}
+					uint64_t id = Socket::decode_length(reply.data());
+					Pending pending;
+					{
+						std::lock_guard<std::mutex> lk(pending_mutex_);
+						std::unordered_map<uint64_t, Pending>::iterator itr = pending_.find(id);
+						if (itr == pending_.end())
+							continue; // not ours, ignore
+						pending = std::move(itr->second);
+						pending_.erase(itr);
+					}
+					pending.complete(std::string(reply.data() + Rpc::_id_sz + 1,
+												 reply.size() - Rpc::_id_sz - 1),
+									 reply[Rpc::_id_sz] == Rpc::_ok);
+				}
+			} catch (const SocketException &e) {
+				reason = e.what();
+			}
+			std::unordered_map<uint64_t, Pending> failed;
+			{
+				std::lock_guard<std::mutex> lk(pending_mutex_);
+				closed_ = true;
+				failed.swap(pending_);
+			}
+			for (auto &pending : failed)
+				pending.second.complete(reason, false);
+		}
+	};
+
+	/**
+	 * @brief RPC server. Requests are read on a SocketReactor event loop and handled
+	 * concurrently on a pool of threads, and each reply is sent as soon as it is ready,
+	 * whatever the order the requests came in.
+	 *
+	 * The handler returns the reply body. Exceptions it throws are sent back as errors and
+	 * raised from the client's future as RpcException.
+	 *
+	 * Example:
+	 * @include tests/sockets/unix_rpc/server.cpp
+	 */
+	class RpcServer {
+	public:
+		typedef std::function<std::string(const std::string &request)>
+			handler_type; ///< Request handler type, called from the handler threads
+		/**
+		 * @brief Construct a new Rpc Server object, listening on path and starting the
+		 * handler threads
+		 *
+		 * @param path Path to socket inode to create
+		 * @param handler Called for each request
+		 * @param threads Number of handler threads
+		 */
+		RpcServer(const std::string &path,
+				  handler_type handler,
+				  int threads = Rpc::_threads_default)
+			: socket_(path)
+			, handler_(handler)
+			, reactor_(socket_, reactor_handlers())
+			, workers_()
+			, jobs_()
+			, jobs_mutex_()
+			, jobs_cv_()
+			, done_(false) {
+			for (int i = 0; i < threads; ++i)
+				workers_.emplace_back(&RpcServer::worker, this);
+		}
+		RpcServer(const RpcServer &) = delete;
+		RpcServer &operator=(const RpcServer &) = delete;
+		/**
+		 * @brief Destroy the Rpc Server object, finishing requests already being handled
+		 *
+		 */
+		~RpcServer() {
+			{
+				std::lock_guard<std::mutex> lk(jobs_mutex_);
+				done_ = true;
+			}
+			jobs_cv_.notify_all();
+			for (std::thread &t : workers_)
+				t.join();
+		}
+		/**
+		 * @brief Serve requests on this thread until stop() is called
+		 *
+		 */
+		void run(void) {
+			reactor_.run();
+		}
+		/**
+		 * @brief Make run() return. Only stores a flag and writes to an eventfd, so it is safe
+		 * to call from any thread or from a signal handler.
+		 *
+		 */
+		void stop(void) {
+			reactor_.stop();
+		}
+	private:
+		/**
+		 * @brief Request waiting for a handler thread
+		 *
+		 */
+		struct Job {
+			uint64_t connection; ///< SocketReactor::Connection::id()
+			std::string id;      ///< Encoded request id, echoed in the reply
+			std::string request;
+		};
+		UnixSocketServer socket_;
+		handler_type handler_;
+		SocketReactor reactor_;
+		std::vector<std::thread> workers_;
+		std::deque<Job> jobs_;
+		std::mutex jobs_mutex_;
+		std::condition_variable jobs_cv_;
+		bool done_;
+		SocketReactor::Handlers reactor_handlers(void) {
+			SocketReactor::Handlers handlers;
+			handlers.on_data = [this](SocketReactor::Connection &connection) {
+				on_data(connection);
+			};
+			return handlers;
+		}
+		/**
+		 * @brief Queue every complete request in the connection's input
+		 *
+		 */
+		void on_data(SocketReactor::Connection &connection) {
+			std::string &in = connection.input();
+			size_t off = 0;
+			std::vector<Job> jobs;
+			while (in.size() - off >= Socket::_frame_header_sz) {
+				uint64_t len = Socket::decode_length(in.data() + off);
+				if (len < Rpc::_id_sz || len > Socket::_max_frame_sz) {
+					connection.close(); // not speaking the protocol
+					in.clear();
+					return;
+				}
+				if (in.size() - off - Socket::_frame_header_sz < len)
+					break; // rest of the request hasn't arrived yet
+				const char *payload = in.data() + off + Socket::_frame_header_sz;
+				Job job;
+				job.connection = connection.id();
+				job.id.assign(payload, Rpc::_id_sz);
+				job.request.assign(payload + Rpc::_id_sz, len - Rpc::_id_sz);
+				jobs.push_back(std::move(job));
+				off += Socket::_frame_header_sz + len;
+			}
+			in.erase(0, off);
+			if (jobs.empty())
+				return;
+			{
+				std::lock_guard<std::mutex> lk(jobs_mutex_);
+				for (Job &job : jobs)
+					jobs_.push_back(std::move(job));
+			}
+			jobs_cv_.notify_all();
+		}
+		void worker(void) {
+			for (;;) {
+				Job job;
+				{
+					std::unique_lock<std::mutex> lk(jobs_mutex_);
+					while (jobs_.empty() && !done_)
+						jobs_cv_.wait(lk);
+					if (jobs_.empty())
+						return;
+					job = std::move(jobs_.front());
+					jobs_.pop_front();
+				}
+				char status = Rpc::_ok;
+				std::string body;
+				try {
+					body = handler_(job.request);
+				} catch (const std::exception &e) {
+					status = Rpc::_error;
+					body = e.what();
+				} catch (const ffd::Exception &e) {
+					status = Rpc::_error;
+					body = e.what();
+				} catch (...) {
+					status = Rpc::_error;
+					body = "Unknown error";
+				}
+				std::string frame(Socket::_frame_header_sz, '\0');
+				Socket::encode_length(Rpc::_id_sz + 1 + body.size(), &frame[0]);
+				frame.reserve(frame.size() + Rpc::_id_sz + 1 + body.size());
+				frame += job.id;
+				frame += status;
+				frame += body;
+				uint64_t connection = job.connection;
+				reactor_.post([this, connection, frame]() {
+					SocketReactor::Connection *c = reactor_.find(connection);
+					if (c != nullptr)
+						c->send(frame);
+				});
+			}
+		}
+	};
+} // namespace ffd
@@ -0,0 +1,477 @@
+// -*- C++ -*-
+/*
+ *    Copyright (C) 2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of lib45d.
+ *
+ *    lib45d is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    lib45d is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with lib45d.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <45d/socket/Exceptions.hpp>
+#include <45d/socket/SocketBase.hpp>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ffd {
+	/**
+	 * @brief Defaults and shared layout of the shared memory ring transport.
+	 *
+	 * The memfd holds a Shared control block in its first _header_sz bytes followed by the
+	 * ring. Each message is a record of an 8 byte header (uint32 length, uint32 kind) and the
+	 * message padded to 8 bytes. Records never wrap around the end of the ring; a _wrap record
+	 * fills the space left instead. Messages too big for the ring are sent over the socket and
+	 * leave a _socket record in the ring so they are still received in order.
+	 */
+	namespace ShmRing {
+		const size_t _capacity_default = 4 << 20;     ///< Bytes of ring, rounded up to a power of 2
+		const size_t _capacity_min = 4096;            ///< Smallest ring
+		const size_t _header_sz = 4096;               ///< Bytes before the ring
+		const size_t _record_header_sz = 8;           ///< Length and kind of each record
+		const uint64_t _magic = 0x676e69722d646666ULL; ///< "ffd-ring"
+		const char _hello[] = "ffd-shm-ring";         ///< Message the memfd is handed over with
+		const uint32_t _data = 0;                     ///< Record kind: message in the ring
+		const uint32_t _wrap = 1;                     ///< Record kind: skip to start of ring
+		const uint32_t _socket = 2;                   ///< Record kind: message on the socket
+
+		/**
+		 * @brief Control block at the start of the memfd. Head and tail are running byte
+		 * counts, on separate cache lines since each is written by a different process.
+		 *
+		 */
+		struct Shared {
+			uint64_t magic;
+			uint64_t capacity;
+			alignas(64) std::atomic<uint64_t> head; ///< Bytes published by the producer
+			std::atomic<uint32_t> consumer_waiting; ///< Consumer is asleep, signal data_fd
+			std::atomic<uint32_t> closed;           ///< Producer is done
+			alignas(64) std::atomic<uint64_t> tail; ///< Bytes released by the consumer
+			std::atomic<uint32_t> producer_waiting; ///< Producer is asleep, signal space_fd
+		};
+		static_assert(sizeof(Shared) <= _header_sz, "Shared must fit in the header");
+
+		/**
+		 * @brief Bytes taken in the ring by a record holding len bytes
+		 *
+		 */
+		inline size_t record_size(size_t len) {
+			return _record_header_sz + ((len + 7) & ~(size_t)7);
+		}
+	} // namespace ShmRing
+
+	/**
+	 * @brief State shared by both ends of a shared memory ring: the mapping, the two eventfds
+	 * and the control socket.
+	 *
+	 */
+	class ShmRingBase {
+	public:
+		ShmRingBase(const ShmRingBase &) = delete;
+		ShmRingBase &operator=(const ShmRingBase &) = delete;
+		/**
+		 * @brief Get the size of the ring in bytes
+		 *
+		 * @return size_t
+		 */
+		size_t capacity(void) const {
+			return capacity_;
+		}
+		/**
+		 * @brief Get the largest message that goes through shared memory. Bigger messages
+		 * are sent over the socket.
+		 *
+		 * @return size_t
+		 */
+		size_t max_message(void) const {
+			return capacity_ / 4;
+		}
+	protected:
+		SocketBase &socket_;
+		int fd_;       ///< Connection fd on socket_
+		int mem_fd_;   ///< memfd backing the ring
+		int data_fd_;  ///< eventfd signalled when the producer publishes data
+		int space_fd_; ///< eventfd signalled when the consumer frees space
+		void *map_;
+		size_t map_sz_;
+		ShmRing::Shared *shared_;
+		char *ring_;
+		size_t capacity_;
+		ShmRingBase(SocketBase &socket, int fd)
+			: socket_(socket)
+			, fd_(fd ? fd : socket.get_io_fd())
+			, mem_fd_(-1)
+			, data_fd_(-1)
+			, space_fd_(-1)
+			, map_(MAP_FAILED)
+			, map_sz_(0)
+			, shared_(nullptr)
+			, ring_(nullptr)
+			, capacity_(0) {
+			if (!socket.framing())
+				throw ShmRingException("Socket must be framed", EINVAL);
+		}
+		~ShmRingBase() {
+			if (map_ != MAP_FAILED)
+				munmap(map_, map_sz_);
+			for (int fd : { mem_fd_, data_fd_, space_fd_ })
+				if (fd != -1)
+					close(fd);
+		}
+		void map(size_t capacity) {
+			map_sz_ = ShmRing::_header_sz + capacity;
+			map_ = mmap(NULL, map_sz_, PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd_, 0);
+			if (map_ == MAP_FAILED) {
+				int error = errno;
+				throw ShmRingException(strerror(error), error);
+			}
+			shared_ = (ShmRing::Shared *)map_;
+			ring_ = (char *)map_ + ShmRing::_header_sz;
+			capacity_ = capacity;
+		}
+		void signal(int efd) {
+			uint64_t one = 1;
+			if (write(efd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+				int error = errno;
+				throw ShmRingException(strerror(error), error);
+			}
+		}
+		/**
+		 * @brief Sleep on efd until ready() holds. waiting is raised before the last check so
+		 * the other end knows to signal.
+		 *
+		 * @return false if the peer closed the socket before ready() held
+		 */
+		template<typename Ready>
+		bool wait(int efd, std::atomic<uint32_t> &waiting, Ready ready) {
+			for (;;) {
+				if (ready())
+					return true;
+				waiting.store(1);
+				if (ready()) {
+					waiting.store(0);
+					return true;
+				}
+				struct pollfd fds[2];
+				fds[0].fd = efd;
+				fds[0].events = POLLIN;
+				fds[1].fd = fd_;
+				fds[1].events = POLLRDHUP;
+				int res = poll(fds, 2, -1);
+				waiting.store(0);
+				if (res == -1) {
+					if (errno == EINTR)
+						continue;
+					int error = errno;
+					throw ShmRingException(strerror(error), error);
+				}
+				if (fds[0].revents & POLLIN) {
+					uint64_t count;
+					if (read(efd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+						int error = errno;
+						throw ShmRingException(strerror(error), error);
+					}
+				}
+				if (fds[1].revents)
+					return ready();
+			}
+		}
+	};
+
+	/**
+	 * @brief Sending end of a single producer, single consumer ring in shared memory, set up
+	 * over an existing Unix socket connection. The memfd backing the ring and two eventfds are
+	 * handed to the peer's ShmRingConsumer with SCM_RIGHTS, after which messages are copied
+	 * straight into shared memory. The consumer is only woken through an eventfd when it is
+	 * asleep, so a busy consumer costs no syscalls.
+	 *
+	 * The socket stays open as the control channel: it carries messages bigger than
+	 * max_message() and tells each end if the other goes away. It must be framed on both ends
+	 * (see SocketBase::set_framing()) and not otherwise used while the ring is open.
+	 *
+	 * Only one thread may send at a time.
+	 *
+	 * Example:
+	 * @include tests/sockets/unix_shm_ring/client.cpp
+	 */
+	class ShmRingProducer : public ShmRingBase {
+	public:
+		/**
+		 * @brief Construct a new Shm Ring Producer object, creating the ring and handing it
+		 * to the peer. Blocks until the peer's ShmRingConsumer accepts it.
+		 *
+		 * @param socket Connected socket to negotiate over
+		 * @param capacity Size of the ring in bytes, rounded up to a power of 2
+		 * @param fd Optional file descriptor for connection
+		 */
+		ShmRingProducer(SocketBase &socket,
+						size_t capacity = ShmRing::_capacity_default,
+						int fd = 0)
+			: ShmRingBase(socket, fd), closed_(false) {
+			size_t cap = ShmRing::_capacity_min;
+			while (cap < capacity)
+				cap <<= 1;
+			mem_fd_ = memfd_create("ffd-shm-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+			if (mem_fd_ == -1) {
+				int error = errno;
+				throw ShmRingException(strerror(error), error);
+			}
+			// sealing the size keeps a misbehaving peer from making our mapping fault
+			if (ftruncate(mem_fd_, ShmRing::_header_sz + cap) == -1
+				|| fcntl(mem_fd_, F_ADD_SEALS, F_SEAL_GROW | F_SEAL_SHRINK | F_SEAL_SEAL) == -1) {
+				int error = errno;
+				throw ShmRingException(strerror(error), error);
+			}
+			map(cap);
+			new (shared_) ShmRing::Shared();
+			shared_->magic = ShmRing::_magic;
+			shared_->capacity = cap;
+			data_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+			space_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+			if (data_fd_ == -1 || space_fd_ == -1) {
+				int error = errno;
+				throw ShmRingException(strerror(error), error);
+			}
+			socket_.send_fds(
+				std::vector<int>{ mem_fd_, data_fd_, space_fd_ }, ShmRing::_hello, 0, fd_);
+			std::string reply;
+			socket_.receive_data_async(reply, 0, fd_);
+			if (reply != "ok")
+				throw ShmRingException(reply.empty() ? "Connection closed" : reply, ECONNREFUSED);
+		}
+		/**
+		 * @brief Destroy the Shm Ring Producer object, closing the ring
+		 *
+		 */
+		~ShmRingProducer() {
+			try {
+				close();
+			} catch (const SocketException &) {
+				// peer already gone
+			}
+		}
+		/**
+		 * @brief Send a message, blocking while the ring is full
+		 *
+		 * @param str Message to send
+		 */
+		void send(const std::string &str) {
+			send(str.data(), str.size());
+		}
+		/**
+		 * @brief Send a message, blocking while the ring is full
+		 *
+		 * @param data Message to send
+		 * @param len Length of data
+		 */
+		void send(const char *data, size_t len) {
+			if (closed_)
+				throw ShmRingException("Ring is closed", EPIPE);
+			bool fallback = len > max_message();
+			size_t need = ShmRing::record_size(fallback ? 0 : len);
+			uint64_t head = shared_->head.load(std::memory_order_relaxed);
+			size_t off = head & (capacity_ - 1);
+			size_t pad = capacity_ - off < need ? capacity_ - off : 0;
+			ShmRing::Shared *shared = shared_;
+			uint64_t cap = capacity_;
+			uint64_t total = pad + need;
+			if (!wait(space_fd_, shared_->producer_waiting, [shared, head, cap, total]() {
+					return cap - (head - shared->tail.load()) >= total;
+				}))
+				throw ShmRingException("Consumer closed connection", EPIPE);
+			if (pad) {
+				write_header(off, 0, ShmRing::_wrap);
+				head += pad;
+				off = 0;
+			}
+			if (fallback) {
+				write_header(off, 0, ShmRing::_socket);
+			} else {
+				write_header(off, len, ShmRing::_data);
+				memcpy(ring_ + off + ShmRing::_record_header_sz, data, len);
+			}
+			shared_->head.store(head + need);
+			if (shared_->consumer_waiting.load())
+				signal(data_fd_);
+			// after publishing the record, else a consumer blocked on the ring would never
+			// read the socket and a big send would never finish
+			if (fallback)
+				socket_.send_data_async(std::string(data, len), MSG_NOSIGNAL, fd_);
+		}
+		/**
+		 * @brief Tell the consumer no more messages are coming. It receives what is left in
+		 * the ring first. Called by the destructor.
+		 *
+		 */
+		void close(void) {
+			if (closed_)
+				return;
+			closed_ = true;
+			shared_->closed.store(1);
+			signal(data_fd_);
+		}
+	private:
+		bool closed_;
+		void write_header(size_t off, uint32_t len, uint32_t kind) {
+			memcpy(ring_ + off, &len, sizeof(len));
+			memcpy(ring_ + off + sizeof(len), &kind, sizeof(kind));
+		}
+	};
+
+	/**
+	 * @brief Receiving end of a shared memory ring, see ShmRingProducer. Messages are read in
+	 * place from shared memory.
+	 *
+	 * Only one thread may receive at a time.
+	 *
+	 * Example:
+	 * @include tests/sockets/unix_shm_ring/server.cpp
+	 */
+	class ShmRingConsumer : public ShmRingBase {
+	public:
+		/**
+		 * @brief Construct a new Shm Ring Consumer object, accepting the ring the peer's
+		 * ShmRingProducer hands over
+		 *
+		 * @param socket Connected socket to negotiate over
+		 * @param fd Optional file descriptor for connection
+		 */
+		ShmRingConsumer(SocketBase &socket, int fd = 0)
+			: ShmRingBase(socket, fd), tail_(0), held_(0) {
+			std::vector<int> fds;
+			std::string hello;
+			socket_.receive_fds(fds, hello, 0, fd_);
+			if (fds.size() == 3) {
+				mem_fd_ = fds[0];
+				data_fd_ = fds[1];
+				space_fd_ = fds[2];
+			} else {
+				for (int received : fds)
+					::close(received);
+			}
+			if (hello != ShmRing::_hello || fds.size() != 3)
+				refuse("Not a shared memory ring", EPROTO);
+			struct stat st;
+			if (fstat(mem_fd_, &st) == -1)
+				refuse(strerror(errno), errno);
+			int seals = fcntl(mem_fd_, F_GET_SEALS);
+			if (seals == -1 || !(seals & F_SEAL_SHRINK))
+				refuse("Ring memfd is not sealed", EPROTO);
+			if ((size_t)st.st_size < ShmRing::_header_sz + ShmRing::_capacity_min)
+				refuse("Ring memfd too small", EPROTO);
+			size_t cap = st.st_size - ShmRing::_header_sz;
+			if (cap & (cap - 1))
+				refuse("Ring capacity not a power of 2", EPROTO);
+			map(cap);
+			if (shared_->magic != ShmRing::_magic || shared_->capacity != cap)
+				refuse("Bad ring header", EPROTO);
+			tail_ = shared_->tail.load();
+			socket_.send_data_async("ok", MSG_NOSIGNAL, fd_);
+		}
+		/**
+		 * @brief Receive the next message, blocking while the ring is empty
+		 *
+		 * @param payload Received message returned by reference
+		 * @return false if the producer closed the ring or the connection
+		 */
+		bool receive(std::string &payload) {
+			BufferView view;
+			if (!receive_view(view))
+				return false;
+			payload.assign(view.data(), view.size());
+			return true;
+		}
+		/**
+		 * @brief Receive the next message without copying it out of the ring. The view is
+		 * valid until the next receive, which is when its space is given back to the
+		 * producer.
+		 *
+		 * @param view Received message returned by reference
+		 * @return false if the producer closed the ring or the connection
+		 */
+		bool receive_view(BufferView &view) {
+			release();
+			for (;;) {
+				ShmRing::Shared *shared = shared_;
+				uint64_t tail = tail_;
+				if (!wait(data_fd_, shared_->consumer_waiting, [shared, tail]() {
+						return shared->head.load() != tail || shared->closed.load();
+					}))
+					return false;
+				if (shared_->head.load() == tail_)
+					return false; // closed and drained
+				size_t off = tail_ & (capacity_ - 1);
+				uint32_t len, kind;
+				memcpy(&len, ring_ + off, sizeof(len));
+				memcpy(&kind, ring_ + off + sizeof(len), sizeof(kind));
+				if (kind == ShmRing::_wrap) {
+					held_ = capacity_ - off;
+					release();
+					continue;
+				}
+				if (kind == ShmRing::_socket) {
+					held_ = ShmRing::record_size(0);
+					view = socket_.receive_view_async(0, fd_);
+					if (view.empty()) // fallback messages are never empty
+						throw ShmRingException("Connection closed mid-message", ECONNRESET);
+					return true;
+				}
+				if (kind != ShmRing::_data || len > capacity_ - off - ShmRing::_record_header_sz)
+					throw ShmRingException("Corrupt ring record", EPROTO);
+				held_ = ShmRing::record_size(len);
+				view = BufferView(ring_ + off + ShmRing::_record_header_sz, len);
+				return true;
+			}
+		}
+	private:
+		uint64_t tail_; ///< Start of the record last returned
+		size_t held_;   ///< Size of the record last returned, given back by release()
+		/**
+		 * @brief Give the last record's space back to the producer
+		 *
+		 */
+		void release(void) {
+			if (!held_)
+				return;
+			tail_ += held_;
+			held_ = 0;
+			shared_->tail.store(tail_);
+			if (shared_->producer_waiting.load())
+				signal(space_fd_);
+		}
+		/**
+		 * @brief Tell the producer the ring was rejected and throw
+		 *
+		 */
+		void refuse(const std::string &why, int err) {
+			try {
+				socket_.send_data_async(why, MSG_NOSIGNAL, fd_);
+			} catch (const SocketException &) {
+				// throw the original error below
+			}
+			throw ShmRingException(why, err);
+		}
+	};
+} // namespace ffd
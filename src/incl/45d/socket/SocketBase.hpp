@@ -21,13 +21,23 @@
 #pragma once
 
 #include <45d/socket/Exceptions.hpp>
-#include <sstream>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <vector>
+#if __cplusplus >= 201703L
+#	include <string_view>
+#endif
 
 extern "C" {
+#include <limits.h> // for IOV_MAX
 #include <string.h> // for strerror
 #include <sys/socket.h>
-#include <unistd.h> // for close
+#include <sys/uio.h> // for iovec
+#include <unistd.h>  // for close
 }
 
 namespace ffd {
@@ -49,10 +59,106 @@ namespace ffd {
 			FFD_SOCKET_BUFF_SZ;
 #endif
 		const char _rec_delim = 0x1E; ///< Record separator character
-	}                                 // namespace Socket
+		const char _ack = '\6';       ///< Byte sent to acknowledge a message
+		const size_t _iov_batch = IOV_MAX; ///< Buffers per sendmsg() when sending vectors
+		const size_t _window_default = 256;   ///< Unacknowledged pipelined messages in flight
+		const size_t _ack_batch_default = 64; ///< Pipelined messages received per cumulative ACK
+		const size_t _max_fds = 253; ///< Descriptors per send_fds(), the kernel's SCM_MAX_FD
+		const size_t _batch_default = 64; ///< Messages per receive_batch()
+		const size_t _mmsg_max = 1024;    ///< Messages per sendmmsg()/recvmmsg(), UIO_MAXIOV
+		/**
+		 * @brief Room for each message in receive_batch(). Can be overridden by defining
+		 * FFD_SOCKET_BATCH_SLOT_SZ before including header.
+		 *
+		 */
+		const size_t _batch_slot_sz =
+#ifndef FFD_SOCKET_BATCH_SLOT_SZ
+			4096;
+#else
+			FFD_SOCKET_BATCH_SLOT_SZ;
+#endif
+		const size_t _frame_header_sz = 8; ///< Big endian payload length preceding framed messages
+		/**
+		 * @brief Largest framed message accepted, so a corrupt header can't trigger a huge
+		 * allocation. Can be overridden by defining FFD_SOCKET_MAX_FRAME before including header.
+		 *
+		 */
+		const uint64_t _max_frame_sz =
+#ifndef FFD_SOCKET_MAX_FRAME
+			1ULL << 30;
+#else
+			FFD_SOCKET_MAX_FRAME;
+#endif
+		/**
+		 * @brief Write a frame length header, see SocketBase::set_framing()
+		 *
+		 * @param len Payload length
+		 * @param header Socket::_frame_header_sz bytes to fill in
+		 */
+		inline void encode_length(uint64_t len, char *header) {
+			for (int i = _frame_header_sz - 1; i >= 0; --i, len >>= 8)
+				header[i] = (char)(len & 0xFF);
+		}
+		/**
+		 * @brief Read a frame length header, see SocketBase::set_framing()
+		 *
+		 * @param header Socket::_frame_header_sz bytes
+		 * @return uint64_t Payload length
+		 */
+		inline uint64_t decode_length(const char *header) {
+			uint64_t len = 0;
+			for (size_t i = 0; i < _frame_header_sz; ++i)
+				len = (len << 8) | (unsigned char)header[i];
+			return len;
+		}
+	} // namespace Socket
+#if __cplusplus >= 201703L
+	typedef std::string_view BufferView; ///< View into a socket's receive buffer
+#else
+	/**
+	 * @brief View into a socket's receive buffer, a minimal stand-in for std::string_view
+	 *
+	 */
+	class BufferView {
+	public:
+		BufferView() : data_(nullptr), size_(0) {}
+		BufferView(const char *data, size_t size) : data_(data), size_(size) {}
+		const char *data(void) const {
+			return data_;
+		}
+		size_t size(void) const {
+			return size_;
+		}
+		bool empty(void) const {
+			return size_ == 0;
+		}
+		const char *begin(void) const {
+			return data_;
+		}
+		const char *end(void) const {
+			return data_ + size_;
+		}
+		char operator[](size_t i) const {
+			return data_[i];
+		}
+		bool operator==(const std::string &str) const {
+			return str.size() == size_ && (size_ == 0 || memcmp(data_, str.data(), size_) == 0);
+		}
+		bool operator!=(const std::string &str) const {
+			return !(*this == str);
+		}
+	private:
+		const char *data_;
+		size_t size_;
+	};
+#endif
 	/**
 	 * @brief Base Unix Socket Class for opening and closing the socket
 	 *
+	 * The *_sync methods and their aliases exchange a one byte ACK per message. A SOCK_DGRAM
+	 * socket has no connection to carry the ACK back on, so they throw SocketException with
+	 * EINVAL there; use the *_async methods.
+	 *
 	 */
 	class SocketBase {
 	public:
@@ -63,10 +169,19 @@ namespace ffd {
 		 * see man socket(2) for details
 		 *
 		 * @param domain Usually AF_UNIX or AF_INET
-		 * @param type Usually SOCK_STREAM
+		 * @param type SOCK_STREAM, or SOCK_SEQPACKET or SOCK_DGRAM to have the kernel keep
+		 * message boundaries
 		 * @param protocol Normally just 0
 		 */
-		SocketBase(int domain, int type, int protocol = 0) : ACK('\6') {
+		SocketBase(int domain, int type, int protocol = 0)
+			: type_(type)
+			, ACK(Socket::_ack)
+			, framed_(false)
+			, window_(Socket::_window_default)
+			, ack_batch_(Socket::_ack_batch_default)
+			, conns_()
+			, conns_mutex_()
+			, track_activity_(false) {
 			int res = socket(domain, type, protocol);
 			if (res == -1) {
 				int error = errno;
@@ -91,6 +206,10 @@ namespace ffd {
 			if (fd == 0) {
 				fd = io_fd_;
 			}
+			{
+				std::lock_guard<std::mutex> lk(conns_mutex_);
+				conns_.erase(fd);
+			}
 			int res = close(fd);
 			if (res == -1) {
 				int error = errno;
@@ -107,6 +226,17 @@ namespace ffd {
 		void send_data_async(const std::string &str, int flags = 0, int fd = 0) {
 			if (fd == 0)
 				fd = io_fd_;
+			if (framed_) {
+				char header[Socket::_frame_header_sz];
+				Socket::encode_length(str.length(), header);
+				struct iovec iov[2];
+				iov[0].iov_base = header;
+				iov[0].iov_len = sizeof(header);
+				iov[1].iov_base = (void *)str.data();
+				iov[1].iov_len = str.length();
+				send_iov(fd, iov, 2, flags);
+				return;
+			}
 			int res = send(fd, (void *)str.c_str(), str.length(), flags);
 			if (res == -1) {
 				int error = errno;
@@ -121,6 +251,7 @@ namespace ffd {
 		 * @param fd Optional file descriptor for connection
 		 */
 		void send_data_sync(const std::string &str, int flags = 0, int fd = 0) {
+			check_acked();
 			if (fd == 0)
 				fd = io_fd_;
 			send_data_async(str, flags, fd);
@@ -140,19 +271,49 @@ namespace ffd {
 		/**
 		 * @brief Send a vector as a record separator (0x1E) delimited string
 		 *
+		 * The records are sent in place with scatter/gather sendmsg() rather than copied into
+		 * one payload string first. An empty vector sends an empty message on framed or
+		 * packet sockets; an unframed stream has no way to carry one, so there it throws
+		 * SocketException with EINVAL.
+		 *
 		 * @param vec Vector to send
 		 * @param flags see man send(2)
 		 * @param fd Optional file descriptor for connection
 		 */
 		void send_data_async(const std::vector<std::string> &vec, int flags = 0, int fd = 0) {
-			std::string payload;
-			std::vector<std::string>::const_iterator itr = vec.begin();
-			payload = *itr;
-			++itr;
-			for (; itr != vec.end(); ++itr) {
-				payload += Socket::_rec_delim + *itr;
+			if (fd == 0)
+				fd = io_fd_;
+			if (type_ != SOCK_STREAM) {
+				send_packet(vec, flags, fd);
+				return;
+			}
+			if (vec.empty() && !framed_)
+				throw SocketException("Empty message needs framing, see set_framing()", EINVAL);
+			// records and delimiters go straight from vec, Socket::_iov_batch buffers at a time
+			struct iovec iov[Socket::_iov_batch];
+			size_t n = 0;
+			char header[Socket::_frame_header_sz];
+			if (framed_) {
+				uint64_t len = vec.empty() ? 0 : vec.size() - 1;
+				for (const std::string &record : vec)
+					len += record.length();
+				Socket::encode_length(len, header);
+				iov[n].iov_base = header;
+				iov[n++].iov_len = sizeof(header);
+			}
+			for (size_t i = 0; i < vec.size(); ++i) {
+				if (n + 2 > Socket::_iov_batch) {
+					send_iov(fd, iov, n, flags | MSG_MORE);
+					n = 0;
+				}
+				if (i) {
+					iov[n].iov_base = (void *)&Socket::_rec_delim;
+					iov[n++].iov_len = 1;
+				}
+				iov[n].iov_base = (void *)vec[i].data();
+				iov[n++].iov_len = vec[i].length();
 			}
-			send_data_async(payload, flags, fd);
+			send_iov(fd, iov, n, flags);
 		}
 		/**
 		 * @brief Send a vector as a record separator (0x1E) delimited string and wait for ACK
@@ -162,6 +323,7 @@ namespace ffd {
 		 * @param fd Optional file descriptor for connection
 		 */
 		void send_data_sync(const std::vector<std::string> &vec, int flags = 0, int fd = 0) {
+			check_acked();
 			send_data_async(vec, flags, fd);
 			get_ack(fd);
 		}
@@ -174,7 +336,7 @@ namespace ffd {
 		 * @param fd Optional file descriptor for connection
 		 */
 		void send_data(const std::vector<std::string> &vec, int flags = 0, int fd = 0) {
-			send_data_sync(vec, fd, flags);
+			send_data_sync(vec, flags, fd);
 		}
 		/**
 		 * @brief Receive a string
@@ -187,19 +349,12 @@ namespace ffd {
 			payload = "";
 			if (fd == 0)
 				fd = io_fd_;
-			char buff[Socket::_buff_sz];
-			memset(&buff, 0, sizeof(buff));
-			int bytes_read = 0;
-			do {
-				bytes_read = recv(fd, &buff, sizeof(buff) - 1, flags);
-				if (bytes_read == -1) {
-					int error = errno;
-					throw SocketReadException(strerror(error), error);
-				}
-				buff[bytes_read] = '\0';
-				payload += buff;
-			} while (bytes_read > 0
-					 && recv(fd, &buff, sizeof(buff) - 1, MSG_PEEK | MSG_DONTWAIT) > 0);
+			if (framed_) {
+				receive_frame(payload, flags, fd);
+				return;
+			}
+			BufferView view = receive_view_async(flags, fd);
+			payload.assign(view.data(), view.size());
 		}
 		/**
 		 * @brief Receive a string and reply with ACK
@@ -209,6 +364,7 @@ namespace ffd {
 		 * @param fd Optional file descriptor for connection
 		 */
 		void receive_data_sync(std::string &payload, int flags = 0, int fd = 0) {
+			check_acked();
 			receive_data_async(payload, flags, fd);
 			send_ack(fd);
 		}
@@ -231,13 +387,11 @@ namespace ffd {
 		 * @param fd Optional file descriptor for connection
 		 */
 		void receive_data_async(std::vector<std::string> &vec, int flags = 0, int fd = 0) {
-			vec.clear();
-			std::string payload, record;
-			receive_data_async(payload, flags, fd);
-			std::stringstream ss(payload);
-			while (std::getline(ss, record, Socket::_rec_delim)) {
-				vec.push_back(record);
-			}
+			std::vector<BufferView> &records = record_views();
+			receive_view_async(records, flags, fd);
+			vec.resize(records.size()); // reuses the capacity of strings already in vec
+			for (size_t i = 0; i < records.size(); ++i)
+				vec[i].assign(records[i].data(), records[i].size());
 		}
 		/**
 		 * @brief Receive a vector as a record separator (0x1E) delimited string and reply with ACK
@@ -247,6 +401,7 @@ namespace ffd {
 		 * @param fd Optional file descriptor for connection
 		 */
 		void receive_data_sync(std::vector<std::string> &vec, int flags = 0, int fd = 0) {
+			check_acked();
 			receive_data_async(vec, flags, fd);
 			send_ack(fd);
 		}
@@ -261,6 +416,413 @@ namespace ffd {
 		void receive_data(std::vector<std::string> &vec, int flags = 0, int fd = 0) {
 			receive_data_sync(vec, flags, fd);
 		}
+		/**
+		 * @brief Receive a message into the connection's own receive buffer and return a view
+		 * of it, without allocating once the buffer has grown to the usual message size.
+		 *
+		 * Each connection fd gets a buffer that grows as needed and is kept until
+		 * close_connection(). The view is valid until the next receive on the same fd.
+		 *
+		 * @param flags see man recv(2)
+		 * @param fd Optional file descriptor for connection
+		 * @return BufferView Received message, empty if the peer closed the connection
+		 */
+		BufferView receive_view_async(int flags = 0, int fd = 0) {
+			if (fd == 0)
+				fd = io_fd_;
+			return receive_message(flags, fd, nullptr);
+		}
+		/**
+		 * @brief Receive a message into the connection's receive buffer and reply with ACK,
+		 * see receive_view_async(int, int)
+		 *
+		 * @param flags see man recv(2)
+		 * @param fd Optional file descriptor for connection
+		 * @return BufferView Received message, empty if the peer closed the connection
+		 */
+		BufferView receive_view_sync(int flags = 0, int fd = 0) {
+			check_acked();
+			BufferView view = receive_view_async(flags, fd);
+			send_ack(fd);
+			return view;
+		}
+		/**
+		 * @brief Receive a record separator (0x1E) delimited message as views of each record.
+		 * Records are split with memchr(), and the views point into the connection's receive
+		 * buffer, see receive_view_async(int, int).
+		 *
+		 * @param records Views of received records returned by reference, cleared first
+		 * @param flags see man recv(2)
+		 * @param fd Optional file descriptor for connection
+		 */
+		void receive_view_async(std::vector<BufferView> &records, int flags = 0, int fd = 0) {
+			split_records(receive_view_async(flags, fd), records);
+		}
+		/**
+		 * @brief Receive a record separator (0x1E) delimited message as views of each record
+		 * and reply with ACK, see receive_view_async(std::vector<BufferView>&, int, int)
+		 *
+		 * @param records Views of received records returned by reference, cleared first
+		 * @param flags see man recv(2)
+		 * @param fd Optional file descriptor for connection
+		 */
+		void receive_view_sync(std::vector<BufferView> &records, int flags = 0, int fd = 0) {
+			check_acked();
+			receive_view_async(records, flags, fd);
+			send_ack(fd);
+		}
+		/**
+		 * @brief Split a record separator (0x1E) delimited message into views of its records.
+		 * Like std::getline(), a trailing separator does not make an empty last record.
+		 *
+		 * @param payload Message to split
+		 * @param records Views into payload returned by reference, cleared first
+		 */
+		static void split_records(BufferView payload, std::vector<BufferView> &records) {
+			records.clear();
+			const char *itr = payload.data();
+			const char *end = itr + payload.size();
+			while (itr < end) {
+				const char *delim = (const char *)memchr(itr, Socket::_rec_delim, end - itr);
+				if (delim == nullptr) {
+					records.push_back(BufferView(itr, end - itr));
+					break;
+				}
+				records.push_back(BufferView(itr, delim - itr));
+				itr = delim + 1;
+			}
+		}
+		/**
+		 * @brief Set how many pipelined messages may be in flight without an ACK before
+		 * send_data_pipelined() blocks. Keep it in the hundreds: unread ACKs queue up in the
+		 * sender's receive buffer until the window fills.
+		 *
+		 * @param window Number of messages
+		 */
+		void set_window(size_t window) {
+			window_ = window ? window : 1;
+		}
+		/**
+		 * @brief Set how many pipelined messages receive_data_pipelined() takes before sending
+		 * a cumulative ACK. An ACK is also sent whenever no more data is waiting.
+		 *
+		 * @param batch Number of messages
+		 */
+		void set_ack_batch(size_t batch) {
+			ack_batch_ = batch ? batch : 1;
+		}
+		/**
+		 * @brief Send a string without waiting for its ACK, as long as fewer than the window's
+		 * worth of messages are unacknowledged (see set_window()). The receiver must use
+		 * receive_data_pipelined(), and both ends must be framed (see set_framing()).
+		 *
+		 * Each message is still acknowledged, but by cumulative ACKs that cover every message
+		 * through the one they name, so bulk transfers aren't paced by the round trip. Call
+		 * flush_pipeline() to wait until everything sent has been acknowledged.
+		 *
+		 * @param str Message to send
+		 * @param flags see man send(2)
+		 * @param fd Optional file descriptor for connection
+		 */
+		void send_data_pipelined(const std::string &str, int flags = 0, int fd = 0) {
+			if (fd == 0)
+				fd = io_fd_;
+			check_pipelined();
+			send_data_async(str, flags, fd);
+			sent_pipelined(fd);
+		}
+		/**
+		 * @brief Send a vector as a record separator (0x1E) delimited string without waiting
+		 * for its ACK, see send_data_pipelined(const std::string&, int, int)
+		 *
+		 * @param vec Vector to send
+		 * @param flags see man send(2)
+		 * @param fd Optional file descriptor for connection
+		 */
+		void send_data_pipelined(const std::vector<std::string> &vec, int flags = 0, int fd = 0) {
+			if (fd == 0)
+				fd = io_fd_;
+			check_pipelined();
+			send_data_async(vec, flags, fd);
+			sent_pipelined(fd);
+		}
+		/**
+		 * @brief Wait until every pipelined message sent on the connection is acknowledged
+		 *
+		 * @param fd Optional file descriptor for connection
+		 */
+		void flush_pipeline(int fd = 0) {
+			if (fd == 0)
+				fd = io_fd_;
+			Connection &c = conn(fd);
+			while (c.acked < c.sent)
+				read_cumulative_ack(fd, c);
+		}
+		/**
+		 * @brief Receive a string sent with send_data_pipelined(), sending a cumulative ACK
+		 * every ack batch (see set_ack_batch()) or when no more data is waiting
+		 *
+		 * @param payload Received message returned by reference
+		 * @param flags see man recv(2)
+		 * @param fd Optional file descriptor for connection
+		 */
+		void receive_data_pipelined(std::string &payload, int flags = 0, int fd = 0) {
+			if (fd == 0)
+				fd = io_fd_;
+			check_pipelined();
+			receive_data_async(payload, flags, fd);
+			received_pipelined(fd);
+		}
+		/**
+		 * @brief Receive a vector sent with send_data_pipelined(), see
+		 * receive_data_pipelined(std::string&, int, int)
+		 *
+		 * @param vec Received vector returned by reference
+		 * @param flags see man recv(2)
+		 * @param fd Optional file descriptor for connection
+		 */
+		void receive_data_pipelined(std::vector<std::string> &vec, int flags = 0, int fd = 0) {
+			if (fd == 0)
+				fd = io_fd_;
+			check_pipelined();
+			receive_data_async(vec, flags, fd);
+			received_pipelined(fd);
+		}
+		/**
+		 * @brief Send open file descriptors to the peer along with a message, using SCM_RIGHTS
+		 * ancillary data. Only works on AF_UNIX sockets. The peer gets its own duplicates of
+		 * the descriptors, so the caller may close its copies right after. No ACK is exchanged.
+		 *
+		 * @param fds Descriptors to pass, at most Socket::_max_fds
+		 * @param str Message to send with them. Unframed, an empty message is sent as a single
+		 * NUL byte, since descriptors must ride along with at least one byte of data. Unframed
+		 * stream messages are received in a single read, so a message longer than
+		 * Socket::_buff_sz may be cut short; use set_framing(true) for long messages.
+		 * @param flags see man send(2)
+		 * @param fd Optional file descriptor for connection
+		 */
+		void send_fds(const std::vector<int> &fds,
+					  const std::string &str = "",
+					  int flags = 0,
+					  int fd = 0) {
+			if (fd == 0)
+				fd = io_fd_;
+			if (fds.size() > Socket::_max_fds)
+				throw SocketWriteException("Too many file descriptors", EINVAL);
+			char header[Socket::_frame_header_sz];
+			struct iovec iov[2];
+			size_t n = 0;
+			if (framed_) {
+				Socket::encode_length(str.length(), header);
+				iov[n].iov_base = header;
+				iov[n++].iov_len = sizeof(header);
+			}
+			static const char nul = '\0';
+			if (!framed_ && str.empty()) {
+				iov[n].iov_base = (void *)&nul;
+				iov[n++].iov_len = 1;
+			} else {
+				iov[n].iov_base = (void *)str.data();
+				iov[n++].iov_len = str.length();
+			}
+			union {
+				struct cmsghdr align;
+				char buff[CMSG_SPACE(sizeof(int) * Socket::_max_fds)];
+			} control;
+			struct msghdr msg;
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_iov = iov;
+			msg.msg_iovlen = n;
+			if (!fds.empty()) {
+				memset(&control, 0, sizeof(control));
+				msg.msg_control = control.buff;
+				msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+				struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+				cmsg->cmsg_level = SOL_SOCKET;
+				cmsg->cmsg_type = SCM_RIGHTS;
+				cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+				memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+			}
+			ssize_t res;
+			do {
+				res = sendmsg(fd, &msg, flags);
+			} while (res == -1 && errno == EINTR);
+			if (res == -1) {
+				int error = errno;
+				throw SocketWriteException(strerror(error), error);
+			}
+			// descriptors went with the first byte, send whatever didn't fit
+			size_t sent = res;
+			for (size_t i = 0; i < n && sent; ++i) {
+				size_t skip = sent < iov[i].iov_len ? sent : iov[i].iov_len;
+				iov[i].iov_base = (char *)iov[i].iov_base + skip;
+				iov[i].iov_len -= skip;
+				sent -= skip;
+			}
+			send_iov(fd, iov, n, flags);
+		}
+		/**
+		 * @brief Receive file descriptors sent with send_fds() and the message they came with.
+		 * Received descriptors are close-on-exec and owned by the caller.
+		 *
+		 * @param fds Received descriptors returned by reference, cleared first
+		 * @param payload Received message returned by reference
+		 * @param flags see man recv(2)
+		 * @param fd Optional file descriptor for connection
+		 */
+		void receive_fds(std::vector<int> &fds, std::string &payload, int flags = 0, int fd = 0) {
+			if (fd == 0)
+				fd = io_fd_;
+			fds.clear();
+			BufferView view = receive_message(flags, fd, &fds);
+			payload.assign(view.data(), view.size());
+			if (!framed_ && payload.size() == 1 && payload[0] == '\0')
+				payload.clear();
+		}
+		/**
+		 * @brief Switch to length-prefixed messages. Both ends of a connection must agree.
+		 *
+		 * Unframed messages are read in Socket::_buff_sz chunks, peeking after each chunk to
+		 * guess whether more is coming, so a slow sender can have its message split and
+		 * back-to-back messages can run together. Framed messages carry an 8 byte big endian
+		 * length, so the receiver allocates the payload once and reads exactly that many
+		 * bytes, and message boundaries hold at any size. ACKs are unchanged.
+		 *
+		 * Only for SOCK_STREAM sockets; SOCK_SEQPACKET and SOCK_DGRAM keep message boundaries
+		 * on their own.
+		 *
+		 * @param framed true to frame messages
+		 */
+		void set_framing(bool framed) {
+			if (framed && type_ != SOCK_STREAM)
+				throw SocketException("Framing is only for stream sockets", EINVAL);
+			framed_ = framed;
+		}
+		/**
+		 * @brief Check whether messages are length-prefixed, see set_framing()
+		 *
+		 * @return true if framed
+		 */
+		bool framing(void) const {
+			return framed_;
+		}
+		/**
+		 * @brief Get the socket fd, e.g. for poll()ing a listening socket
+		 *
+		 * @return int fd of socket
+		 */
+		int get_fd(void) const {
+			return fd_;
+		}
+		/**
+		 * @brief Get the connection fd used when no fd is passed, e.g. for poll()ing it
+		 *
+		 * @return int fd of current connection
+		 */
+		int get_io_fd(void) const {
+			return io_fd_;
+		}
+		/**
+		 * @brief Get the socket type
+		 *
+		 * @return int SOCK_STREAM, SOCK_SEQPACKET or SOCK_DGRAM
+		 */
+		int get_type(void) const {
+			return type_;
+		}
+		/**
+		 * @brief Send each string as its own message with as few sendmmsg() calls as possible.
+		 * Only for SOCK_SEQPACKET and SOCK_DGRAM sockets, where each is read back whole by
+		 * one receive.
+		 *
+		 * @param messages Messages to send
+		 * @param flags see man send(2)
+		 * @param fd Optional file descriptor for connection
+		 */
+		void send_batch(const std::vector<std::string> &messages, int flags = 0, int fd = 0) {
+			if (fd == 0)
+				fd = io_fd_;
+			check_packet();
+			struct iovec iov[Socket::_mmsg_max];
+			struct mmsghdr msgs[Socket::_mmsg_max];
+			size_t done = 0;
+			while (done < messages.size()) {
+				size_t n = messages.size() - done;
+				if (n > Socket::_mmsg_max)
+					n = Socket::_mmsg_max;
+				memset(msgs, 0, sizeof(struct mmsghdr) * n);
+				for (size_t i = 0; i < n; ++i) {
+					iov[i].iov_base = (void *)messages[done + i].data();
+					iov[i].iov_len = messages[done + i].length();
+					msgs[i].msg_hdr.msg_iov = &iov[i];
+					msgs[i].msg_hdr.msg_iovlen = 1;
+				}
+				int res = sendmmsg(fd, msgs, n, flags);
+				if (res == -1) {
+					if (errno == EINTR)
+						continue;
+					int error = errno;
+					throw SocketWriteException(strerror(error), error);
+				}
+				done += res;
+			}
+		}
+		/**
+		 * @brief Receive up to max messages with one recvmmsg() call. Blocks until at least
+		 * one message arrives, then takes whatever else is already queued. Only for
+		 * SOCK_SEQPACKET and SOCK_DGRAM sockets.
+		 *
+		 * An empty message ends the batch; on a SOCK_SEQPACKET socket it means the peer hung
+		 * up. Messages must fit in Socket::_batch_slot_sz bytes.
+		 *
+		 * @param messages Views of the received messages returned by reference, valid until
+		 * the next receive on the connection
+		 * @param max Most messages to take, up to Socket::_mmsg_max
+		 * @param flags see man recv(2)
+		 * @param fd Optional file descriptor for connection
+		 * @return size_t Number of messages received
+		 */
+		size_t receive_batch(std::vector<BufferView> &messages,
+							 size_t max = Socket::_batch_default,
+							 int flags = 0,
+							 int fd = 0) {
+			if (fd == 0)
+				fd = io_fd_;
+			check_packet();
+			messages.clear();
+			if (max > Socket::_mmsg_max)
+				max = Socket::_mmsg_max;
+			if (max == 0)
+				return 0;
+			std::vector<char> &buff = conn(fd).rx;
+			if (buff.size() < max * Socket::_batch_slot_sz)
+				buff.resize(max * Socket::_batch_slot_sz);
+			struct iovec iov[Socket::_mmsg_max];
+			struct mmsghdr msgs[Socket::_mmsg_max];
+			memset(msgs, 0, sizeof(struct mmsghdr) * max);
+			for (size_t i = 0; i < max; ++i) {
+				iov[i].iov_base = buff.data() + i * Socket::_batch_slot_sz;
+				iov[i].iov_len = Socket::_batch_slot_sz;
+				msgs[i].msg_hdr.msg_iov = &iov[i];
+				msgs[i].msg_hdr.msg_iovlen = 1;
+			}
+			int res;
+			do {
+				res = recvmmsg(fd, msgs, max, flags | MSG_WAITFORONE, NULL);
+			} while (res == -1 && errno == EINTR);
+			if (res == -1) {
+				int error = errno;
+				throw SocketReadException(strerror(error), error);
+			}
+			for (int i = 0; i < res; ++i) {
+				if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+					throw SocketReadException("Message larger than batch slot", EMSGSIZE);
+				messages.push_back(BufferView((const char *)iov[i].iov_base, msgs[i].msg_len));
+				if (msgs[i].msg_len == 0)
+					break;
+			}
+			return messages.size();
+		}
 		/**
 		 * @brief Call shutdown() on the socket fd, waking any blocked threads.
 		 *
@@ -276,21 +838,416 @@ namespace ffd {
 	protected:
 		int fd_;    ///< File descriptor of socket
 		int io_fd_; ///< Connection fd
+		int type_;  ///< Socket type, see get_type()
 		char ACK;   ///< char to send for acknowledging reception
+		bool framed_; ///< Length-prefix messages, see set_framing()
+		size_t window_;    ///< see set_window()
+		size_t ack_batch_; ///< see set_ack_batch()
+		/**
+		 * @brief State kept per connection fd until close_connection()
+		 *
+		 */
+		struct Connection {
+			std::vector<char> rx; ///< Receive buffer, see receive_view_async()
+			uint64_t sent;        ///< Pipelined messages sent
+			uint64_t acked;       ///< Pipelined messages the peer acknowledged
+			uint64_t received;    ///< Pipelined messages received
+			uint64_t ack_sent;    ///< Pipelined messages received and acknowledged
+			bool eof;             ///< Peer closed the connection, nothing left to ACK
+			/// steady_clock time of the last message received, see touch()
+			std::atomic<std::chrono::steady_clock::rep> last_active;
+			Connection()
+				: rx()
+				, sent(0)
+				, acked(0)
+				, received(0)
+				, ack_sent(0)
+				, eof(false)
+				, last_active(0) {}
+		};
+		std::unordered_map<int, Connection> conns_; ///< State per connection fd
+		std::mutex conns_mutex_;                    ///< Guards conns_
+		std::atomic<bool> track_activity_; ///< Whether receives call touch()
+		/**
+		 * @brief Get the state of a connection, creating it if need be
+		 *
+		 */
+		Connection &conn(int fd) {
+			std::lock_guard<std::mutex> lk(conns_mutex_);
+			return conns_[fd]; // references into unordered_map survive rehashing
+		}
+		/**
+		 * @brief Record that a message arrived on fd, for servers that close idle
+		 * connections. Does nothing unless track_activity_ is set.
+		 *
+		 */
+		void touch(int fd) {
+			if (track_activity_.load(std::memory_order_relaxed))
+				conn(fd).last_active.store(
+					std::chrono::steady_clock::now().time_since_epoch().count(),
+					std::memory_order_relaxed);
+		}
+		/**
+		 * @brief Scratch record list for the receive_data_async() vector overload, reused
+		 * per thread
+		 *
+		 */
+		static std::vector<BufferView> &record_views(void) {
+			static thread_local std::vector<BufferView> records;
+			return records;
+		}
+		/**
+		 * @brief Receive the length header of a framed message
+		 *
+		 * @return false if the peer closed the connection between messages
+		 */
+		bool receive_header(uint64_t &len, int flags, int fd, std::vector<int> *fds = nullptr) {
+			char header[Socket::_frame_header_sz];
+			size_t got = 0;
+			if (fds) {
+				got = recv_fds(fd, header, sizeof(header), flags, *fds);
+				if (got == 0)
+					return false;
+			}
+			got += recv_all(fd, header + got, sizeof(header) - got, flags);
+			if (got == 0) {
+				conn(fd).eof = true;
+				return false;
+			}
+			if (got < sizeof(header))
+				throw SocketReadException("Connection closed mid-message", ECONNRESET);
+			touch(fd);
+			len = Socket::decode_length(header);
+			if (len > Socket::_max_frame_sz)
+				throw SocketReadException("Message length exceeds limit", EMSGSIZE);
+			return true;
+		}
+		/**
+		 * @brief Send buffers with sendmsg(), at most IOV_MAX at a time, retrying partial
+		 * writes. Advances iov as bytes go out.
+		 *
+		 * @param fd Connection fd
+		 * @param iov Buffers to send
+		 * @param count Number of buffers
+		 * @param flags see man send(2)
+		 */
+		void send_iov(int fd, struct iovec *iov, size_t count, int flags) {
+			while (count > 0 && iov->iov_len == 0) {
+				++iov;
+				--count;
+			}
+			while (count > 0) {
+				struct msghdr msg;
+				memset(&msg, 0, sizeof(msg));
+				msg.msg_iov = iov;
+				msg.msg_iovlen = count < IOV_MAX ? count : IOV_MAX;
+				ssize_t res = sendmsg(fd, &msg, flags);
+				if (res == -1) {
+					if (errno == EINTR)
+						continue;
+					int error = errno;
+					throw SocketWriteException(strerror(error), error);
+				}
+				size_t sent = res;
+				while (count > 0 && sent >= iov->iov_len) {
+					sent -= iov->iov_len;
+					++iov;
+					--count;
+				}
+				if (count > 0) {
+					iov->iov_base = (char *)iov->iov_base + sent;
+					iov->iov_len -= sent;
+				}
+			}
+		}
+		/**
+		 * @brief Send records as one message on a SOCK_SEQPACKET or SOCK_DGRAM socket, which
+		 * must go out in a single sendmsg()
+		 *
+		 */
+		void send_packet(const std::vector<std::string> &vec, int flags, int fd) {
+			if (vec.size() * 2 > Socket::_iov_batch) {
+				std::string joined;
+				size_t len = vec.empty() ? 0 : vec.size() - 1;
+				for (const std::string &record : vec)
+					len += record.length();
+				joined.reserve(len);
+				for (size_t i = 0; i < vec.size(); ++i) {
+					if (i)
+						joined += Socket::_rec_delim;
+					joined += vec[i];
+				}
+				send_data_async(joined, flags, fd);
+				return;
+			}
+			struct iovec iov[Socket::_iov_batch];
+			size_t n = 0;
+			for (size_t i = 0; i < vec.size(); ++i) {
+				if (i) {
+					iov[n].iov_base = (void *)&Socket::_rec_delim;
+					iov[n++].iov_len = 1;
+				}
+				iov[n].iov_base = (void *)vec[i].data();
+				iov[n++].iov_len = vec[i].length();
+			}
+			struct msghdr msg;
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_iov = iov;
+			msg.msg_iovlen = n;
+			ssize_t res;
+			do {
+				res = sendmsg(fd, &msg, flags);
+			} while (res == -1 && errno == EINTR);
+			if (res == -1) {
+				int error = errno;
+				throw SocketWriteException(strerror(error), error);
+			}
+		}
+		/**
+		 * @brief Receive exactly len bytes
+		 *
+		 * @param fd Connection fd
+		 * @param data Buffer to fill
+		 * @param len Number of bytes
+		 * @param flags see man recv(2)
+		 * @return size_t Bytes received, less than len only if the peer closed the connection
+		 */
+		size_t recv_all(int fd, char *data, size_t len, int flags) {
+			size_t got = 0;
+			while (got < len) {
+				ssize_t res = recv(fd, data + got, len - got, flags | MSG_WAITALL);
+				if (res == -1) {
+					if (errno == EINTR)
+						continue;
+					int error = errno;
+					throw SocketReadException(strerror(error), error);
+				}
+				if (res == 0)
+					break;
+				got += res;
+			}
+			return got;
+		}
+		/**
+		 * @brief Receive a message into the connection's receive buffer, optionally collecting
+		 * SCM_RIGHTS descriptors that arrive with its first bytes
+		 *
+		 */
+		BufferView receive_message(int flags, int fd, std::vector<int> *fds) {
+			std::vector<char> &buff = conn(fd).rx;
+			size_t len = 0;
+			if (type_ != SOCK_STREAM) {
+				// the kernel keeps message boundaries, so peek at the size and read it whole
+				ssize_t res = recv(fd, NULL, 0, flags | MSG_PEEK | MSG_TRUNC);
+				if (res == -1) {
+					int error = errno;
+					throw SocketReadException(strerror(error), error);
+				}
+				if (buff.size() < (size_t)res)
+					buff.resize(res);
+				if (fds) {
+					len = recv_fds(fd, buff.data(), res, flags, *fds);
+				} else {
+					res = recv(fd, buff.data(), res, flags);
+					if (res == -1) {
+						int error = errno;
+						throw SocketReadException(strerror(error), error);
+					}
+					len = res;
+				}
+				touch(fd);
+				return BufferView(buff.data(), len);
+			}
+			if (framed_) {
+				uint64_t frame_len;
+				if (!receive_header(frame_len, flags, fd, fds))
+					return BufferView();
+				if (buff.size() < frame_len)
+					buff.resize(frame_len);
+				if (frame_len && recv_all(fd, buff.data(), frame_len, flags) < frame_len)
+					throw SocketReadException("Connection closed mid-message", ECONNRESET);
+				return BufferView(buff.data(), frame_len);
+			}
+			if (buff.size() < (size_t)Socket::_buff_sz)
+				buff.resize(Socket::_buff_sz);
+			ssize_t bytes_read;
+			char peek;
+			do {
+				if (len == buff.size())
+					buff.resize(buff.size() * 2);
+				if (fds && len == 0) {
+					bytes_read = recv_fds(fd, buff.data(), buff.size(), flags, *fds);
+				} else {
+					bytes_read = recv(fd, buff.data() + len, buff.size() - len, flags);
+					if (bytes_read == -1) {
+						int error = errno;
+						throw SocketReadException(strerror(error), error);
+					}
+				}
+				len += bytes_read;
+				// the kernel ends a read at the data carrying descriptors, so stop there too or
+				// the next message would be appended here and lose its descriptors
+			} while (bytes_read > 0 && !fds && recv(fd, &peek, 1, MSG_PEEK | MSG_DONTWAIT) > 0);
+			if (len == 0)
+				conn(fd).eof = true;
+			else
+				touch(fd);
+			return BufferView(buff.data(), len);
+		}
+		/**
+		 * @brief recv() that also collects SCM_RIGHTS descriptors
+		 *
+		 * @return size_t Bytes received, 0 if the peer closed the connection
+		 */
+		size_t recv_fds(int fd, char *data, size_t len, int flags, std::vector<int> &fds) {
+			struct iovec iov;
+			iov.iov_base = data;
+			iov.iov_len = len;
+			union {
+				struct cmsghdr align;
+				char buff[CMSG_SPACE(sizeof(int) * Socket::_max_fds)];
+			} control;
+			struct msghdr msg;
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_iov = &iov;
+			msg.msg_iovlen = 1;
+			msg.msg_control = control.buff;
+			msg.msg_controllen = sizeof(control.buff);
+			ssize_t res;
+			do {
+				res = recvmsg(fd, &msg, flags | MSG_CMSG_CLOEXEC);
+			} while (res == -1 && errno == EINTR);
+			if (res == -1) {
+				int error = errno;
+				throw SocketReadException(strerror(error), error);
+			}
+			for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+				 cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+				if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+					continue;
+				size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+				const char *p = (const char *)CMSG_DATA(cmsg);
+				for (size_t i = 0; i < n; ++i) {
+					int received;
+					memcpy(&received, p + i * sizeof(int), sizeof(int));
+					fds.push_back(received);
+				}
+			}
+			if (msg.msg_flags & MSG_CTRUNC) {
+				for (int received : fds)
+					close(received);
+				fds.clear();
+				throw SocketReadException("File descriptors truncated", EMSGSIZE);
+			}
+			return res;
+		}
+		/**
+		 * @brief Receive one length-prefixed message. payload is left empty if the peer
+		 * closed the connection between messages.
+		 *
+		 */
+		void receive_frame(std::string &payload, int flags, int fd) {
+			uint64_t len;
+			if (!receive_header(len, flags, fd))
+				return;
+			payload.resize(len);
+			if (len && recv_all(fd, &payload[0], len, flags) < len)
+				throw SocketReadException("Connection closed mid-message", ECONNRESET);
+		}
 	private:
+		/**
+		 * @brief Throw if the socket doesn't keep message boundaries
+		 *
+		 */
+		void check_packet(void) const {
+			if (type_ == SOCK_STREAM)
+				throw SocketException("Batches need a SOCK_SEQPACKET or SOCK_DGRAM socket", EINVAL);
+		}
+		/**
+		 * @brief Throw if ACKs can't be exchanged, which needs a connection to reply on
+		 *
+		 */
+		void check_acked(void) const {
+			if (type_ == SOCK_DGRAM)
+				throw SocketException("ACKs need a connected socket, use the async methods",
+									  EINVAL);
+		}
+		void check_pipelined(void) const {
+			check_acked();
+			if (!framed_)
+				throw SocketException("Pipelined messages must be framed, see set_framing()",
+									  EINVAL);
+		}
+		/**
+		 * @brief Count a pipelined message as sent, blocking for ACKs while the window is full
+		 *
+		 */
+		void sent_pipelined(int fd) {
+			Connection &c = conn(fd);
+			++c.sent;
+			while (c.sent - c.acked >= window_)
+				read_cumulative_ack(fd, c);
+		}
+		/**
+		 * @brief Count a pipelined message as received, acknowledging everything so far at the
+		 * end of a batch or when the sender has nothing more in flight right now
+		 *
+		 */
+		void received_pipelined(int fd) {
+			Connection &c = conn(fd);
+			++c.received;
+			char peek;
+			if (c.received - c.ack_sent < ack_batch_
+				&& recv(fd, &peek, 1, MSG_PEEK | MSG_DONTWAIT) > 0)
+				return;
+			char ack[1 + Socket::_frame_header_sz];
+			ack[0] = ACK;
+			Socket::encode_length(c.received, ack + 1);
+			send_data_async(std::string(ack, sizeof(ack)), MSG_NOSIGNAL, fd);
+			c.ack_sent = c.received;
+		}
+		/**
+		 * @brief Read one cumulative ACK: the ACK char then the big endian count of messages
+		 * acknowledged so far, sent as a framed message
+		 *
+		 */
+		void read_cumulative_ack(int fd, Connection &c) {
+			BufferView ack = receive_view_async(0, fd);
+			if (ack.size() != 1 + Socket::_frame_header_sz || ack[0] != ACK)
+				throw SocketWriteException("ACK failed");
+			c.acked = Socket::decode_length(ack.data() + 1);
+		}
 		void get_ack(int fd) {
+			check_acked();
 			if (fd == 0)
 				fd = io_fd_;
 			char ack_check;
-			recv(fd, &ack_check, 1, 0);
+			ssize_t res;
+			do {
+				res = recv(fd, &ack_check, 1, 0);
+			} while (res == -1 && errno == EINTR);
+			if (res == -1) {
+				int error = errno;
+				throw SocketWriteException(strerror(error), error);
+			}
+			if (res == 0)
+				throw SocketWriteException("Connection closed before ACK", ECONNRESET);
 			if (ack_check != ACK) {
 				throw SocketWriteException("ACK failed");
 			}
 		}
+		/**
+		 * @brief Acknowledge a received message. Nothing is sent if the receive found the
+		 * connection closed, and a peer gone since can't raise SIGPIPE.
+		 *
+		 */
 		void send_ack(int fd) {
+			check_acked();
 			if (fd == 0)
 				fd = io_fd_;
-			send(fd, &ACK, 1, 0);
+			if (conn(fd).eof)
+				return;
+			send(fd, &ACK, 1, MSG_NOSIGNAL);
 		}
 	};
 } // namespace ffd
@@ -0,0 +1,689 @@
+// -*- C++ -*-
+/*
+ *    Copyright (C) 2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of lib45d.
+ *
+ *    lib45d is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    lib45d is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with lib45d.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Coroutine layer, only built by compilers with C++20 coroutines. Including this header from
+// older standards is harmless and defines nothing.
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+
+#	include <45d/socket/Exceptions.hpp>
+#	include <45d/socket/SocketBase.hpp>
+#	include <algorithm>
+#	include <atomic>
+#	include <coroutine>
+#	include <exception>
+#	include <mutex>
+#	include <optional>
+#	include <string>
+#	include <utility>
+#	include <vector>
+
+#	include <fcntl.h>
+#	include <sys/epoll.h>
+#	include <sys/eventfd.h>
+#	include <sys/timerfd.h>
+
+namespace ffd {
+	/**
+	 * @brief Default parameters for SocketLoop
+	 *
+	 */
+	namespace Loop {
+		const int _max_events_default = 256;     ///< epoll events handled per wakeup
+		const int _connect_retries = 64;         ///< connect() retries while a backlog is full
+		const int _connect_backoff_max_ms = 100; ///< Longest wait between those retries
+	} // namespace Loop
+
+	template<typename T = void>
+	class Task;
+
+	/**
+	 * @brief Coroutine plumbing behind Task
+	 *
+	 */
+	namespace Co {
+		/**
+		 * @brief Promise parts that don't depend on the result type. Tasks start suspended
+		 * and resume whoever awaited them when they finish.
+		 *
+		 */
+		struct PromiseBase {
+			std::coroutine_handle<> continuation;
+			std::exception_ptr error;
+			struct FinalAwaiter {
+				bool await_ready() noexcept {
+					return false;
+				}
+				template<typename P>
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+					std::coroutine_handle<> next = h.promise().continuation;
+					return next ? next : std::noop_coroutine();
+				}
+				void await_resume() noexcept {}
+			};
+			std::suspend_always initial_suspend() noexcept {
+				return {};
+			}
+			FinalAwaiter final_suspend() noexcept {
+				return {};
+			}
+			void unhandled_exception() noexcept {
+				error = std::current_exception();
+			}
+		};
+		template<typename T>
+		struct Promise : PromiseBase {
+			std::optional<T> value;
+			template<typename U>
+			void return_value(U &&val) {
+				value.emplace(std::forward<U>(val));
+			}
+			T result(void) {
+				if (error)
+					std::rethrow_exception(error);
+				return std::move(*value);
+			}
+		};
+		template<>
+		struct Promise<void> : PromiseBase {
+			void return_void() noexcept {}
+			void result(void) {
+				if (error)
+					std::rethrow_exception(error);
+			}
+		};
+		/**
+		 * @brief Fire and forget coroutine, see SocketLoop::spawn()
+		 *
+		 */
+		struct Detached {
+			struct promise_type {
+				Detached get_return_object() noexcept {
+					return {};
+				}
+				std::suspend_never initial_suspend() noexcept {
+					return {};
+				}
+				std::suspend_never final_suspend() noexcept {
+					return {};
+				}
+				void return_void() noexcept {}
+				void unhandled_exception() noexcept {
+					std::terminate();
+				}
+			};
+		};
+	} // namespace Co
+
+	/**
+	 * @brief Lazily started coroutine returning T. Runs when co_awaited, and the awaiting
+	 * coroutine continues with its result or exception.
+	 *
+	 */
+	template<typename T>
+	class Task {
+	public:
+		struct promise_type : Co::Promise<T> {
+			Task get_return_object() {
+				return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+			}
+		};
+		Task(Task &&other) noexcept : coro_(std::exchange(other.coro_, {})) {}
+		Task(const Task &) = delete;
+		Task &operator=(const Task &) = delete;
+		~Task() {
+			if (coro_)
+				coro_.destroy();
+		}
+		bool await_ready() const noexcept {
+			return false;
+		}
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+			coro_.promise().continuation = caller;
+			return coro_;
+		}
+		T await_resume() {
+			return coro_.promise().result();
+		}
+	private:
+		std::coroutine_handle<promise_type> coro_;
+		explicit Task(std::coroutine_handle<promise_type> coro) : coro_(coro) {}
+	};
+
+	/**
+	 * @brief Epoll loop running coroutine sessions over the socket classes. Each session
+	 * reads like blocking code, but connect, wait_for_connection, send_data and receive_data
+	 * are co_awaited and suspend the session until its socket is ready instead of blocking a
+	 * thread, so thousands of sessions share however many threads call run().
+	 *
+	 * The awaitables speak the same protocol as the blocking methods, framing and ACKs
+	 * included, so either end can be written either way. Sockets stay in blocking mode
+	 * between calls. Only one operation may be outstanding per fd at a time.
+	 *
+	 * Example:
+	 * @include tests/sockets/unix_coroutine/server.cpp
+	 */
+	class SocketLoop {
+		/**
+		 * @brief Suspends a coroutine until an fd is ready
+		 *
+		 */
+		struct Readiness {
+			SocketLoop &loop;
+			int fd;
+			uint32_t events;
+			std::coroutine_handle<> handle;
+			bool await_ready() const noexcept {
+				return false;
+			}
+			void await_suspend(std::coroutine_handle<> h) {
+				handle = h;
+				loop.arm(fd, events, this); // may resume on another thread right away
+			}
+			void await_resume() const noexcept {}
+		};
+	public:
+		/**
+		 * @brief Construct a new Socket Loop object
+		 *
+		 * @param max_events Number of epoll events to handle per wakeup
+		 */
+		SocketLoop(int max_events = Loop::_max_events_default)
+			: epfd_(-1)
+			, wake_fd_(-1)
+			, max_events_(max_events > 0 ? max_events : 1)
+			, sessions_(0)
+			, stop_(false)
+			, error_mutex_()
+			, error_() {
+			epfd_ = epoll_create1(EPOLL_CLOEXEC);
+			if (epfd_ == -1) {
+				int error = errno;
+				throw SocketReactorException(strerror(error), error);
+			}
+			wake_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+			if (wake_fd_ == -1) {
+				int error = errno;
+				close(epfd_);
+				throw SocketReactorException(strerror(error), error);
+			}
+			struct epoll_event ev;
+			ev.events = EPOLLIN;
+			ev.data.ptr = nullptr;
+			if (epoll_ctl(epfd_, EPOLL_CTL_ADD, wake_fd_, &ev) == -1) {
+				int error = errno;
+				close(wake_fd_);
+				close(epfd_);
+				throw SocketReactorException(strerror(error), error);
+			}
+		}
+		SocketLoop(const SocketLoop &) = delete;
+		SocketLoop &operator=(const SocketLoop &) = delete;
+		/**
+		 * @brief Destroy the Socket Loop object. Sessions still suspended are abandoned.
+		 *
+		 */
+		~SocketLoop() {
+			close(wake_fd_);
+			close(epfd_);
+		}
+		/**
+		 * @brief Start a session. It runs on the calling thread until it first suspends,
+		 * then on whichever thread in run() sees its socket become ready. An exception
+		 * escaping a session stops the loop and is rethrown from run().
+		 *
+		 * @param session Coroutine to run
+		 */
+		void spawn(Task<void> session) {
+			sessions_.fetch_add(1);
+			detach(std::move(session));
+		}
+		/**
+		 * @brief Resume sessions as their sockets become ready, until every session has
+		 * finished or stop() is called. Call from as many threads as should share the work.
+		 *
+		 */
+		void run(void) {
+			std::vector<struct epoll_event> events(max_events_);
+			drain_wakeups();
+			while (!stop_.load() && sessions_.load() > 0) {
+				int n = epoll_wait(epfd_, events.data(), max_events_, -1);
+				if (n == -1) {
+					if (errno == EINTR)
+						continue;
+					int error = errno;
+					throw SocketReactorException(strerror(error), error);
+				}
+				for (int i = 0; i < n; ++i) {
+					if (events[i].data.ptr == nullptr)
+						continue; // stop() or last session done, checked above
+					static_cast<Readiness *>(events[i].data.ptr)->handle.resume();
+				}
+			}
+			std::lock_guard<std::mutex> lk(error_mutex_);
+			if (error_)
+				std::rethrow_exception(error_);
+		}
+		/**
+		 * @brief Make every run() return. Suspended sessions stay suspended.
+		 *
+		 */
+		void stop(void) {
+			stop_.store(true);
+			wake();
+		}
+		/**
+		 * @brief Get the number of sessions that haven't finished
+		 *
+		 * @return size_t
+		 */
+		size_t sessions(void) const {
+			return sessions_.load();
+		}
+		/**
+		 * @brief Suspend until fd is readable
+		 *
+		 */
+		Readiness readable(int fd) {
+			return Readiness{ *this, fd, EPOLLIN | EPOLLRDHUP, {} };
+		}
+		/**
+		 * @brief Suspend until fd is writable
+		 *
+		 */
+		Readiness writable(int fd) {
+			return Readiness{ *this, fd, EPOLLOUT, {} };
+		}
+		/**
+		 * @brief Suspend for ms milliseconds without blocking the thread
+		 *
+		 * @param ms Milliseconds to wait
+		 * @return Task<void>
+		 */
+		Task<void> sleep_for(int ms) {
+			int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+			if (tfd == -1) {
+				int error = errno;
+				throw SocketReactorException(strerror(error), error);
+			}
+			struct itimerspec spec = {};
+			spec.it_value.tv_sec = ms / 1000;
+			spec.it_value.tv_nsec = ms > 0 ? (ms % 1000) * 1000000L : 1; // 0 would disarm
+			try {
+				if (timerfd_settime(tfd, 0, &spec, nullptr) == -1) {
+					int error = errno;
+					throw SocketReactorException(strerror(error), error);
+				}
+				co_await readable(tfd);
+			} catch (...) {
+				close(tfd);
+				throw;
+			}
+			close(tfd); // also removes it from epoll
+		}
+		/**
+		 * @brief Awaitable UnixSocketClient::connect() or TcpSocketClient::connect()
+		 *
+		 * A Unix socket whose server backlog is full fails with EAGAIN and never becomes
+		 * writable when a slot frees up, so the connect is retried on a timer instead, waiting
+		 * 1 ms and doubling up to Loop::_connect_backoff_max_ms. After Loop::_connect_retries
+		 * retries (about 6 s) SocketConnectException is thrown with EAGAIN.
+		 *
+		 * @param client Client to connect
+		 * @return Task<int> fd for socket
+		 */
+		template<typename Client>
+		Task<int> connect(Client &client) {
+			int fd = client.get_fd();
+			int backoff_ms = 1;
+			for (int retries = 0;; ++retries) {
+				int error;
+				{
+					NonBlocking nb(fd);
+					try {
+						co_return client.connect();
+					} catch (const SocketConnectException &e) {
+						error = e.get_errno();
+					}
+				}
+				if (error == EINPROGRESS) {
+					// TCP, connecting in the background
+					co_await writable(fd);
+					socklen_t len = sizeof(error);
+					if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1)
+						error = errno;
+					if (error)
+						throw SocketConnectException(strerror(error), error);
+					co_return fd;
+				}
+				if (error != EAGAIN || retries == Loop::_connect_retries)
+					throw SocketConnectException(strerror(error), error);
+				// Unix, the server's backlog is full. Back off and try again.
+				co_await sleep_for(backoff_ms);
+				backoff_ms = std::min(backoff_ms * 2, Loop::_connect_backoff_max_ms);
+			}
+		}
+		/**
+		 * @brief Awaitable UnixSocketServer::wait_for_connection() or
+		 * TcpSocketServer::wait_for_connection()
+		 *
+		 * @param server Server to accept from
+		 * @return Task<int> fd of connection
+		 */
+		template<typename Server>
+		Task<int> wait_for_connection(Server &server) {
+			int fd = server.get_fd();
+			for (;;) {
+				{
+					NonBlocking nb(fd);
+					try {
+						co_return server.wait_for_connection();
+					} catch (const SocketAcceptException &e) {
+						if (e.get_errno() != EAGAIN && e.get_errno() != EWOULDBLOCK)
+							throw;
+					}
+				}
+				co_await readable(fd);
+			}
+		}
+		/**
+		 * @brief Awaitable SocketBase::send_data_async(const std::string&, int, int)
+		 *
+		 * @param socket Socket to send on
+		 * @param str Message to send
+		 * @param flags see man send(2)
+		 * @param fd Optional file descriptor for connection
+		 */
+		Task<void> send_data_async(SocketBase &socket, std::string str, int flags = 0, int fd = 0) {
+			if (fd == 0)
+				fd = socket.get_io_fd();
+			char header[Socket::_frame_header_sz];
+			struct iovec iov[2];
+			size_t n = 0;
+			if (socket.framing()) {
+				Socket::encode_length(str.length(), header);
+				iov[n].iov_base = header;
+				iov[n++].iov_len = sizeof(header);
+			}
+			iov[n].iov_base = str.data();
+			iov[n++].iov_len = str.length();
+			co_await send_iov(fd, iov, n, flags);
+		}
+		/**
+		 * @brief Awaitable SocketBase::send_data(const std::string&, int, int), waiting for
+		 * the peer's ACK
+		 *
+		 * @param socket Socket to send on
+		 * @param str Message to send
+		 * @param flags see man send(2)
+		 * @param fd Optional file descriptor for connection
+		 */
+		Task<void> send_data(SocketBase &socket, std::string str, int flags = 0, int fd = 0) {
+			if (fd == 0)
+				fd = socket.get_io_fd();
+			co_await send_data_async(socket, std::move(str), flags, fd);
+			char ack = 0;
+			if (co_await recv_exact(fd, &ack, 1, 0) != 1 || ack != Socket::_ack)
+				throw SocketWriteException("ACK failed");
+		}
+		/**
+		 * @brief Awaitable SocketBase::receive_data_async(std::string&, int, int)
+		 *
+		 * @param socket Socket to receive on
+		 * @param flags see man recv(2)
+		 * @param fd Optional file descriptor for connection
+		 * @return Task<std::string> Received message, empty if the peer closed the connection
+		 */
+		Task<std::string> receive_data_async(SocketBase &socket, int flags = 0, int fd = 0) {
+			if (fd == 0)
+				fd = socket.get_io_fd();
+			std::string payload;
+			co_await receive_into(socket, payload, flags, fd);
+			co_return payload;
+		}
+		/**
+		 * @brief Awaitable SocketBase::receive_data(std::string&, int, int), sending the
+		 * peer an ACK
+		 *
+		 * @param socket Socket to receive on
+		 * @param flags see man recv(2)
+		 * @param fd Optional file descriptor for connection
+		 * @return Task<std::string> Received message, empty if the peer closed the connection
+		 */
+		Task<std::string> receive_data(SocketBase &socket, int flags = 0, int fd = 0) {
+			if (fd == 0)
+				fd = socket.get_io_fd();
+			std::string payload;
+			if (co_await receive_into(socket, payload, flags, fd)) {
+				char ack = Socket::_ack;
+				struct iovec iov;
+				iov.iov_base = &ack;
+				iov.iov_len = 1;
+				co_await send_iov(fd, &iov, 1, MSG_NOSIGNAL);
+			}
+			co_return payload;
+		}
+	private:
+		int epfd_;
+		int wake_fd_; ///< eventfd making every run() recheck whether to return
+		int max_events_;
+		std::atomic<size_t> sessions_; ///< Spawned sessions not finished yet
+		std::atomic<bool> stop_;
+		std::mutex error_mutex_;
+		std::exception_ptr error_; ///< First exception to escape a session
+		/**
+		 * @brief Puts an fd in non-blocking mode for its lifetime
+		 *
+		 */
+		struct NonBlocking {
+			int fd;
+			int flags;
+			NonBlocking(int fd) : fd(fd), flags(fcntl(fd, F_GETFL)) {
+				if (flags != -1)
+					fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+			}
+			~NonBlocking() {
+				if (flags != -1)
+					fcntl(fd, F_SETFL, flags);
+			}
+		};
+		Co::Detached detach(Task<void> session) {
+			try {
+				co_await session;
+			} catch (...) {
+				{
+					std::lock_guard<std::mutex> lk(error_mutex_);
+					if (!error_)
+						error_ = std::current_exception();
+				}
+				stop_.store(true);
+			}
+			if (sessions_.fetch_sub(1) == 1 || stop_.load())
+				wake();
+		}
+		void arm(int fd, uint32_t events, Readiness *waiter) {
+			struct epoll_event ev;
+			ev.events = events | EPOLLONESHOT;
+			ev.data.ptr = waiter;
+			if (epoll_ctl(epfd_, EPOLL_CTL_MOD, fd, &ev) == 0)
+				return;
+			if (errno == ENOENT && epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) == 0)
+				return;
+			int error = errno;
+			throw SocketReactorException(strerror(error), error);
+		}
+		void wake(void) {
+			uint64_t one = 1;
+			if (write(wake_fd_, &one, sizeof(one)) == -1) {
+				// counter full, already readable
+			}
+		}
+		void drain_wakeups(void) {
+			if (stop_.load() || sessions_.load() == 0)
+				return;
+			uint64_t count;
+			if (read(wake_fd_, &count, sizeof(count)) == -1) {
+				// nothing pending
+			}
+		}
+		/**
+		 * @brief Send everything in iov, suspending whenever the socket buffer is full.
+		 * Always makes at least one sendmsg() so empty packets still go out.
+		 *
+		 */
+		Task<void> send_iov(int fd, struct iovec *iov, size_t count, int flags) {
+			for (bool first = true;; first = false) {
+				while (count > 0 && iov->iov_len == 0) {
+					++iov;
+					--count;
+				}
+				if (count == 0 && !first)
+					co_return;
+				struct msghdr msg;
+				memset(&msg, 0, sizeof(msg));
+				msg.msg_iov = iov;
+				msg.msg_iovlen = count < IOV_MAX ? count : IOV_MAX;
+				ssize_t res = sendmsg(fd, &msg, flags | MSG_DONTWAIT);
+				if (res == -1) {
+					if (errno == EAGAIN || errno == EWOULDBLOCK) {
+						co_await writable(fd);
+						continue;
+					}
+					if (errno == EINTR)
+						continue;
+					int error = errno;
+					throw SocketWriteException(strerror(error), error);
+				}
+				size_t sent = res;
+				while (count > 0 && sent >= iov->iov_len) {
+					sent -= iov->iov_len;
+					++iov;
+					--count;
+				}
+				if (count > 0) {
+					iov->iov_base = (char *)iov->iov_base + sent;
+					iov->iov_len -= sent;
+				} else {
+					co_return;
+				}
+			}
+		}
+		/**
+		 * @brief Receive what's available, up to len bytes, suspending until there is some
+		 *
+		 * @return Task<size_t> Bytes received, 0 if the peer closed the connection
+		 */
+		Task<size_t> recv_some(int fd, char *data, size_t len, int flags) {
+			for (;;) {
+				ssize_t res = recv(fd, data, len, flags | MSG_DONTWAIT);
+				if (res >= 0)
+					co_return (size_t)res;
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+					co_await readable(fd);
+				else if (errno != EINTR) {
+					int error = errno;
+					throw SocketReadException(strerror(error), error);
+				}
+			}
+		}
+		/**
+		 * @brief Receive exactly len bytes
+		 *
+		 * @return Task<size_t> Bytes received, short only if the peer closed the connection
+		 */
+		Task<size_t> recv_exact(int fd, char *data, size_t len, int flags) {
+			size_t got = 0;
+			while (got < len) {
+				size_t res = co_await recv_some(fd, data + got, len - got, flags);
+				if (res == 0)
+					break;
+				got += res;
+			}
+			co_return got;
+		}
+		/**
+		 * @brief Receive a message the way SocketBase does for the socket's type and framing
+		 *
+		 * @return Task<bool> false if the peer closed the connection
+		 */
+		Task<bool> receive_into(SocketBase &socket, std::string &payload, int flags, int fd) {
+			if (socket.get_type() != SOCK_STREAM) {
+				for (;;) {
+					ssize_t len = recv(fd, NULL, 0, flags | MSG_PEEK | MSG_TRUNC | MSG_DONTWAIT);
+					if (len >= 0) {
+						payload.resize(len);
+						len = recv(fd, payload.data(), len, flags | MSG_DONTWAIT);
+						if (len == -1) {
+							int error = errno;
+							throw SocketReadException(strerror(error), error);
+						}
+						payload.resize(len);
+						co_return len > 0 || socket.get_type() == SOCK_DGRAM;
+					}
+					if (errno == EAGAIN || errno == EWOULDBLOCK)
+						co_await readable(fd);
+					else if (errno != EINTR) {
+						int error = errno;
+						throw SocketReadException(strerror(error), error);
+					}
+				}
+			}
+			if (socket.framing()) {
+				char header[Socket::_frame_header_sz];
+				size_t got = co_await recv_exact(fd, header, sizeof(header), flags);
+				if (got == 0)
+					co_return false;
+				if (got < sizeof(header))
+					throw SocketReadException("Connection closed mid-message", ECONNRESET);
+				uint64_t len = Socket::decode_length(header);
+				if (len > Socket::_max_frame_sz)
+					throw SocketReadException("Message length exceeds limit", EMSGSIZE);
+				payload.resize(len);
+				if (len && co_await recv_exact(fd, payload.data(), len, flags) < len)
+					throw SocketReadException("Connection closed mid-message", ECONNRESET);
+				co_return true;
+			}
+			// unframed, whatever has arrived once there is something
+			payload.resize(Socket::_buff_sz);
+			size_t len = co_await recv_some(fd, payload.data(), payload.size(), flags);
+			if (len == 0) {
+				payload.clear();
+				co_return false;
+			}
+			for (;;) {
+				if (len == payload.size())
+					payload.resize(payload.size() * 2);
+				ssize_t res = recv(fd, &payload[len], payload.size() - len, flags | MSG_DONTWAIT);
+				if (res == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+					int error = errno;
+					throw SocketReadException(strerror(error), error);
+				}
+				if (res <= 0)
+					break;
+				len += res;
+			}
+			payload.resize(len);
+			co_return true;
+		}
+	};
+} // namespace ffd
+
+#endif
@@ -0,0 +1,501 @@
+// -*- C++ -*-
+/*
+ *    Copyright (C) 2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of lib45d.
+ *
+ *    lib45d is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    lib45d is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with lib45d.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <45d/socket/SocketBase.hpp>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+extern "C" {
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+}
+
+namespace ffd {
+	/**
+	 * @brief Default parameters for SocketReactor
+	 *
+	 */
+	namespace Reactor {
+		const int _max_events_default = 256; ///< epoll events handled per wakeup
+		const size_t _read_sz = 64 * 1024;   ///< Bytes per recv()
+		const int _reads_per_event = 16; ///< recv()s per readiness event, so no peer hogs the loop
+	} // namespace Reactor
+
+	/**
+	 * @brief Epoll event loop serving every connection of a listening socket from one thread.
+	 *
+	 * The listening socket and all accepted connections are non-blocking. New connections are
+	 * accepted as they arrive, received bytes are appended to the connection's input buffer
+	 * and handed to the on_data handler, and output that the socket can't take right away is
+	 * buffered and flushed when the socket becomes writable. Handlers run on the thread
+	 * calling run() and must not block.
+	 *
+	 * The listener is only borrowed, e.g. a UnixSocketServer; it is switched to non-blocking
+	 * mode, so its wait_for_connection() should not be used alongside the reactor.
+	 *
+	 * Example:
+	 * @include tests/sockets/unix_reactor/server.cpp
+	 */
+	class SocketReactor {
+	public:
+		/**
+		 * @brief One accepted connection. Owned by the reactor, only valid inside handlers
+		 * and posted functions.
+		 *
+		 */
+		class Connection {
+		public:
+			Connection(const Connection &) = delete;
+			Connection &operator=(const Connection &) = delete;
+			/**
+			 * @brief Get the connection fd
+			 *
+			 * @return int
+			 */
+			int fd(void) const {
+				return fd_;
+			}
+			/**
+			 * @brief Get the connection id. Unlike fds, ids are never reused, so they are safe
+			 * to hold on to for SocketReactor::find().
+			 *
+			 * @return uint64_t
+			 */
+			uint64_t id(void) const {
+				return id_;
+			}
+			/**
+			 * @brief Bytes received and not consumed yet. Handlers erase what they used and
+			 * leave partial messages for the next on_data call.
+			 *
+			 * @return std::string&
+			 */
+			std::string &input(void) {
+				return in_;
+			}
+			/**
+			 * @brief Send data, buffering whatever the socket can't take right now
+			 *
+			 * @param data Bytes to send
+			 */
+			void send(const std::string &data) {
+				if (dead_ || data.empty())
+					return;
+				if (out_.size() == out_off_) {
+					out_.clear();
+					out_off_ = 0;
+					size_t sent = 0;
+					if (!write_some(data.data(), data.size(), sent))
+						return;
+					if (sent == data.size())
+						return;
+					out_.append(data, sent, std::string::npos);
+				} else {
+					out_ += data;
+				}
+				reactor_->touch(*this);
+			}
+			/**
+			 * @brief Close the connection once buffered output is flushed
+			 *
+			 */
+			void close(void) {
+				closing_ = true;
+				reactor_->touch(*this);
+			}
+			/**
+			 * @brief Get the number of bytes waiting to be sent
+			 *
+			 * @return size_t
+			 */
+			size_t pending_output(void) const {
+				return out_.size() - out_off_;
+			}
+		private:
+			friend class SocketReactor;
+			SocketReactor *reactor_; ///< Owner
+			int fd_;                 ///< Connection fd
+			uint64_t id_;            ///< Unique id, epoll user data
+			std::string in_;         ///< Received bytes not yet consumed
+			std::string out_;        ///< Bytes waiting to be sent from out_off_
+			size_t out_off_;         ///< Bytes of out_ already sent
+			bool closing_;           ///< Close once out_ is flushed
+			bool dead_;              ///< Peer gone or socket error, close now
+			uint32_t events_;        ///< Events currently registered with epoll
+			bool touched_;           ///< Already queued for SocketReactor::settle()
+			Connection(SocketReactor *reactor, int fd, uint64_t id)
+				: reactor_(reactor)
+				, fd_(fd)
+				, id_(id)
+				, in_()
+				, out_()
+				, out_off_(0)
+				, closing_(false)
+				, dead_(false)
+				, events_(0)
+				, touched_(false) {}
+			/**
+			 * @brief Write as much as the socket takes without blocking
+			 *
+			 * @return false if the connection died
+			 */
+			bool write_some(const char *data, size_t len, size_t &sent) {
+				sent = 0;
+				while (sent < len) {
+					ssize_t res = ::send(fd_, data + sent, len - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+					if (res == -1) {
+						if (errno == EINTR)
+							continue;
+						if (errno == EAGAIN || errno == EWOULDBLOCK)
+							break;
+						dead_ = true;
+						reactor_->touch(*this);
+						return false;
+					}
+					sent += res;
+				}
+				return true;
+			}
+			/**
+			 * @brief Write buffered output when the socket becomes writable
+			 *
+			 */
+			void flush(void) {
+				size_t sent;
+				if (write_some(out_.data() + out_off_, out_.size() - out_off_, sent))
+					out_off_ += sent;
+				if (out_off_ == out_.size()) {
+					out_.clear();
+					out_off_ = 0;
+				}
+				reactor_->touch(*this);
+			}
+		};
+		/**
+		 * @brief Handlers called from the event loop. Any may be left empty.
+		 *
+		 */
+		struct Handlers {
+			std::function<void(Connection &)> on_connect; ///< After accept()
+			std::function<void(Connection &)> on_data;    ///< After bytes were added to input()
+			std::function<void(Connection &)> on_close;   ///< Before the fd is closed
+		};
+		/**
+		 * @brief Construct a new Socket Reactor object
+		 *
+		 * @param listener Listening socket to accept connections from, must outlive the
+		 * reactor
+		 * @param handlers Connection event handlers
+		 * @param max_events Number of epoll events to handle per wakeup
+		 */
+		SocketReactor(SocketBase &listener,
+					  const Handlers &handlers,
+					  int max_events = Reactor::_max_events_default)
+			: listen_fd_(listener.get_fd())
+			, handlers_(handlers)
+			, epoll_fd_(-1)
+			, event_fd_(-1)
+			, events_(max_events > 0 ? max_events : 1)
+			, read_buff_(Reactor::_read_sz)
+			, connections_()
+			, next_id_(_first_id)
+			, touched_()
+			, accept_paused_(false)
+			, stopping_(false)
+			, posted_mutex_()
+			, posted_() {
+			int flags = fcntl(listen_fd_, F_GETFL);
+			if (flags == -1 || fcntl(listen_fd_, F_SETFL, flags | O_NONBLOCK) == -1) {
+				int error = errno;
+				throw SocketReactorException(strerror(error), error);
+			}
+			epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+			if (epoll_fd_ == -1) {
+				int error = errno;
+				throw SocketReactorException(strerror(error), error);
+			}
+			event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			if (event_fd_ == -1) {
+				int error = errno;
+				close(epoll_fd_);
+				throw SocketReactorException(strerror(error), error);
+			}
+			try {
+				ctl(EPOLL_CTL_ADD, listen_fd_, EPOLLIN, _listen_id);
+				ctl(EPOLL_CTL_ADD, event_fd_, EPOLLIN, _wake_id);
+			} catch (...) {
+				close(event_fd_);
+				close(epoll_fd_);
+				throw;
+			}
+		}
+		SocketReactor(const SocketReactor &) = delete;
+		SocketReactor &operator=(const SocketReactor &) = delete;
+		/**
+		 * @brief Destroy the Socket Reactor object, closing every connection without calling
+		 * on_close
+		 *
+		 */
+		~SocketReactor() {
+			for (auto &connection : connections_)
+				close(connection.second->fd_);
+			close(event_fd_);
+			close(epoll_fd_);
+		}
+		/**
+		 * @brief Run the event loop on this thread until stop() is called
+		 *
+		 */
+		void run(void) {
+			while (!stopping_) {
+				int n = epoll_wait(epoll_fd_, events_.data(), events_.size(), -1);
+				if (n == -1) {
+					if (errno == EINTR)
+						continue;
+					int error = errno;
+					throw SocketReactorException(strerror(error), error);
+				}
+				for (int i = 0; i < n; ++i) {
+					uint64_t id = events_[i].data.u64;
+					if (id == _listen_id)
+						accept_all();
+					else if (id == _wake_id)
+						run_posted();
+					else
+						handle(id, events_[i].events);
+					settle();
+				}
+			}
+			stopping_ = false;
+		}
+		/**
+		 * @brief Make run() return after the current batch of events. Safe to call from any
+		 * thread.
+		 *
+		 */
+		void stop(void) {
+			stopping_ = true;
+			wake();
+		}
+		/**
+		 * @brief Run a function on the event loop thread, e.g. to send a reply computed on
+		 * another thread. Safe to call from any thread.
+		 *
+		 * @param fn Function to run
+		 */
+		void post(std::function<void()> fn) {
+			{
+				std::lock_guard<std::mutex> lk(posted_mutex_);
+				posted_.push_back(fn);
+			}
+			wake();
+		}
+		/**
+		 * @brief Look up a connection by id. Only call from the event loop thread.
+		 *
+		 * @param id Connection::id()
+		 * @return Connection* nullptr if it was closed
+		 */
+		Connection *find(uint64_t id) {
+			std::unordered_map<uint64_t, std::unique_ptr<Connection>>::iterator itr =
+				connections_.find(id);
+			return itr == connections_.end() ? nullptr : itr->second.get();
+		}
+		/**
+		 * @brief Get the number of open connections. Only call from the event loop thread.
+		 *
+		 * @return size_t
+		 */
+		size_t connections(void) const {
+			return connections_.size();
+		}
+	private:
+		static const uint64_t _listen_id = 0; ///< epoll user data of the listening socket
+		static const uint64_t _wake_id = 1;   ///< epoll user data of the eventfd
+		static const uint64_t _first_id = 2;  ///< First connection id
+		int listen_fd_;                       ///< Borrowed listening socket
+		Handlers handlers_;
+		int epoll_fd_;
+		int event_fd_; ///< Wakes the loop for stop() and post()
+		std::vector<struct epoll_event> events_;
+		std::vector<char> read_buff_; ///< Shared by all connections, only used on the loop thread
+		std::unordered_map<uint64_t, std::unique_ptr<Connection>> connections_;
+		uint64_t next_id_;
+		std::vector<uint64_t> touched_; ///< Connections to re-register or close in settle()
+		bool accept_paused_;            ///< Out of fds, listener removed from epoll
+		std::atomic<bool> stopping_;
+		std::mutex posted_mutex_; ///< Guards posted_
+		std::deque<std::function<void()>> posted_;
+		void ctl(int op, int fd, uint32_t events, uint64_t id) {
+			struct epoll_event ev;
+			memset(&ev, 0, sizeof(ev));
+			ev.events = events;
+			ev.data.u64 = id;
+			if (epoll_ctl(epoll_fd_, op, fd, &ev) == -1) {
+				int error = errno;
+				throw SocketReactorException(strerror(error), error);
+			}
+		}
+		void wake(void) {
+			uint64_t one = 1;
+			ssize_t res = write(event_fd_, &one, sizeof(one));
+			(void)res; // only fails if the counter is saturated, which wakes the loop anyway
+		}
+		void touch(Connection &connection) {
+			if (!connection.touched_) {
+				connection.touched_ = true;
+				touched_.push_back(connection.id_);
+			}
+		}
+		void accept_all(void) {
+			for (;;) {
+				int fd = accept4(listen_fd_, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+				if (fd == -1) {
+					if (errno == EINTR || errno == ECONNABORTED)
+						continue;
+					if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS
+						|| errno == ENOMEM) {
+						// listener stays readable, so stop polling it until a connection closes
+						ctl(EPOLL_CTL_DEL, listen_fd_, 0, _listen_id);
+						accept_paused_ = true;
+					}
+					return;
+				}
+				uint64_t id = next_id_++;
+				Connection *connection = new Connection(this, fd, id);
+				connections_[id].reset(connection);
+				connection->events_ = EPOLLIN | EPOLLRDHUP;
+				ctl(EPOLL_CTL_ADD, fd, connection->events_, id);
+				if (handlers_.on_connect)
+					handlers_.on_connect(*connection);
+				settle();
+			}
+		}
+		void run_posted(void) {
+			uint64_t count;
+			ssize_t res = read(event_fd_, &count, sizeof(count));
+			(void)res;
+			std::deque<std::function<void()>> posted;
+			{
+				std::lock_guard<std::mutex> lk(posted_mutex_);
+				posted.swap(posted_);
+			}
+			for (std::function<void()> &fn : posted) {
+				fn();
+				settle();
+			}
+		}
+		/**
+		 * @brief Act on one epoll event. Only EPOLLERR closes a connection outright; on
+		 * EPOLLHUP the peer may have sent its last bytes just before closing, so they are
+		 * drained and handed to on_data first. Once the peer hung up completely, buffered
+		 * output is flushed right away so the failed write closes the connection instead of
+		 * epoll reporting the hangup forever.
+		 *
+		 */
+		void handle(uint64_t id, uint32_t events) {
+			Connection *connection = find(id);
+			if (connection == nullptr)
+				return; // closed earlier in this batch
+			if (events & EPOLLERR) {
+				connection->dead_ = true;
+				touch(*connection);
+				return;
+			}
+			if (events & EPOLLOUT)
+				connection->flush();
+			if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))
+				receive(*connection);
+			if ((events & EPOLLHUP) && connection->closing_ && !connection->dead_
+				&& connection->pending_output())
+				connection->flush();
+		}
+		void receive(Connection &connection) {
+			bool got_data = false;
+			for (int i = 0; i < Reactor::_reads_per_event; ++i) {
+				ssize_t res = recv(connection.fd_, read_buff_.data(), read_buff_.size(), 0);
+				if (res > 0) {
+					connection.in_.append(read_buff_.data(), res);
+					got_data = true;
+					continue;
+				}
+				if (res == 0) {
+					// peer is done sending, finish replying then close
+					connection.closing_ = true;
+				} else if (errno == EINTR) {
+					continue;
+				} else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+					connection.dead_ = true;
+				}
+				break;
+			}
+			touch(connection);
+			if (got_data && !connection.dead_ && handlers_.on_data)
+				handlers_.on_data(connection);
+		}
+		/**
+		 * @brief Apply state changes made by handlers: close finished connections and watch
+		 * for writability only while output is buffered
+		 *
+		 */
+		void settle(void) {
+			for (size_t i = 0; i < touched_.size(); ++i) {
+				Connection *connection = find(touched_[i]);
+				if (connection == nullptr)
+					continue;
+				connection->touched_ = false;
+				if (connection->dead_
+					|| (connection->closing_ && connection->pending_output() == 0)) {
+					destroy(connection);
+					continue;
+				}
+				uint32_t events = connection->closing_ ? 0 : EPOLLIN | EPOLLRDHUP;
+				if (connection->pending_output())
+					events |= EPOLLOUT;
+				if (events != connection->events_) {
+					ctl(EPOLL_CTL_MOD, connection->fd_, events, connection->id_);
+					connection->events_ = events;
+				}
+			}
+			touched_.clear();
+		}
+		void destroy(Connection *connection) {
+			if (handlers_.on_close)
+				handlers_.on_close(*connection);
+			close(connection->fd_); // also removes it from epoll
+			connections_.erase(connection->id_);
+			if (accept_paused_) {
+				ctl(EPOLL_CTL_ADD, listen_fd_, EPOLLIN, _listen_id);
+				accept_paused_ = false;
+			}
+		}
+	};
+} // namespace ffd
@@ -0,0 +1,253 @@
+// -*- C++ -*-
+/*
+ *    Copyright (C) 2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of lib45d.
+ *
+ *    lib45d is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    lib45d is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with lib45d.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <45d/socket/SocketBase.hpp>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+}
+
+namespace ffd {
+	/**
+	 * @brief Default parameters for TCP sockets
+	 *
+	 */
+	namespace Tcp {
+		const int _keepalive_idle_default = 60;     ///< Seconds idle before the first probe
+		const int _keepalive_interval_default = 10; ///< Seconds between probes
+		const int _keepalive_count_default = 5;     ///< Unanswered probes before dropping
+		const int _buffer_sz_large = 4 << 20;       ///< Socket buffer size for bulk transfers
+	} // namespace Tcp
+
+	/**
+	 * @brief Address resolution and TCP socket options shared by TcpSocketServer and
+	 * TcpSocketClient. Either end of a TCP connection needs MSG_NOSIGNAL in the send flags to
+	 * get an exception instead of SIGPIPE when the peer is gone.
+	 *
+	 */
+	class TcpSocketBase : public SocketBase {
+	public:
+		/**
+		 * @brief Disable or re-enable Nagle's algorithm. With it off, small messages go out
+		 * right away instead of waiting for the previous one to be ACKed.
+		 *
+		 * @param on true to set TCP_NODELAY
+		 * @param fd Optional file descriptor for connection
+		 */
+		void set_nodelay(bool on = true, int fd = 0) {
+			set_option(fd, IPPROTO_TCP, TCP_NODELAY, on);
+		}
+		/**
+		 * @brief Cork the connection, holding back partial segments until it is uncorked, so
+		 * a message written in pieces goes out in as few packets as possible
+		 *
+		 * @param on true to set TCP_CORK, false to flush and uncork
+		 * @param fd Optional file descriptor for connection
+		 */
+		void set_cork(bool on, int fd = 0) {
+			set_option(fd, IPPROTO_TCP, TCP_CORK, on);
+		}
+		/**
+		 * @brief Turn on keepalive probes so a dead peer is noticed on an idle connection
+		 *
+		 * @param on true to set SO_KEEPALIVE
+		 * @param idle Seconds idle before the first probe
+		 * @param interval Seconds between probes
+		 * @param count Unanswered probes before the connection is dropped
+		 * @param fd Optional file descriptor for connection
+		 */
+		void set_keepalive(bool on = true,
+						   int idle = Tcp::_keepalive_idle_default,
+						   int interval = Tcp::_keepalive_interval_default,
+						   int count = Tcp::_keepalive_count_default,
+						   int fd = 0) {
+			set_option(fd, SOL_SOCKET, SO_KEEPALIVE, on);
+			if (!on)
+				return;
+			set_option(fd, IPPROTO_TCP, TCP_KEEPIDLE, idle);
+			set_option(fd, IPPROTO_TCP, TCP_KEEPINTVL, interval);
+			set_option(fd, IPPROTO_TCP, TCP_KEEPCNT, count);
+		}
+		/**
+		 * @brief Set the kernel's receive and send buffer sizes. Sizes past the system limits
+		 * (net.core.rmem_max/wmem_max) are only honoured with CAP_NET_ADMIN, otherwise they
+		 * are capped. On a server, call it before connections are accepted so the larger
+		 * receive window is advertised from the start.
+		 *
+		 * @param rcvbuf Bytes of SO_RCVBUF, 0 to leave alone
+		 * @param sndbuf Bytes of SO_SNDBUF, 0 to leave alone
+		 * @param fd Optional file descriptor for connection, or get_fd() for a listener
+		 */
+		void set_buffer_sizes(int rcvbuf = Tcp::_buffer_sz_large,
+							  int sndbuf = Tcp::_buffer_sz_large,
+							  int fd = 0) {
+			if (rcvbuf > 0 && !try_option(fd, SOL_SOCKET, SO_RCVBUFFORCE, rcvbuf))
+				set_option(fd, SOL_SOCKET, SO_RCVBUF, rcvbuf);
+			if (sndbuf > 0 && !try_option(fd, SOL_SOCKET, SO_SNDBUFFORCE, sndbuf))
+				set_option(fd, SOL_SOCKET, SO_SNDBUF, sndbuf);
+		}
+		/**
+		 * @brief Get the local port, e.g. the one picked when binding port 0
+		 *
+		 * @return uint16_t
+		 */
+		uint16_t get_port(void) const {
+			struct sockaddr_storage addr;
+			socklen_t len = sizeof(addr);
+			if (getsockname(fd_, (sockaddr *)&addr, &len) == -1) {
+				int error = errno;
+				throw SocketAddressException(strerror(error), error);
+			}
+			if (addr.ss_family == AF_INET6)
+				return ntohs(((struct sockaddr_in6 *)&addr)->sin6_port);
+			return ntohs(((struct sockaddr_in *)&addr)->sin_port);
+		}
+	protected:
+		/**
+		 * @brief Resolved socket address
+		 *
+		 */
+		struct Address {
+			struct sockaddr_storage addr;
+			socklen_t len;
+			int family;
+		};
+		std::vector<Address> addrs_; ///< Every address resolved, in getaddrinfo() order
+		struct Address addr_;        ///< Address bound to or connected to
+		/**
+		 * @brief Open a socket for the first of the resolved addresses
+		 *
+		 * @param addrs Result of resolve(), not empty
+		 */
+		TcpSocketBase(const std::vector<Address> &addrs)
+			: SocketBase(addrs[0].family, SOCK_STREAM)
+			, addrs_(addrs)
+			, addr_(addrs[0])
+			, options_() {}
+		/**
+		 * @brief Resolve host and port to every address getaddrinfo() returns. A name can
+		 * resolve to both an IPv6 and an IPv4 address, of which the server may listen on only
+		 * one, so a client tries them in turn.
+		 *
+		 * @param host Name or numeric address, empty for any address when passive
+		 * @param port Port number
+		 * @param passive true to get an address to bind to
+		 * @return std::vector<Address> at least one address
+		 */
+		static std::vector<Address>
+		resolve(const std::string &host, uint16_t port, bool passive) {
+			struct addrinfo hints;
+			memset(&hints, 0, sizeof(hints));
+			hints.ai_family = AF_UNSPEC;
+			hints.ai_socktype = SOCK_STREAM;
+			hints.ai_flags = AI_NUMERICSERV | (passive ? AI_PASSIVE : 0);
+			struct addrinfo *res;
+			std::string service = std::to_string(port);
+			int err =
+				getaddrinfo(host.empty() ? NULL : host.c_str(), service.c_str(), &hints, &res);
+			if (err != 0)
+				throw SocketAddressException(gai_strerror(err),
+											 err == EAI_SYSTEM ? errno : EINVAL);
+			std::vector<Address> addrs;
+			for (struct addrinfo *itr = res; itr != NULL; itr = itr->ai_next) {
+				Address addr;
+				memcpy(&addr.addr, itr->ai_addr, itr->ai_addrlen);
+				addr.len = itr->ai_addrlen;
+				addr.family = itr->ai_family;
+				addrs.push_back(addr);
+			}
+			freeaddrinfo(res);
+			return addrs;
+		}
+		void set_option(int fd, int level, int option, int value) {
+			if (!try_option(fd, level, option, value)) {
+				int error = errno;
+				throw SocketOptionException(strerror(error), error);
+			}
+		}
+		/**
+		 * @brief Replace fd_ with a fresh socket for another address, keeping its fd number
+		 * and the options set on it so far
+		 *
+		 * @param family Address family of the new socket
+		 */
+		void reopen(int family) {
+			int res = socket(family, SOCK_STREAM, 0);
+			if (res == -1) {
+				int error = errno;
+				throw SocketCreateException(strerror(error), error);
+			}
+			for (const Option &opt : options_) {
+				if (setsockopt(res, opt.level, opt.option, &opt.value, sizeof(opt.value)) == -1) {
+					int error = errno;
+					close(res);
+					throw SocketOptionException(strerror(error), error);
+				}
+			}
+			if (dup2(res, fd_) == -1) {
+				int error = errno;
+				close(res);
+				throw SocketCreateException(strerror(error), error);
+			}
+			close(res);
+		}
+	private:
+		/**
+		 * @brief Option set on fd_, see reopen()
+		 *
+		 */
+		struct Option {
+			int level;
+			int option;
+			int value;
+		};
+		std::vector<Option> options_; ///< Options set on fd_, latest value of each
+		int io(int fd) const {
+			return fd == 0 ? io_fd_ : fd;
+		}
+		/**
+		 * @brief Set an int option, remembering it if it was set on fd_
+		 *
+		 * @return false with errno set if setsockopt() failed
+		 */
+		bool try_option(int fd, int level, int option, int value) {
+			if (setsockopt(io(fd), level, option, &value, sizeof(value)) == -1)
+				return false;
+			if (io(fd) != fd_)
+				return true;
+			for (Option &opt : options_) {
+				if (opt.level == level && opt.option == option) {
+					opt.value = value;
+					return true;
+				}
+			}
+			options_.push_back(Option{ level, option, value });
+			return true;
+		}
+	};
+} // namespace ffd
@@ -0,0 +1,66 @@
+// -*- C++ -*-
+/*
+ *    Copyright (C) 2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of lib45d.
+ *
+ *    lib45d is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    lib45d is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with lib45d.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <45d/socket/TcpSocketBase.hpp>
+
+namespace ffd {
+	/**
+	 * @brief TCP Socket Client class. Same API as UnixSocketClient, for IPC between hosts.
+	 *
+	 * Example:
+	 * @include tests/sockets/tcp_loopback/client.cpp
+	 */
+	class TcpSocketClient : public TcpSocketBase {
+	public:
+		/**
+		 * @brief Construct a new Tcp Socket Client object
+		 *
+		 * @param host Server name or address, every address it resolves to is tried by
+		 * connect()
+		 * @param port Server port
+		 */
+		TcpSocketClient(const std::string &host, uint16_t port)
+			: TcpSocketBase(resolve(host, port, false)) {
+			io_fd_ = fd_;
+		}
+		/**
+		 * @brief Make connection to server, trying each address the host resolved to in
+		 * turn. Socket options may be set before or after; each further address gets a fresh
+		 * socket, under the same fd, with the options set so far.
+		 *
+		 * @return int fd for socket
+		 */
+		int connect() {
+			int error = 0;
+			for (size_t i = 0; i < addrs_.size(); ++i) {
+				if (i > 0)
+					reopen(addrs_[i].family); // a socket whose connect() failed can't be reused
+				if (::connect(fd_, (sockaddr *)&addrs_[i].addr, addrs_[i].len) == 0) {
+					addr_ = addrs_[i];
+					return io_fd_;
+				}
+				error = errno;
+			}
+			throw SocketConnectException(strerror(error), error);
+		}
+	};
+} // namespace ffd
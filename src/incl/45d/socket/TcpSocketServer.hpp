@@ -0,0 +1,137 @@
+// -*- C++ -*-
+/*
+ *    Copyright (C) 2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of lib45d.
+ *
+ *    lib45d is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    lib45d is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with lib45d.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <45d/socket/TcpSocketBase.hpp>
+#include <vector>
+
+namespace ffd {
+	/**
+	 * @brief TCP Socket Server class. Same API as UnixSocketServer, for IPC between hosts.
+	 *
+	 * To spread accepting across cores, give each acceptor thread its own server on the same
+	 * host and port with reuse_port set. The kernel then hashes incoming connections across
+	 * the listening sockets, so the threads never contend on one accept queue.
+	 *
+	 * Until a connection is accepted, the option setters apply to the listening socket, and
+	 * accepted connections inherit them.
+	 *
+	 * Example:
+	 * @include tests/sockets/tcp_loopback/server.cpp
+	 */
+	class TcpSocketServer : public TcpSocketBase {
+	public:
+		/**
+		 * @brief Construct a new Tcp Socket Server object, listening on host:port
+		 *
+		 * @param host Address to bind to, empty for any. Only the first address it resolves to
+		 * is bound.
+		 * @param port Port to bind to, 0 to have one picked, see get_port()
+		 * @param backlog Number of connections to queue
+		 * @param reuse_port Set SO_REUSEPORT, letting other sockets with it set bind the same
+		 * port and share its connections
+		 */
+		TcpSocketServer(const std::string &host,
+						uint16_t port,
+						int backlog = Socket::_backlog_default,
+						bool reuse_port = false)
+			: TcpSocketBase(resolve(host, port, true)), connections_() {
+			io_fd_ = fd_;
+			set_option(fd_, SOL_SOCKET, SO_REUSEADDR, 1);
+			if (reuse_port)
+				set_option(fd_, SOL_SOCKET, SO_REUSEPORT, 1);
+			bind();
+			listen(backlog);
+		}
+		/**
+		 * @brief Destroy the Tcp Socket Server object
+		 *
+		 * Closes all connections
+		 *
+		 */
+		~TcpSocketServer() {
+			for (int connection : connections_) {
+				close(connection);
+			}
+		}
+		/**
+		 * @brief Uses accept() to block and wait for a connection, returning a file descriptor
+		 * to the connection. Also sets internal io_fd_ for later use.
+		 *
+		 * @return int fd of connection
+		 */
+		int wait_for_connection() {
+			int connection_fd = accept(fd_, NULL, NULL);
+			if (connection_fd == -1) {
+				int error = errno;
+				throw SocketAcceptException(strerror(error), error);
+			}
+			connections_.push_back(connection_fd);
+			io_fd_ = connection_fd;
+			return connection_fd;
+		}
+		/**
+		 * @brief Close a connection accepted by wait_for_connection(). Does nothing before
+		 * the first accept rather than close the listening socket; the destructor closes it.
+		 *
+		 * @param fd Connection fd or default for the last one accepted
+		 */
+		void close_connection(int fd = 0) {
+			if (fd == 0)
+				fd = io_fd_;
+			if (fd == fd_)
+				return;
+			SocketBase::close_connection(fd);
+			for (size_t i = 0; i < connections_.size(); ++i) {
+				if (connections_[i] == fd) {
+					connections_[i] = connections_.back();
+					connections_.pop_back();
+					break;
+				}
+			}
+		}
+	private:
+		std::vector<int> connections_; ///< vector of open connections for closing in dtor
+		/**
+		 * @brief Bind to the resolved address
+		 *
+		 */
+		void bind(void) {
+			int res = ::bind(fd_, (sockaddr *)&addr_.addr, addr_.len);
+			if (res == -1) {
+				int error = errno;
+				throw SocketBindException(strerror(error), error);
+			}
+		}
+		/**
+		 * @brief Start listening for connections
+		 *
+		 * @param backlog
+		 */
+		void listen(int backlog) {
+			int res = ::listen(fd_, backlog);
+			if (res == -1) {
+				int error = errno;
+				throw SocketListenException(strerror(error), error);
+			}
+		}
+	};
+} // namespace ffd
@@ -30,6 +30,8 @@ namespace ffd {
 	/**
 	 * @brief Unix Socket Client class. Used for IPC through a named socket inode.
 	 *
+	 * The type must match the server's. For SOCK_DGRAM, connect() only sets where messages
+	 * go.
 	 */
 	class UnixSocketClient : public SocketBase {
 	public:
@@ -37,8 +39,10 @@ namespace ffd {
 		 * @brief Construct a new Unix Socket Client object
 		 *
 		 * @param path Path to socket inode
+		 * @param type SOCK_STREAM, SOCK_SEQPACKET or SOCK_DGRAM
 		 */
-		UnixSocketClient(const std::string &path) : SocketBase(AF_UNIX, SOCK_STREAM) {
+		UnixSocketClient(const std::string &path, int type = SOCK_STREAM)
+			: SocketBase(AF_UNIX, type) {
 			memset(&server_addr_, 0, sizeof(server_addr_));
 			server_addr_.sun_family = AF_UNIX;
 			if (path.length() >= sizeof(server_addr_.sun_path))
@@ -0,0 +1,238 @@
+// -*- C++ -*-
+/*
+ *    Copyright (C) 2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of lib45d.
+ *
+ *    lib45d is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    lib45d is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with lib45d.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <45d/socket/Exceptions.hpp>
+#include <45d/socket/UnixSocketClient.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ffd {
+	/**
+	 * @brief Default parameters for UnixSocketPool
+	 *
+	 */
+	namespace Pool {
+		const size_t _max_default = 16; ///< Connections per path, idle and leased together
+	} // namespace Pool
+
+	/**
+	 * @brief Thread safe pool of connected UnixSocketClients, keyed by socket path, so short
+	 * exchanges skip socket() and connect().
+	 *
+	 * acquire() hands out the most recently returned idle connection, after checking with a
+	 * non-blocking peek that the server hasn't closed it and that nothing unread is left on
+	 * it. Connections failing the check are dropped and replaced. When max_per_path
+	 * connections are leased, acquire() waits for one to come back.
+	 *
+	 * A connection goes back to the pool when its Lease is destroyed. A lease whose exchange
+	 * failed part way should be discard()ed; one left with an unread reply is dropped on the
+	 * next check anyway. Leases must not outlive the pool.
+	 *
+	 * Example:
+	 * @include tests/sockets/unix_pool/client.cpp
+	 */
+	class UnixSocketPool {
+	public:
+		/**
+		 * @brief A connection checked out of the pool, returned when destroyed
+		 *
+		 */
+		class Lease {
+		public:
+			Lease(Lease &&other)
+				: pool_(other.pool_), path_(std::move(other.path_)), client_(other.client_) {
+				other.client_ = nullptr;
+			}
+			Lease(const Lease &) = delete;
+			Lease &operator=(const Lease &) = delete;
+			Lease &operator=(Lease &&) = delete;
+			/**
+			 * @brief Return the connection to the pool
+			 *
+			 */
+			~Lease() {
+				if (client_ != nullptr)
+					pool_->release(path_, client_);
+			}
+			/**
+			 * @brief Close the connection instead of returning it, e.g. after an exception
+			 * left it mid-exchange
+			 *
+			 */
+			void discard(void) {
+				if (client_ == nullptr)
+					return;
+				pool_->release(path_, nullptr);
+				delete client_;
+				client_ = nullptr;
+			}
+			/**
+			 * @brief Get the connected client
+			 *
+			 * @return UnixSocketClient&
+			 */
+			UnixSocketClient &operator*(void) const {
+				return *client_;
+			}
+			UnixSocketClient *operator->(void) const {
+				return client_;
+			}
+		private:
+			friend class UnixSocketPool;
+			UnixSocketPool *pool_;
+			std::string path_;
+			UnixSocketClient *client_; ///< Owned while leased, nullptr once returned
+			Lease(UnixSocketPool *pool, const std::string &path, UnixSocketClient *client)
+				: pool_(pool), path_(path), client_(client) {}
+		};
+		/**
+		 * @brief Construct a new Unix Socket Pool object
+		 *
+		 * @param max_per_path Most connections open to one path at once, 0 for no limit
+		 * @param framed Set framing on new connections, see SocketBase::set_framing()
+		 */
+		UnixSocketPool(size_t max_per_path = Pool::_max_default, bool framed = false)
+			: max_per_path_(max_per_path), framed_(framed), mutex_(), paths_() {}
+		UnixSocketPool(const UnixSocketPool &) = delete;
+		UnixSocketPool &operator=(const UnixSocketPool &) = delete;
+		/**
+		 * @brief Check out a connection to path, reusing an idle one or connecting a new one.
+		 * Waits while max_per_path connections to path are leased.
+		 *
+		 * @param path Path to socket inode
+		 * @param timeout_ms Most milliseconds to wait for a free slot, -1 to wait forever
+		 * @return Lease
+		 */
+		Lease acquire(const std::string &path, int timeout_ms = -1) {
+			std::unique_lock<std::mutex> lk(mutex_);
+			Path &entry = paths_[path];
+			std::chrono::steady_clock::time_point deadline =
+				std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+			while (entry.idle.empty() && max_per_path_ != 0 && entry.leased >= max_per_path_) {
+				if (timeout_ms < 0)
+					entry.returned.wait(lk);
+				else if (entry.returned.wait_until(lk, deadline) == std::cv_status::timeout
+						 && entry.idle.empty() && entry.leased >= max_per_path_)
+					throw SocketConnectException("Connection pool exhausted", ETIMEDOUT);
+			}
+			++entry.leased; // slot held from here, release() gives it back on failure
+			while (!entry.idle.empty()) {
+				std::unique_ptr<UnixSocketClient> client(std::move(entry.idle.back()));
+				entry.idle.pop_back();
+				lk.unlock();
+				if (healthy(*client))
+					return Lease(this, path, client.release());
+				client.reset();
+				lk.lock();
+			}
+			lk.unlock();
+			try {
+				std::unique_ptr<UnixSocketClient> client(new UnixSocketClient(path));
+				client->set_framing(framed_);
+				client->connect();
+				return Lease(this, path, client.release());
+			} catch (...) {
+				release(path, nullptr);
+				throw;
+			}
+		}
+		/**
+		 * @brief Get the number of idle connections to path
+		 *
+		 * @param path Path to socket inode
+		 * @return size_t
+		 */
+		size_t idle(const std::string &path) {
+			std::lock_guard<std::mutex> lk(mutex_);
+			std::unordered_map<std::string, Path>::iterator itr = paths_.find(path);
+			return itr == paths_.end() ? 0 : itr->second.idle.size();
+		}
+		/**
+		 * @brief Get the number of leased connections to path
+		 *
+		 * @param path Path to socket inode
+		 * @return size_t
+		 */
+		size_t leased(const std::string &path) {
+			std::lock_guard<std::mutex> lk(mutex_);
+			std::unordered_map<std::string, Path>::iterator itr = paths_.find(path);
+			return itr == paths_.end() ? 0 : itr->second.leased;
+		}
+		/**
+		 * @brief Close every idle connection, e.g. after the server restarted
+		 *
+		 */
+		void clear(void) {
+			std::vector<std::unique_ptr<UnixSocketClient>> closing;
+			std::lock_guard<std::mutex> lk(mutex_);
+			for (auto &entry : paths_) {
+				for (auto &client : entry.second.idle)
+					closing.push_back(std::move(client));
+				entry.second.idle.clear();
+			}
+		}
+	private:
+		/**
+		 * @brief Connections to one path. Each path has its own condition variable so a
+		 * returned lease only wakes the waiters that can use it.
+		 *
+		 */
+		struct Path {
+			std::vector<std::unique_ptr<UnixSocketClient>> idle; ///< Most recently returned last
+			size_t leased;
+			std::condition_variable returned; ///< Signalled when a lease on this path ends
+			Path() : idle(), leased(0), returned() {}
+		};
+		size_t max_per_path_;
+		bool framed_;
+		std::mutex mutex_; ///< Guards paths_
+		std::unordered_map<std::string, Path> paths_;
+		/**
+		 * @brief Give back a leased slot, and the connection unless it's nullptr
+		 *
+		 */
+		void release(const std::string &path, UnixSocketClient *client) {
+			std::lock_guard<std::mutex> lk(mutex_);
+			Path &entry = paths_[path];
+			--entry.leased;
+			if (client != nullptr)
+				entry.idle.emplace_back(client);
+			entry.returned.notify_one();
+		}
+		/**
+		 * @brief Check an idle connection without blocking. A peek that would block means the
+		 * connection is open with nothing pending; end of file means the server closed it,
+		 * and data means a previous exchange wasn't finished.
+		 *
+		 */
+		static bool healthy(const UnixSocketClient &client) {
+			char byte;
+			ssize_t res = ::recv(client.get_io_fd(), &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+			return res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+		}
+	};
+} // namespace ffd
@@ -21,7 +21,12 @@
 #pragma once
 
 #include <45d/socket/SocketBase.hpp>
-#include <vector>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 extern "C" {
 #include <sys/un.h>
@@ -31,6 +36,14 @@ namespace ffd {
 	/**
 	 * @brief Unix Socket Server class. Used for IPC through a named socket inode.
 	 *
+	 * SOCK_SEQPACKET works like SOCK_STREAM but each receive returns exactly one message.
+	 * SOCK_DGRAM is connectionless: there is nothing to accept, and messages from every client
+	 * are received straight from the server socket, best with receive_batch(). Since datagram
+	 * clients have no address to reply to, only the async methods make sense there.
+	 *
+	 * Accepted connections are tracked until close_connection(), which any thread may call,
+	 * so a long running server's fds don't grow with the number of clients served. See
+	 * set_max_connections() and set_idle_timeout() to bound them further.
 	 */
 	class UnixSocketServer : public SocketBase {
 	public:
@@ -39,23 +52,47 @@ namespace ffd {
 		 *
 		 * @param path Path to socket inode
 		 * @param backlog Number of connections to queue
+		 * @param type SOCK_STREAM, SOCK_SEQPACKET or SOCK_DGRAM
 		 */
-		UnixSocketServer(const std::string &path, int backlog = Socket::_backlog_default)
-			: SocketBase(AF_UNIX, SOCK_STREAM)
+		UnixSocketServer(const std::string &path,
+						 int backlog = Socket::_backlog_default,
+						 int type = SOCK_STREAM)
+			: SocketBase(AF_UNIX, type)
 			, domain_(AF_UNIX)
-			, socket_path_(path) {
+			, socket_path_(path)
+			, connections_()
+			, connections_mutex_()
+			, connection_closed_()
+			, max_connections_(0)
+			, receive_timeout_ms_(0)
+			, idle_timeout_ms_(0)
+			, idle_closed_(0)
+			, reaper_()
+			, reaper_stop_(false)
+			, reaper_wake_() {
 			bind();
-			listen(backlog);
+			if (type == SOCK_DGRAM)
+				io_fd_ = fd_;
+			else
+				listen(backlog);
 		}
 		/**
 		 * @brief Destroy the Unix Socket Server object
 		 *
-		 * Closes all connections and unlinks the socket inode
+		 * Closes connections still open and unlinks the socket inode
 		 *
 		 */
 		~UnixSocketServer() {
-			for (int connection : connections_) {
-				close(connection);
+			if (reaper_.joinable()) {
+				{
+					std::lock_guard<std::mutex> lk(connections_mutex_);
+					reaper_stop_ = true;
+				}
+				reaper_wake_.notify_all();
+				reaper_.join();
+			}
+			for (const std::pair<const int, bool> &connection : connections_) {
+				close(connection.first);
 			}
 			unlink(socket_path_.c_str());
 		}
@@ -66,20 +103,178 @@ namespace ffd {
 		 * @return int fd of connection
 		 */
 		int wait_for_connection() {
+			{
+				std::unique_lock<std::mutex> lk(connections_mutex_);
+				connection_closed_.wait(lk, [this] {
+					return max_connections_ == 0 || connections_.size() < max_connections_;
+				});
+			}
 			int connection_fd = accept(fd_, NULL, NULL);
 			if (connection_fd == -1) {
 				int error = errno;
 				throw SocketAcceptException(strerror(error), error);
 			}
-			connections_.push_back(connection_fd);
+			int timeout_ms = receive_timeout_ms_;
+			if (timeout_ms > 0) {
+				struct timeval tv;
+				tv.tv_sec = timeout_ms / 1000;
+				tv.tv_usec = (timeout_ms % 1000) * 1000;
+				if (setsockopt(connection_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == -1) {
+					int error = errno;
+					close(connection_fd);
+					throw SocketOptionException(strerror(error), error);
+				}
+			}
+			conn(connection_fd)
+				.last_active.store(std::chrono::steady_clock::now().time_since_epoch().count());
+			{
+				std::lock_guard<std::mutex> lk(connections_mutex_);
+				connections_.emplace(connection_fd, false);
+			}
 			io_fd_ = connection_fd;
 			return connection_fd;
 		}
+		/**
+		 * @brief Close a connection accepted by wait_for_connection(), freeing its slot. A
+		 * SOCK_DGRAM server has no connections, so this does nothing there rather than close
+		 * the bound socket; the destructor closes it.
+		 *
+		 * @param fd Connection fd or default for the last one accepted
+		 */
+		void close_connection(int fd = 0) {
+			if (fd == 0)
+				fd = io_fd_;
+			if (fd == fd_)
+				return;
+			{
+				// forget it before closing, once closed the fd number can be accepted again
+				// and the reaper must not shut down the new connection
+				std::lock_guard<std::mutex> lk(connections_mutex_);
+				connections_.erase(fd);
+			}
+			connection_closed_.notify_all();
+			SocketBase::close_connection(fd);
+		}
+		/**
+		 * @brief Limit the number of open connections. At the limit, wait_for_connection()
+		 * waits for close_connection() before accepting another, leaving new clients queued
+		 * in the listen backlog. Meant for a blocking accept loop handing connections to
+		 * other threads; it blocks even on a non-blocking listener.
+		 *
+		 * @param max Most open connections, 0 for no limit
+		 */
+		void set_max_connections(size_t max) {
+			{
+				std::lock_guard<std::mutex> lk(connections_mutex_);
+				max_connections_ = max;
+			}
+			connection_closed_.notify_all();
+		}
+		/**
+		 * @brief Set SO_RCVTIMEO on connections accepted by wait_for_connection() from now
+		 * on. A single recv() that waits longer than timeout_ms throws SocketReadException
+		 * with EAGAIN, after which the connection should be closed with close_connection().
+		 *
+		 * This is a per-recv() limit, see set_idle_timeout() for closing connections that
+		 * stop sending. It also fires between the chunks of one framed message, and while
+		 * send_data() waits for the peer's ACK, so pick a value above the longest expected
+		 * stall. Connections accepted by SocketReactor, UringReactor or SocketLoop don't go
+		 * through wait_for_connection() and never time out. SOCK_DGRAM servers are not
+		 * affected.
+		 *
+		 * @param timeout_ms Milliseconds, 0 to wait forever
+		 */
+		void set_receive_timeout(int timeout_ms) {
+			receive_timeout_ms_ = timeout_ms;
+		}
+		/**
+		 * @brief Shut down connections accepted by wait_for_connection() that go longer than
+		 * timeout_ms without a message arriving. A background thread checks every
+		 * timeout_ms / 2 and calls shutdown(2) on idle connections, so a thread blocked
+		 * receiving from one gets an empty message as if the client had left. The connection
+		 * stays open until its owner calls close_connection(), so its fd can't be reused
+		 * under that thread.
+		 *
+		 * @param timeout_ms Milliseconds, 0 to stop reaping
+		 */
+		void set_idle_timeout(int timeout_ms) {
+			{
+				std::lock_guard<std::mutex> lk(connections_mutex_);
+				if (timeout_ms > 0 && !track_activity_) {
+					// connections accepted so far get a full timeout from now
+					std::chrono::steady_clock::rep now =
+						std::chrono::steady_clock::now().time_since_epoch().count();
+					for (const std::pair<const int, bool> &connection : connections_)
+						conn(connection.first).last_active.store(now);
+					track_activity_ = true;
+				}
+				idle_timeout_ms_ = timeout_ms;
+				if (timeout_ms > 0 && !reaper_.joinable())
+					reaper_ = std::thread(&UnixSocketServer::reap, this);
+			}
+			reaper_wake_.notify_all();
+		}
+		/**
+		 * @brief Get the number of connections shut down for being idle, see
+		 * set_idle_timeout()
+		 *
+		 * @return size_t
+		 */
+		size_t idle_closed(void) const {
+			return idle_closed_;
+		}
+		/**
+		 * @brief Get the number of connections accepted and not yet closed
+		 *
+		 * @return size_t
+		 */
+		size_t connections(void) {
+			std::lock_guard<std::mutex> lk(connections_mutex_);
+			return connections_.size();
+		}
 	private:
 		const int domain_;              ///< Socket domain, always AF_UNIX
 		const std::string socket_path_; ///< Path to socket inode, equal to address
 		struct sockaddr_un sock_addr_;  ///< Unix socket address structs
-		std::vector<int> connections_;  ///< vector of open connections for closing in dtor
+		/// Open connections, closed in dtor, and whether the reaper shut them down
+		std::unordered_map<int, bool> connections_;
+		std::mutex connections_mutex_; ///< Guards connections_ and the settings below
+		std::condition_variable connection_closed_; ///< Signalled by close_connection()
+		size_t max_connections_;                    ///< see set_max_connections()
+		std::atomic<int> receive_timeout_ms_;       ///< see set_receive_timeout()
+		int idle_timeout_ms_;                       ///< see set_idle_timeout()
+		std::atomic<size_t> idle_closed_;           ///< see idle_closed()
+		std::thread reaper_;                        ///< Runs reap() once an idle timeout is set
+		bool reaper_stop_;                          ///< Set by the dtor to end reap()
+		std::condition_variable reaper_wake_;       ///< Wakes reap() early
+		/**
+		 * @brief Reaper thread, shutting down connections idle for longer than
+		 * idle_timeout_ms_ every idle_timeout_ms_ / 2
+		 *
+		 */
+		void reap(void) {
+			std::unique_lock<std::mutex> lk(connections_mutex_);
+			while (!reaper_stop_) {
+				if (idle_timeout_ms_ <= 0) {
+					reaper_wake_.wait(lk);
+					continue;
+				}
+				std::chrono::milliseconds timeout(idle_timeout_ms_);
+				reaper_wake_.wait_for(lk, timeout / 2);
+				if (reaper_stop_ || idle_timeout_ms_ <= 0)
+					continue;
+				std::chrono::steady_clock::rep cutoff =
+					(std::chrono::steady_clock::now() - timeout).time_since_epoch().count();
+				// fds in connections_ are not closed until close_connection() takes the lock
+				for (std::pair<const int, bool> &connection : connections_) {
+					if (connection.second || conn(connection.first).last_active.load() > cutoff)
+						continue;
+					::shutdown(connection.first, SHUT_RDWR);
+					connection.second = true;
+					++idle_closed_;
+				}
+			}
+		}
 		/**
 		 * @brief Set up socket address structs and bind to the address inode path
 		 *
@@ -0,0 +1,895 @@
+// -*- C++ -*-
+/*
+ *    Copyright (C) 2021 Joshua Boudreau <jboudreau@45drives.com>
+ *
+ *    This file is part of lib45d.
+ *
+ *    lib45d is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    lib45d is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with lib45d.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#if defined(__has_include)
+#	if __has_include(<linux/io_uring.h>)
+#		include <linux/io_uring.h>
+#	endif
+#endif
+
+// Needs kernel headers new enough for multishot recv and provided buffer rings, otherwise
+// this header defines nothing
+#ifdef IORING_RECV_MULTISHOT
+
+#	include <45d/socket/Exceptions.hpp>
+#	include <45d/socket/SocketBase.hpp>
+#	include <atomic>
+#	include <cstdint>
+#	include <cstdio>
+#	include <cstring>
+#	include <deque>
+#	include <functional>
+#	include <memory>
+#	include <mutex>
+#	include <string>
+#	include <unordered_map>
+#	include <vector>
+
+#	include <sys/eventfd.h>
+#	include <sys/mman.h>
+#	include <sys/syscall.h>
+#	include <sys/utsname.h>
+#	include <unistd.h>
+
+namespace ffd {
+	/**
+	 * @brief Default parameters for UringReactor
+	 *
+	 */
+	namespace Uring {
+		const unsigned _entries_default = 256;  ///< Submission queue entries
+		const unsigned _buffers_default = 256;  ///< Provided receive buffers, a power of 2
+		const unsigned _buffer_sz = 16 * 1024;  ///< Bytes per provided receive buffer
+		const size_t _coalesce_sz = 64 * 1024;  ///< Queued sends are merged up to this size
+		const unsigned _chain_max = 16;         ///< Most sends linked in one chain
+		const uint16_t _group = 0;              ///< Provided buffer group id
+	} // namespace Uring
+
+	/**
+	 * @brief io_uring event loop with the same interface as SocketReactor, for when syscalls
+	 * are the bottleneck. Talks to the kernel directly, no liburing needed.
+	 *
+	 * One multishot accept takes every new connection, and one multishot recv per connection
+	 * delivers data into a ring of kernel-provided buffers, so nothing is re-armed per event
+	 * and idle connections pin no memory. Output is queued and submitted as chains of linked
+	 * sends, which the kernel runs in order without coming back to user space. Submitting
+	 * and waiting is one io_uring_enter() per loop iteration however many connections are
+	 * busy.
+	 *
+	 * Needs Linux 6.0 or newer; check supported() and fall back to SocketReactor. Kernels that
+	 * register a buffer ring but never select from it get the buffers handed back one at a
+	 * time with IORING_OP_PROVIDE_BUFFERS instead. Handlers run on the thread calling run()
+	 * and must not block.
+	 *
+	 * Example:
+	 * @include tests/sockets/unix_uring/server.cpp
+	 */
+	class UringReactor {
+	public:
+		/**
+		 * @brief One accepted connection. Owned by the reactor, only valid inside handlers
+		 * and posted functions.
+		 *
+		 */
+		class Connection {
+		public:
+			Connection(const Connection &) = delete;
+			Connection &operator=(const Connection &) = delete;
+			/**
+			 * @brief Get the connection fd
+			 *
+			 * @return int
+			 */
+			int fd(void) const {
+				return fd_;
+			}
+			/**
+			 * @brief Get the connection id. Unlike fds, ids are never reused, so they are safe
+			 * to hold on to for UringReactor::find().
+			 *
+			 * @return uint64_t
+			 */
+			uint64_t id(void) const {
+				return id_;
+			}
+			/**
+			 * @brief Bytes received and not consumed yet. Handlers erase what they used and
+			 * leave partial messages for the next on_data call.
+			 *
+			 * @return std::string&
+			 */
+			std::string &input(void) {
+				return in_;
+			}
+			/**
+			 * @brief Queue data to send. It goes out with the next submission.
+			 *
+			 * @param data Bytes to send
+			 */
+			void send(const std::string &data) {
+				if (dead_ || closed_ || data.empty())
+					return;
+				if (out_.size() > submitted_ && out_.back().size() < Uring::_coalesce_sz)
+					out_.back() += data;
+				else
+					out_.push_back(data);
+				pending_ += data.size();
+				reactor_->touch(*this);
+			}
+			/**
+			 * @brief Close the connection once queued output is sent
+			 *
+			 */
+			void close(void) {
+				closing_ = true;
+				reactor_->touch(*this);
+			}
+			/**
+			 * @brief Get the number of bytes waiting to be sent
+			 *
+			 * @return size_t
+			 */
+			size_t pending_output(void) const {
+				return pending_;
+			}
+		private:
+			friend class UringReactor;
+			UringReactor *reactor_;
+			int fd_;
+			uint64_t id_;
+			std::string in_;
+			std::deque<std::string> out_; ///< Queued sends, elements never move while in flight
+			size_t submitted_;            ///< Sends at the front of out_ owned by the kernel
+			size_t acked_;                ///< Completions received for the submitted chain
+			size_t sent_;                 ///< Chunks of the chain sent in full
+			size_t pending_;              ///< Bytes in out_
+			bool receiving_;              ///< Multishot recv armed
+			bool closing_;                ///< Close once out_ is sent
+			bool dead_;                   ///< Peer gone or socket error, close now
+			bool closed_;                 ///< fd closed, waiting for sends in flight to finish
+			bool touched_;                ///< Already queued for UringReactor::settle()
+			Connection(UringReactor *reactor, int fd, uint64_t id)
+				: reactor_(reactor)
+				, fd_(fd)
+				, id_(id)
+				, in_()
+				, out_()
+				, submitted_(0)
+				, acked_(0)
+				, sent_(0)
+				, pending_(0)
+				, receiving_(false)
+				, closing_(false)
+				, dead_(false)
+				, closed_(false)
+				, touched_(false) {}
+		};
+		/**
+		 * @brief Handlers called from the event loop. Any may be left empty.
+		 *
+		 */
+		struct Handlers {
+			std::function<void(Connection &)> on_connect; ///< After accept()
+			std::function<void(Connection &)> on_data;    ///< After bytes were added to input()
+			std::function<void(Connection &)> on_close;   ///< Before the fd is closed
+		};
+		/**
+		 * @brief Check whether the running kernel has everything this engine uses
+		 *
+		 * @return true if a UringReactor can be constructed
+		 */
+		static bool supported(void) {
+			struct utsname u;
+			int major = 0, minor = 0;
+			if (uname(&u) == -1 || sscanf(u.release, "%d.%d", &major, &minor) != 2
+				|| major < 6)
+				return false; // multishot recv came in 6.0
+			try {
+				Ring ring(4, 4);
+				return true;
+			} catch (const SocketReactorException &) {
+				return false;
+			}
+		}
+		/**
+		 * @brief Construct a new Uring Reactor object
+		 *
+		 * @param listener Listening socket to accept connections from, must outlive the
+		 * reactor
+		 * @param handlers Connection event handlers
+		 * @param entries Submission queue entries
+		 * @param buffers Number of provided receive buffers, a power of 2
+		 */
+		UringReactor(SocketBase &listener,
+					 const Handlers &handlers,
+					 unsigned entries = Uring::_entries_default,
+					 unsigned buffers = Uring::_buffers_default)
+			: listen_fd_(listener.get_fd())
+			, handlers_(handlers)
+			, ring_(entries, buffers)
+			, event_fd_(-1)
+			, event_count_(0)
+			, connections_()
+			, open_(0)
+			, next_id_(_first_id)
+			, touched_()
+			, accepting_(false)
+			, accept_paused_(false)
+			, waking_(false)
+			, stopping_(false)
+			, posted_mutex_()
+			, posted_() {
+			event_fd_ = eventfd(0, EFD_CLOEXEC);
+			if (event_fd_ == -1) {
+				int error = errno;
+				throw SocketReactorException(strerror(error), error);
+			}
+		}
+		UringReactor(const UringReactor &) = delete;
+		UringReactor &operator=(const UringReactor &) = delete;
+		/**
+		 * @brief Destroy the Uring Reactor object, closing every connection without calling
+		 * on_close
+		 *
+		 */
+		~UringReactor() {
+			for (auto &connection : connections_) {
+				if (!connection.second->closed_) {
+					// fail anything in flight now, the ring holds its own reference
+					shutdown(connection.second->fd_, SHUT_RDWR);
+					::close(connection.second->fd_);
+				}
+			}
+			ring_.teardown(); // before connections_ goes, sends may point into it
+			::close(event_fd_);
+		}
+		/**
+		 * @brief Run the event loop on this thread until stop() is called
+		 *
+		 */
+		void run(void) {
+			if (!accepting_ && !accept_paused_)
+				arm_accept();
+			if (!waking_)
+				arm_wake();
+			while (!stopping_) {
+				ring_.enter(1);
+				struct io_uring_cqe *cqe;
+				while ((cqe = ring_.peek()) != nullptr) {
+					uint64_t data = cqe->user_data;
+					int res = cqe->res;
+					uint32_t flags = cqe->flags;
+					ring_.advance();
+					complete(data, res, flags);
+				}
+				settle();
+			}
+			stopping_ = false;
+		}
+		/**
+		 * @brief Make run() return after the current batch of completions. Safe to call from
+		 * any thread.
+		 *
+		 */
+		void stop(void) {
+			stopping_ = true;
+			wake();
+		}
+		/**
+		 * @brief Run a function on the event loop thread, e.g. to send a reply computed on
+		 * another thread. Safe to call from any thread.
+		 *
+		 * @param fn Function to run
+		 */
+		void post(std::function<void()> fn) {
+			{
+				std::lock_guard<std::mutex> lk(posted_mutex_);
+				posted_.push_back(fn);
+			}
+			wake();
+		}
+		/**
+		 * @brief Look up a connection by id. Only call from the event loop thread.
+		 *
+		 * @param id Connection::id()
+		 * @return Connection* nullptr if it was closed
+		 */
+		Connection *find(uint64_t id) {
+			Connection *connection = lookup(id);
+			return connection == nullptr || connection->closed_ ? nullptr : connection;
+		}
+		/**
+		 * @brief Get the number of open connections. Only call from the event loop thread.
+		 *
+		 * @return size_t
+		 */
+		size_t connections(void) const {
+			return open_;
+		}
+	private:
+		/**
+		 * @brief Operation a completion belongs to, in the low bits of its user data
+		 *
+		 */
+		enum Op : uint64_t { ACCEPT = 0, RECV = 1, SEND = 2, WAKE = 3, CANCEL = 4, PROVIDE = 5 };
+		static const int _op_bits = 3;
+		static const uint64_t _first_id = 1; ///< First connection id, 0 is the reactor's own
+		/**
+		 * @brief The io_uring instance and its provided buffer ring, mapped into our memory
+		 *
+		 */
+		class Ring {
+		public:
+			Ring(unsigned entries, unsigned buffers)
+				: fd_(-1)
+				, sq_ptr_(MAP_FAILED)
+				, cq_ptr_(MAP_FAILED)
+				, sqes_(nullptr)
+				, sq_sz_(0)
+				, cq_sz_(0)
+				, sqes_sz_(0)
+				, queued_(0)
+				, bufs_(nullptr)
+				, bufs_sz_(0)
+				, buff_mem_()
+				, buffers_(0)
+				, buf_tail_(0) {
+				struct io_uring_params p;
+				memset(&p, 0, sizeof(p));
+				p.flags = IORING_SETUP_CLAMP | IORING_SETUP_COOP_TASKRUN;
+				fd_ = syscall(__NR_io_uring_setup, entries, &p);
+				if (fd_ == -1 && errno == EINVAL) {
+					p.flags = IORING_SETUP_CLAMP; // COOP_TASKRUN is 5.19+
+					fd_ = syscall(__NR_io_uring_setup, entries, &p);
+				}
+				if (fd_ == -1) {
+					int error = errno;
+					throw SocketReactorException(strerror(error), error);
+				}
+				try {
+					map(p);
+					provide(buffers);
+				} catch (...) {
+					teardown();
+					throw;
+				}
+			}
+			Ring(const Ring &) = delete;
+			Ring &operator=(const Ring &) = delete;
+			~Ring() {
+				teardown();
+			}
+			/**
+			 * @brief Close the ring, cancelling everything in flight, and unmap it
+			 *
+			 */
+			void teardown(void) {
+				if (fd_ != -1)
+					::close(fd_);
+				fd_ = -1;
+				if (sqes_ != nullptr)
+					munmap(sqes_, sqes_sz_);
+				sqes_ = nullptr;
+				if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_)
+					munmap(cq_ptr_, cq_sz_);
+				if (sq_ptr_ != MAP_FAILED)
+					munmap(sq_ptr_, sq_sz_);
+				sq_ptr_ = cq_ptr_ = MAP_FAILED;
+				if (bufs_ != nullptr)
+					munmap(bufs_, bufs_sz_);
+				bufs_ = nullptr;
+			}
+			/**
+			 * @brief Make sure the submission queue has room for need more entries, submitting
+			 * the queued ones if it doesn't
+			 *
+			 */
+			void reserve(unsigned need) {
+				if (*sq_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) + need <= sq_entries_)
+					return;
+				enter(0);
+				if (*sq_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) + need > sq_entries_)
+					throw SocketReactorException("Submission queue full", EBUSY);
+			}
+			/**
+			 * @brief Get a zeroed submission queue entry
+			 *
+			 */
+			struct io_uring_sqe *sqe(void) {
+				reserve(1);
+				unsigned tail = *sq_tail_;
+				struct io_uring_sqe *sqe = &sqes_[tail & sq_mask_];
+				memset(sqe, 0, sizeof(*sqe));
+				__atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+				++queued_;
+				return sqe;
+			}
+			/**
+			 * @brief Submit queued entries and wait for at least wait completions
+			 *
+			 */
+			void enter(unsigned wait) {
+				for (;;) {
+					int res = syscall(__NR_io_uring_enter,
+									  fd_,
+									  queued_,
+									  wait,
+									  wait ? IORING_ENTER_GETEVENTS : 0,
+									  NULL,
+									  0);
+					if (res >= 0) {
+						queued_ -= res;
+						if (queued_ == 0 || wait == 0)
+							return;
+						continue;
+					}
+					if (errno == EINTR)
+						return;
+					if ((errno == EAGAIN || errno == EBUSY) && peek() != nullptr)
+						return; // completion queue backed up, reap before submitting more
+					int error = errno;
+					throw SocketReactorException(strerror(error), error);
+				}
+			}
+			/**
+			 * @brief Get the next completion without consuming it
+			 *
+			 */
+			struct io_uring_cqe *peek(void) {
+				unsigned head = *cq_head_;
+				if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE))
+					return nullptr;
+				return &cqes_[head & cq_mask_];
+			}
+			/**
+			 * @brief Consume the completion returned by peek()
+			 *
+			 */
+			void advance(void) {
+				__atomic_store_n(cq_head_, *cq_head_ + 1, __ATOMIC_RELEASE);
+			}
+			/**
+			 * @brief Get the data of provided buffer bid
+			 *
+			 */
+			const char *buffer(uint16_t bid) const {
+				return buff_mem_.data() + (size_t)bid * Uring::_buffer_sz;
+			}
+			/**
+			 * @brief Give provided buffer bid back to the kernel
+			 *
+			 */
+			void recycle(uint16_t bid) {
+				if (bufs_ == nullptr) {
+					struct io_uring_sqe *sqe = this->sqe();
+					sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+					sqe->fd = 1;
+					sqe->addr = (uint64_t)(uintptr_t)buffer(bid);
+					sqe->len = Uring::_buffer_sz;
+					sqe->off = bid;
+					sqe->buf_group = Uring::_group;
+					sqe->user_data = tag(0, PROVIDE);
+					return;
+				}
+				// set fields one by one, bufs[0].resv is the ring's tail
+				struct io_uring_buf *buf = &bufs_->bufs[buf_tail_ & (buffers_ - 1)];
+				buf->addr = (uint64_t)(uintptr_t)buffer(bid);
+				buf->len = Uring::_buffer_sz;
+				buf->bid = bid;
+				__atomic_store_n(&bufs_->tail, ++buf_tail_, __ATOMIC_RELEASE);
+			}
+		private:
+			int fd_;
+			void *sq_ptr_;
+			void *cq_ptr_;
+			struct io_uring_sqe *sqes_;
+			size_t sq_sz_;
+			size_t cq_sz_;
+			size_t sqes_sz_;
+			unsigned *sq_head_;
+			unsigned *sq_tail_;
+			unsigned sq_mask_;
+			unsigned sq_entries_;
+			unsigned *cq_head_;
+			unsigned *cq_tail_;
+			unsigned cq_mask_;
+			struct io_uring_cqe *cqes_;
+			unsigned queued_; ///< Entries written but not yet submitted
+			struct io_uring_buf_ring *bufs_; ///< nullptr when buffers are provided one at a time
+			size_t bufs_sz_;
+			std::vector<char> buff_mem_; ///< Memory behind the provided buffers
+			unsigned buffers_;
+			uint16_t buf_tail_;
+			void *map_region(size_t sz, off_t off) {
+				void *ptr =
+					mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, off);
+				if (ptr == MAP_FAILED) {
+					int error = errno;
+					throw SocketReactorException(strerror(error), error);
+				}
+				return ptr;
+			}
+			void map(const struct io_uring_params &p) {
+				sq_sz_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+				cq_sz_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+				if (p.features & IORING_FEAT_SINGLE_MMAP) {
+					if (cq_sz_ > sq_sz_)
+						sq_sz_ = cq_sz_;
+					sq_ptr_ = map_region(sq_sz_, IORING_OFF_SQ_RING);
+					cq_ptr_ = sq_ptr_;
+				} else {
+					sq_ptr_ = map_region(sq_sz_, IORING_OFF_SQ_RING);
+					cq_ptr_ = map_region(cq_sz_, IORING_OFF_CQ_RING);
+				}
+				sqes_sz_ = p.sq_entries * sizeof(struct io_uring_sqe);
+				sqes_ = (struct io_uring_sqe *)map_region(sqes_sz_, IORING_OFF_SQES);
+				char *sq = (char *)sq_ptr_;
+				char *cq = (char *)cq_ptr_;
+				sq_head_ = (unsigned *)(sq + p.sq_off.head);
+				sq_tail_ = (unsigned *)(sq + p.sq_off.tail);
+				sq_mask_ = *(unsigned *)(sq + p.sq_off.ring_mask);
+				sq_entries_ = p.sq_entries;
+				unsigned *array = (unsigned *)(sq + p.sq_off.array);
+				for (unsigned i = 0; i < p.sq_entries; ++i)
+					array[i] = i; // entry i always lives in slot i
+				cq_head_ = (unsigned *)(cq + p.cq_off.head);
+				cq_tail_ = (unsigned *)(cq + p.cq_off.tail);
+				cq_mask_ = *(unsigned *)(cq + p.cq_off.ring_mask);
+				cqes_ = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+			}
+			/**
+			 * @brief Register the provided buffers as a ring (5.19+), or provide them with
+			 * IORING_OP_PROVIDE_BUFFERS if the kernel won't select from the ring
+			 *
+			 */
+			void provide(unsigned buffers) {
+				if (buffers == 0 || (buffers & (buffers - 1)) || buffers > 32768)
+					throw SocketReactorException("Buffer count must be a power of 2", EINVAL);
+				buffers_ = buffers;
+				buff_mem_.resize((size_t)buffers * Uring::_buffer_sz);
+				bufs_sz_ = buffers * sizeof(struct io_uring_buf);
+				void *ptr = mmap(NULL,
+								 bufs_sz_,
+								 PROT_READ | PROT_WRITE,
+								 MAP_PRIVATE | MAP_ANONYMOUS,
+								 -1,
+								 0);
+				if (ptr == MAP_FAILED) {
+					int error = errno;
+					throw SocketReactorException(strerror(error), error);
+				}
+				bufs_ = (struct io_uring_buf_ring *)ptr;
+				struct io_uring_buf_reg reg;
+				memset(&reg, 0, sizeof(reg));
+				reg.ring_addr = (uint64_t)(uintptr_t)bufs_;
+				reg.ring_entries = buffers;
+				reg.bgid = Uring::_group;
+				if (syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PBUF_RING, &reg, 1) == 0) {
+					for (unsigned i = 0; i < buffers; ++i)
+						recycle(i);
+					if (probe())
+						return;
+					syscall(__NR_io_uring_register, fd_, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+				}
+				munmap(bufs_, bufs_sz_);
+				bufs_ = nullptr;
+				struct io_uring_sqe *sqe = this->sqe();
+				sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+				sqe->fd = buffers;
+				sqe->addr = (uint64_t)(uintptr_t)buff_mem_.data();
+				sqe->len = Uring::_buffer_sz;
+				sqe->buf_group = Uring::_group;
+				sqe->user_data = tag(0, PROVIDE);
+				int res = wait_one();
+				if (res < 0)
+					throw SocketReactorException(strerror(-res), -res);
+			}
+			/**
+			 * @brief Check that a receive actually gets a buffer from the ring. Some kernels
+			 * accept the registration and then never select from it.
+			 *
+			 */
+			bool probe(void) {
+				int sv[2];
+				if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1) {
+					int error = errno;
+					throw SocketReactorException(strerror(error), error);
+				}
+				bool ok = write(sv[1], "", 1) == 1;
+				if (ok) {
+					struct io_uring_sqe *sqe = this->sqe();
+					sqe->opcode = IORING_OP_RECV;
+					sqe->fd = sv[0];
+					sqe->flags = IOSQE_BUFFER_SELECT;
+					sqe->buf_group = Uring::_group;
+					sqe->user_data = tag(0, RECV);
+					uint32_t flags;
+					ok = wait_one(&flags) == 1 && (flags & IORING_CQE_F_BUFFER);
+					if (ok)
+						recycle(flags >> IORING_CQE_BUFFER_SHIFT);
+				}
+				::close(sv[0]);
+				::close(sv[1]);
+				return ok;
+			}
+			/**
+			 * @brief Submit and reap a single request during setup
+			 *
+			 */
+			int wait_one(uint32_t *flags = nullptr) {
+				struct io_uring_cqe *cqe;
+				while ((cqe = peek()) == nullptr)
+					enter(1);
+				int res = cqe->res;
+				if (flags != nullptr)
+					*flags = cqe->flags;
+				advance();
+				return res;
+			}
+		};
+		int listen_fd_; ///< Borrowed listening socket
+		Handlers handlers_;
+		Ring ring_;
+		int event_fd_;         ///< Wakes the loop for stop() and post()
+		uint64_t event_count_; ///< Read target for event_fd_
+		std::unordered_map<uint64_t, std::unique_ptr<Connection>> connections_;
+		size_t open_; ///< Connections not closed yet
+		uint64_t next_id_;
+		std::vector<uint64_t> touched_; ///< Connections to submit sends for or close in settle()
+		bool accepting_;                ///< Multishot accept armed
+		bool accept_paused_;            ///< Out of fds, accept re-armed when a connection closes
+		bool waking_;                   ///< Read on event_fd_ armed
+		std::atomic<bool> stopping_;
+		std::mutex posted_mutex_; ///< Guards posted_
+		std::deque<std::function<void()>> posted_;
+		static uint64_t tag(uint64_t id, Op op) {
+			return (id << _op_bits) | op;
+		}
+		Connection *lookup(uint64_t id) {
+			std::unordered_map<uint64_t, std::unique_ptr<Connection>>::iterator itr =
+				connections_.find(id);
+			return itr == connections_.end() ? nullptr : itr->second.get();
+		}
+		void wake(void) {
+			uint64_t one = 1;
+			ssize_t res = write(event_fd_, &one, sizeof(one));
+			(void)res; // only fails if the counter is saturated, which wakes the loop anyway
+		}
+		void touch(Connection &connection) {
+			if (!connection.touched_) {
+				connection.touched_ = true;
+				touched_.push_back(connection.id_);
+			}
+		}
+		void arm_accept(void) {
+			struct io_uring_sqe *sqe = ring_.sqe();
+			sqe->opcode = IORING_OP_ACCEPT;
+			sqe->fd = listen_fd_;
+			sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+			sqe->accept_flags = SOCK_CLOEXEC;
+			sqe->user_data = tag(0, ACCEPT);
+			accepting_ = true;
+		}
+		void arm_wake(void) {
+			struct io_uring_sqe *sqe = ring_.sqe();
+			sqe->opcode = IORING_OP_READ;
+			sqe->fd = event_fd_;
+			sqe->addr = (uint64_t)(uintptr_t)&event_count_;
+			sqe->len = sizeof(event_count_);
+			sqe->user_data = tag(0, WAKE);
+			waking_ = true;
+		}
+		void arm_recv(Connection &connection) {
+			struct io_uring_sqe *sqe = ring_.sqe();
+			sqe->opcode = IORING_OP_RECV;
+			sqe->fd = connection.fd_;
+			sqe->ioprio = IORING_RECV_MULTISHOT;
+			sqe->flags = IOSQE_BUFFER_SELECT;
+			sqe->buf_group = Uring::_group;
+			sqe->user_data = tag(connection.id_, RECV);
+			connection.receiving_ = true;
+		}
+		/**
+		 * @brief Submit queued output as one chain of linked sends
+		 *
+		 */
+		void submit_sends(Connection &connection) {
+			unsigned n = connection.out_.size();
+			if (n > Uring::_chain_max)
+				n = Uring::_chain_max;
+			ring_.reserve(n); // links don't span submissions
+			for (unsigned i = 0; i < n; ++i) {
+				const std::string &chunk = connection.out_[i];
+				struct io_uring_sqe *sqe = ring_.sqe();
+				sqe->opcode = IORING_OP_SEND;
+				sqe->fd = connection.fd_;
+				sqe->addr = (uint64_t)(uintptr_t)chunk.data();
+				sqe->len = chunk.size();
+				sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+				if (i + 1 < n)
+					sqe->flags = IOSQE_IO_LINK;
+				sqe->user_data = tag(connection.id_, SEND);
+			}
+			connection.submitted_ = n;
+			connection.acked_ = 0;
+			connection.sent_ = 0;
+		}
+		void complete(uint64_t data, int res, uint32_t flags) {
+			uint64_t id = data >> _op_bits;
+			switch ((Op)(data & ((1 << _op_bits) - 1))) {
+			case ACCEPT:
+				accepted(res, flags);
+				break;
+			case RECV:
+				received(id, res, flags);
+				break;
+			case SEND:
+				sent(id, res);
+				break;
+			case WAKE:
+				waking_ = false;
+				arm_wake();
+				run_posted();
+				break;
+			case CANCEL:
+			case PROVIDE:
+				break;
+			}
+		}
+		void accepted(int res, uint32_t flags) {
+			if (!(flags & IORING_CQE_F_MORE))
+				accepting_ = false;
+			if (res < 0) {
+				if (res == -EMFILE || res == -ENFILE || res == -ENOBUFS || res == -ENOMEM)
+					accept_paused_ = true; // try again when a connection closes
+				else if (!accepting_)
+					arm_accept();
+				return;
+			}
+			uint64_t id = next_id_++;
+			Connection *connection = new Connection(this, res, id);
+			connections_[id].reset(connection);
+			++open_;
+			arm_recv(*connection);
+			if (handlers_.on_connect)
+				handlers_.on_connect(*connection);
+			settle();
+			if (!accepting_ && !accept_paused_)
+				arm_accept();
+		}
+		void received(uint64_t id, int res, uint32_t flags) {
+			Connection *connection = find(id);
+			if (flags & IORING_CQE_F_BUFFER) {
+				uint16_t bid = flags >> IORING_CQE_BUFFER_SHIFT;
+				if (connection != nullptr && res > 0)
+					connection->in_.append(ring_.buffer(bid), res);
+				ring_.recycle(bid);
+			}
+			if (connection == nullptr)
+				return;
+			if (!(flags & IORING_CQE_F_MORE))
+				connection->receiving_ = false;
+			if (res == 0) {
+				// peer is done sending, finish replying then close
+				connection->closing_ = true;
+			} else if (res < 0 && res != -ENOBUFS) {
+				connection->dead_ = true;
+			}
+			touch(*connection);
+			if (res > 0 && !connection->dead_ && handlers_.on_data)
+				handlers_.on_data(*connection);
+		}
+		/**
+		 * @brief Sends of a chain complete in order. Chunks stay put until the whole chain is
+		 * back, then the ones sent in full are dropped. After a short send the rest of the
+		 * chain comes back cancelled and is resubmitted from the unsent part.
+		 *
+		 */
+		void sent(uint64_t id, int res) {
+			Connection *connection = lookup(id);
+			if (connection == nullptr || connection->acked_ == connection->submitted_)
+				return;
+			std::string &chunk = connection->out_[connection->acked_++];
+			if (res == (int)chunk.size() && connection->sent_ + 1 == connection->acked_) {
+				++connection->sent_;
+				connection->pending_ -= chunk.size();
+			} else if (res > 0) {
+				connection->pending_ -= res;
+				chunk.erase(0, res); // done with this one, the kernel has moved on
+			} else if (res < 0 && res != -ECANCELED) {
+				connection->dead_ = true;
+			}
+			if (connection->acked_ < connection->submitted_)
+				return;
+			connection->out_.erase(connection->out_.begin(),
+								   connection->out_.begin() + connection->sent_);
+			connection->submitted_ = connection->acked_ = connection->sent_ = 0;
+			touch(*connection);
+		}
+		void run_posted(void) {
+			std::deque<std::function<void()>> posted;
+			{
+				std::lock_guard<std::mutex> lk(posted_mutex_);
+				posted.swap(posted_);
+			}
+			for (std::function<void()> &fn : posted) {
+				fn();
+				settle();
+			}
+		}
+		/**
+		 * @brief Apply state changes made by handlers and completions: close finished
+		 * connections, re-arm receives and submit queued output
+		 *
+		 */
+		void settle(void) {
+			for (size_t i = 0; i < touched_.size(); ++i) {
+				Connection *connection = lookup(touched_[i]);
+				if (connection == nullptr)
+					continue;
+				connection->touched_ = false;
+				if (connection->closed_) {
+					if (connection->submitted_ == 0)
+						connections_.erase(connection->id_);
+					continue;
+				}
+				if (connection->dead_
+					|| (connection->closing_ && connection->pending_output() == 0)) {
+					destroy(connection);
+					continue;
+				}
+				if (!connection->receiving_ && !connection->closing_)
+					arm_recv(*connection);
+				if (connection->submitted_ == 0 && !connection->out_.empty())
+					submit_sends(*connection);
+			}
+			touched_.clear();
+		}
+		void cancel(uint64_t data) {
+			struct io_uring_sqe *sqe = ring_.sqe();
+			sqe->opcode = IORING_OP_ASYNC_CANCEL;
+			sqe->addr = data;
+			sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+			sqe->user_data = tag(0, CANCEL);
+		}
+		void destroy(Connection *connection) {
+			if (handlers_.on_close)
+				handlers_.on_close(*connection);
+			if (connection->receiving_)
+				cancel(tag(connection->id_, RECV));
+			if (connection->submitted_ > 0)
+				cancel(tag(connection->id_, SEND));
+			::close(connection->fd_); // in-flight requests hold their own reference
+			connection->closed_ = true;
+			--open_;
+			if (connection->submitted_ == 0)
+				connections_.erase(connection->id_);
+			// else kept until its sends complete, they point into out_
+			if (accept_paused_) {
+				accept_paused_ = false;
+				arm_accept();
+			}
+		}
+	};
+} // namespace ffd
+
+#endif
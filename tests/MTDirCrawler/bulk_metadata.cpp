@@ -0,0 +1,93 @@
+/**
+ * @code
+ */
+
+#include <45d/crawler/BulkMetadata.hpp>
+#include <cassert>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+namespace fs = std::filesystem;
+
+void usage(void) {
+	std::cout << "bulk-metadata /path/ pattern [# threads]" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+	int threads;
+	if (argc == 3) {
+		threads = 8;
+	} else if (argc == 4) {
+		try {
+			threads = std::stoi(argv[3]);
+		} catch (const std::invalid_argument &) {
+			usage();
+			exit(1);
+		}
+	} else {
+		usage();
+		exit(1);
+	}
+	std::string path = argv[1];
+	char scratch_template[] = "/tmp/bulk_metadata.XXXXXX";
+	fs::path scratch = mkdtemp(scratch_template);
+	fs::copy(path, scratch, fs::copy_options::recursive);
+	for (auto const &e : fs::recursive_directory_iterator(scratch)) {
+		if (!e.is_directory())
+			fs::permissions(e.path(), fs::perms(0755));
+	}
+
+	/* Like chmod -R with a different mode for files and directories, plus touch -m.
+	 * A dry run first, which should count the same changes without making any.
+	 */
+	ffd::BulkMetadataUpdater updater;
+	updater.set_mode(0640, 0750);
+	struct timespec mtime = { 1000000000, 0 };
+	struct timespec omit = { 0, UTIME_OMIT };
+	updater.set_times(omit, mtime);
+
+	updater.set_dry_run(true);
+	ffd::BulkMetadataUpdater::Stats dry = updater.run(scratch, threads);
+	assert(dry.errors == 0);
+	assert(dry.changed == dry.examined);
+
+	updater.set_dry_run(false);
+	ffd::BulkMetadataUpdater::Stats wet = updater.run(scratch, threads);
+	assert(wet.errors == 0);
+	assert(wet.changed == dry.changed);
+
+	unsigned long files = 0;
+	for (auto const &e : fs::recursive_directory_iterator(scratch)) {
+		struct stat st;
+		assert(lstat(e.path().c_str(), &st) == 0);
+		assert((st.st_mode & 07777) == (S_ISDIR(st.st_mode) ? 0750u : 0640u));
+		assert(st.st_mtim.tv_sec == mtime.tv_sec);
+		if (!S_ISDIR(st.st_mode))
+			++files;
+	}
+
+	/* Everything already matches now, so nothing should be changed again */
+	ffd::BulkMetadataUpdater::Stats again = updater.run(scratch, threads);
+	assert(again.changed == 0);
+	assert(again.unchanged == wet.examined);
+
+	/* Symlinks are never followed, so a file outside the tree keeps its mode */
+	fs::path outside = scratch.string() + ".outside";
+	{ std::ofstream touch(outside); }
+	fs::permissions(outside, fs::perms(0600));
+	fs::create_symlink(outside, scratch / "link");
+	assert(updater.run(scratch, threads).errors == 0);
+	assert(fs::status(outside).permissions() == fs::perms(0600));
+	fs::remove(outside);
+
+	fs::remove_all(scratch);
+
+	std::cout << files << std::endl;
+
+	return 0;
+}
+
+/**
+ * @endcode
+ *
+ */
@@ -0,0 +1,95 @@
+/**
+ * @code
+ */
+
+#include <45d/MTDirCrawler.hpp>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+namespace fs = std::filesystem;
+
+void usage(void) {
+	std::cout << "cancel-progress /path/ pattern [# threads]" << std::endl;
+}
+
+bool recurse(const fs::directory_entry &e) {
+	return e.is_directory() && !e.is_symlink();
+}
+
+int main(int argc, char *argv[]) {
+	int threads;
+	if (argc == 3) {
+		threads = 8;
+	} else if (argc == 4) {
+		try {
+			threads = std::stoi(argv[3]);
+		} catch (const std::invalid_argument &) {
+			usage();
+			exit(1);
+		}
+	} else {
+		usage();
+		exit(1);
+	}
+	std::string path = argv[1];
+	ffd::MTDirCrawler crawler{};
+
+	/* A full crawl, watching progress from this thread while it runs */
+	std::atomic<unsigned long> files(0);
+	crawler.set_count_bytes(true);
+	crawler.crawl_async(
+		path,
+		[&files](const fs::directory_entry &e) {
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+			if (!e.is_directory())
+				++files;
+			return recurse(e);
+		},
+		threads);
+	unsigned long last_seen = 0;
+	ffd::MTDirCrawler::Progress p;
+	do {
+		p = crawler.progress();
+		assert(p.entries_seen >= last_seen);
+		last_seen = p.entries_seen;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	} while (p.entries_seen < files + 1 || p.pending != 0);
+	crawler.wait();
+	p = crawler.progress();
+	assert(!crawler.cancelled());
+	assert(p.pending == 0);
+	assert(p.entries_seen == files + p.dirs_completed);
+	assert(p.bytes_seen == 0); // every file in the test environment is empty
+
+	/* Cancel from inside the callback after a handful of entries */
+	std::atomic<unsigned long> seen(0);
+	crawler.crawl(
+		path,
+		[&](const fs::directory_entry &e) {
+			if (++seen == 10)
+				crawler.cancel();
+			return recurse(e);
+		},
+		threads);
+	assert(crawler.cancelled());
+	assert(crawler.progress().entries_seen < p.entries_seen);
+
+	/* A deadline that has already passed stops the crawl before it gets going */
+	crawler.set_deadline(std::chrono::steady_clock::now());
+	crawler.crawl(path, recurse, threads);
+	assert(crawler.cancelled());
+	assert(crawler.progress().entries_seen <= (unsigned long)threads);
+	crawler.clear_deadline();
+
+	std::cout << files << std::endl;
+
+	return 0;
+}
+
+/**
+ * @endcode
+ *
+ */
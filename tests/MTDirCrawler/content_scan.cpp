@@ -0,0 +1,161 @@
+/**
+ * @code
+ */
+
+#include <45d/MTDirCrawler.hpp>
+#include <45d/crawler/ContentScanner.hpp>
+#include <atomic>
+#include <cassert>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sys/resource.h>
+namespace fs = std::filesystem;
+
+void usage(void) {
+	std::cout << "content-scan /path/ pattern [# threads]" << std::endl;
+}
+
+/* @brief Crawl callback, accepting every regular file for scanning
+ *
+ * @param e Directory entry passed to callback from MTDirCrawler
+ * @return true if e is a file (scan it) or a directory that is not a symlink (recurse in)
+ */
+bool callback(const fs::directory_entry &e) {
+	return !fs::is_symlink(e);
+}
+
+/* @brief Build a scratch tree from the layout of the test environment, giving every file
+ * content to search through
+ *
+ * Each file gets a line containing "secret" and "token" somewhere past a run of filler, and
+ * every tenth file is big enough to be mmap()ed instead of read().
+ */
+void make_scratch(const fs::path &src, const fs::path &dst) {
+	int i = 0;
+	for (auto const &e : fs::recursive_directory_iterator(src)) {
+		fs::path target = dst / fs::relative(e.path(), src);
+		if (e.is_directory()) {
+			fs::create_directories(target);
+			continue;
+		}
+		std::ofstream f(target);
+		size_t filler = (i++ % 10 == 0) ? ffd::ContentScan::_mmap_min : 100 + i;
+		f << std::string(filler, 'x') << "\n"
+		  << "the secret is " << i << " token\n"
+		  << "end\n";
+	}
+}
+
+/* @brief Get the address space in use, from /proc/self/status
+ */
+size_t vm_size(void) {
+	std::ifstream status("/proc/self/status");
+	std::string key;
+	size_t kb = 0;
+	while (status >> key) {
+		if (key == "VmSize:") {
+			status >> kb;
+			break;
+		}
+	}
+	return kb * 1024;
+}
+
+/* @brief Scan a file too big to map under a lowered address space limit, so the scanner
+ * reads it in chunks instead. The file is a 1 GiB hole with no newline until the matching
+ * line at its end, so the unfinished line can't be carried from chunk to chunk.
+ */
+void check_stream(const fs::path &dir) {
+	const size_t size = 1UL << 30;
+	const std::string tail = "\nthe secret is big token\n";
+	fs::path big = dir / "big";
+	{
+		std::ofstream f(big);
+		f.seekp(size - tail.length());
+		f << tail;
+	}
+	struct rlimit old_limit;
+	getrlimit(RLIMIT_AS, &old_limit);
+	struct rlimit limit = old_limit;
+	limit.rlim_cur = vm_size() + (256UL << 20);
+	setrlimit(RLIMIT_AS, &limit);
+	std::atomic<size_t> literal_offset(0);
+	std::atomic<size_t> glob_offset(0);
+	{
+		ffd::ContentScanner scanner({ "secret", "secret is ?* token" },
+									[&](const std::string &, size_t pattern, size_t offset) {
+										if (pattern == 0)
+											literal_offset = offset;
+										else
+											glob_offset = offset;
+									},
+									1);
+		scanner.submit(big.string());
+		scanner.finish();
+	}
+	setrlimit(RLIMIT_AS, &old_limit);
+	assert(literal_offset == size - tail.length() + 5);
+	assert(glob_offset == size - tail.length() + 1);
+	fs::remove(big);
+}
+
+int main(int argc, char *argv[]) {
+	int threads;
+	if (argc == 3) {
+		threads = 8;
+	} else if (argc == 4) {
+		try {
+			threads = std::stoi(argv[3]);
+		} catch (const std::invalid_argument &) {
+			usage();
+			exit(1);
+		}
+	} else {
+		usage();
+		exit(1);
+	}
+	std::string path = argv[1];
+	char scratch_template[] = "/tmp/content_scan.XXXXXX";
+	fs::path scratch = mkdtemp(scratch_template);
+	make_scratch(path, scratch);
+
+	std::atomic<unsigned long> literal_count(0);
+	std::atomic<unsigned long> glob_count(0);
+	std::atomic<unsigned long> miss_count(0);
+	{
+		/* Scanner threads run alongside the crawler threads, fed through the wrapped
+		 * callback, and call back once per matching file and pattern.
+		 */
+		ffd::ContentScanner scanner({ "secret", "secret is ?* token", "not there" },
+									[&](const std::string &, size_t pattern, size_t) {
+										if (pattern == 0)
+											++literal_count;
+										else if (pattern == 1)
+											++glob_count;
+										else
+											++miss_count;
+									},
+									threads);
+		ffd::MTDirCrawler crawler{};
+		crawler.crawl(scratch, scanner.wrap(callback), threads);
+		scanner.finish();
+	}
+
+	check_stream(scratch);
+
+	fs::remove_all(scratch);
+
+	assert(literal_count == glob_count);
+	assert(miss_count == 0);
+
+	std::cout << glob_count << std::endl;
+
+	return 0;
+}
+
+/**
+ * @endcode
+ *
+ */
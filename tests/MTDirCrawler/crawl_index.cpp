@@ -0,0 +1,161 @@
+/**
+ * @code
+ */
+
+#include <45d/MTDirCrawler.hpp>
+#include <45d/crawler/CrawlIndex.hpp>
+#include <cassert>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+namespace fs = std::filesystem;
+
+void usage(void) {
+	std::cout << "crawl-index /path/ pattern [# threads]" << std::endl;
+}
+
+/* @brief Recurse into every directory that is not a symlink
+ *
+ * @param e Directory entry passed to callback from MTDirCrawler
+ * @return true if e is a directory and is not a symlink (recurse in)
+ * @return false if e is a file or special file (do not recurse)
+ */
+bool callback(const fs::directory_entry &e) {
+	return fs::is_directory(e) && !fs::is_symlink(e);
+}
+
+/* @brief Write a damaged copy of an index and check that opening it or reading every record
+ * through it is refused
+ *
+ * @param bytes Contents of a good index
+ * @param path Where to write the damaged copy
+ * @param damage Edits the copy
+ */
+void expect_corrupt(const std::string &bytes,
+					const std::string &path,
+					const std::function<void(std::string &)> &damage) {
+	std::string copy = bytes;
+	damage(copy);
+	std::ofstream(path, std::ios::binary) << copy;
+	bool refused = false;
+	try {
+		ffd::CrawlIndexReader bad(path);
+		std::vector<uint32_t> res;
+		bad.find_size(0, UINT64_MAX, res);
+		for (uint32_t i : res)
+			bad.path(i);
+	} catch (const ffd::CrawlIndexException &) {
+		refused = true;
+	}
+	assert(refused);
+	unlink(path.c_str());
+}
+
+int main(int argc, char *argv[]) {
+	int threads;
+	if (argc == 3) {
+		threads = 8;
+	} else if (argc == 4) {
+		try {
+			threads = std::stoi(argv[3]);
+		} catch (const std::invalid_argument &) {
+			usage();
+			exit(1);
+		}
+	} else {
+		usage();
+		exit(1);
+	}
+	std::string path = argv[1];
+	while (path.length() > 1 && path.back() == '/')
+		path.pop_back();
+	std::string pattern = argv[2];
+	std::string index_path = path + ".idx";
+
+	/* Wrap the crawl callback with the index writer so every entry is recorded,
+	 * then write the index out once the crawl is done.
+	 */
+	ffd::CrawlIndexWriter writer(index_path);
+	ffd::MTDirCrawler crawler{};
+	crawler.crawl(path, writer.wrap(callback), threads);
+	writer.finish();
+
+	ffd::CrawlIndexReader reader(index_path);
+	assert(reader.size() == writer.size());
+
+	std::vector<uint32_t> res;
+	reader.find_prefix(path, res);
+	assert(res.size() == reader.size());
+	for (uint32_t i : res) {
+		assert(fs::exists(fs::symlink_status(reader.path(i))));
+		assert(reader.record(i).end <= reader.size());
+	}
+
+	reader.find_prefix(path + "/2/", res);
+	assert(!res.empty());
+	for (uint32_t i : res)
+		assert(reader.path(i).compare(0, path.length() + 3, path + "/2/") == 0);
+
+	/* Looking up every directory by path walks the name index down to it */
+	reader.find_prefix(path, res);
+	for (uint32_t i : res) {
+		if (!S_ISDIR(reader.record(i).mode))
+			continue;
+		std::vector<uint32_t> subtree;
+		reader.find_prefix(reader.path(i) + "/", subtree);
+		assert(subtree.size() == reader.record(i).end - i - 1);
+	}
+
+	reader.find_size(0, 0, res);
+	for (uint32_t i : res)
+		assert(reader.record(i).size == 0);
+
+	std::vector<uint32_t> all_mtime;
+	reader.find_mtime(INT64_MIN, INT64_MAX, all_mtime);
+	assert(all_mtime.size() == reader.size());
+
+	unsigned long count = 0;
+	reader.find_name(pattern, res);
+	for (uint32_t i : res) {
+		if (!S_ISDIR(reader.record(i).mode))
+			++count;
+	}
+
+	/* Damaged indices are refused when opened or when a query reaches the damage, rather
+	 * than read out of bounds
+	 */
+	std::ifstream in(index_path, std::ios::binary);
+	std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	const ffd::CrawlIndex::Header *header =
+		reinterpret_cast<const ffd::CrawlIndex::Header *>(bytes.data());
+	size_t last = header->records_off + (reader.size() - 1) * sizeof(ffd::CrawlIndex::Record);
+	std::string bad_path = index_path + ".bad";
+	expect_corrupt(bytes, bad_path, [](std::string &b) {
+		reinterpret_cast<ffd::CrawlIndex::Header *>(&b[0])->record_count = UINT64_MAX / 8;
+	});
+	expect_corrupt(bytes, bad_path, [last](std::string &b) {
+		reinterpret_cast<ffd::CrawlIndex::Record *>(&b[last])->name_off = UINT64_MAX;
+	});
+	expect_corrupt(bytes, bad_path, [last](std::string &b) {
+		reinterpret_cast<ffd::CrawlIndex::Record *>(&b[last])->parent = UINT32_MAX - 1;
+	});
+	expect_corrupt(bytes, bad_path, [last](std::string &b) {
+		reinterpret_cast<ffd::CrawlIndex::Record *>(&b[last])->end = 0;
+	});
+	expect_corrupt(bytes, bad_path, [header](std::string &b) {
+		reinterpret_cast<uint32_t *>(&b[header->size_index_off])[0] = UINT32_MAX;
+	});
+
+	unlink(index_path.c_str());
+
+	std::cout << count << std::endl;
+
+	return 0;
+}
+
+/**
+ * @endcode
+ *
+ */
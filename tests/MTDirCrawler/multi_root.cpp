@@ -0,0 +1,77 @@
+/**
+ * @code
+ */
+
+#include <45d/MTDirCrawler.hpp>
+#include <45d/low_overhead_string.hpp>
+#include <atomic>
+#include <cassert>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <vector>
+namespace fs = std::filesystem;
+
+void usage(void) {
+	std::cout << "multi-root /path/ pattern [# threads]" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+	int threads;
+	if (argc == 3) {
+		threads = 8;
+	} else if (argc == 4) {
+		try {
+			threads = std::stoi(argv[3]);
+		} catch (const std::invalid_argument &) {
+			usage();
+			exit(1);
+		}
+	} else {
+		usage();
+		exit(1);
+	}
+	std::string path = argv[1];
+	std::string pattern = argv[2];
+
+	/* Overlapping roots: the whole tree, a subtree nested in it, the whole tree again,
+	 * and a symlink leading into another of its subtrees
+	 */
+	char scratch_template[] = "/tmp/multi_root.XXXXXX";
+	fs::path scratch = mkdtemp(scratch_template);
+	fs::create_directory_symlink(fs::absolute(path) / "3", scratch / "link");
+	std::vector<fs::path> roots = { path, fs::path(path) / "2", path, scratch / "link" };
+	std::vector<std::atomic<unsigned long>> per_root(roots.size());
+	std::atomic<unsigned long> count(0);
+
+	ffd::MTDirCrawler crawler{};
+	crawler.crawl(
+		roots,
+		[&](const fs::directory_entry &e, size_t root) {
+			if (!fs::is_directory(e)) {
+				++per_root[root];
+				if (ffd::pattern_match(e.path().c_str(), pattern.c_str()))
+					++count;
+				return false;
+			}
+			if (root == 0)
+				assert(e.path().string().find(path + "/2/") != 0);
+			return true; // follow the symlink root, overlap detection stops repeats
+		},
+		threads);
+
+	fs::remove_all(scratch);
+
+	assert(per_root[1] > 0);
+	assert(per_root[2] == 0);
+	assert(per_root[0] + per_root[1] + per_root[3] == count);
+
+	std::cout << count << std::endl;
+
+	return 0;
+}
+
+/**
+ * @endcode
+ *
+ */
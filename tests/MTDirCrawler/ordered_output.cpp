@@ -0,0 +1,80 @@
+/**
+ * @code
+ */
+
+#include <45d/crawler/OrderedDirCrawler.hpp>
+#include <algorithm>
+#include <cassert>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+namespace fs = std::filesystem;
+
+void usage(void) {
+	std::cout << "ordered-output /path/ pattern [# threads]" << std::endl;
+}
+
+std::vector<fs::path> ordered_crawl(const fs::path &path, int threads, size_t max_buffered) {
+	std::vector<fs::path> out;
+	ffd::OrderedDirCrawler crawler(threads, max_buffered);
+	crawler.crawl(path, [&out](const fs::directory_entry &e) { out.push_back(e.path()); });
+	if (max_buffered < 16)
+		assert(crawler.peak_buffered() < 200);
+	return out;
+}
+
+int main(int argc, char *argv[]) {
+	int threads;
+	if (argc == 3) {
+		threads = 8;
+	} else if (argc == 4) {
+		try {
+			threads = std::stoi(argv[3]);
+		} catch (const std::invalid_argument &) {
+			usage();
+			exit(1);
+		}
+	} else {
+		usage();
+		exit(1);
+	}
+	fs::path path = argv[1];
+
+	/* Expected order: every path sorted element by element */
+	std::vector<fs::path> expected = { path };
+	for (const fs::directory_entry &e : fs::recursive_directory_iterator(path))
+		expected.push_back(e.path());
+	std::sort(expected.begin(), expected.end());
+
+	/* Same order every run, whatever the thread count or buffer size */
+	assert(ordered_crawl(path, threads, 65536) == expected);
+	assert(ordered_crawl(path, threads + 3, 1) == expected);
+	assert(ordered_crawl(path, 1, 8) == expected);
+
+	/* Pruning with the recursion predicate */
+	unsigned long files = 0;
+	ffd::OrderedDirCrawler crawler(threads);
+	crawler.crawl(
+		path,
+		[&files](const fs::directory_entry &e) {
+			if (!e.is_directory())
+				++files;
+		},
+		[](const fs::directory_entry &e) {
+			return e.is_directory() && !e.is_symlink() && e.path().filename() != "2";
+		});
+	assert(files < expected.size());
+
+	files = 0;
+	for (const fs::path &p : expected)
+		if (!fs::is_directory(p))
+			++files;
+	std::cout << files << std::endl;
+
+	return 0;
+}
+
+/**
+ * @endcode
+ *
+ */
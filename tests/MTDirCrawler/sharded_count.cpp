@@ -0,0 +1,78 @@
+/**
+ * @code
+ */
+
+#include <45d/crawler/ShardedCrawl.hpp>
+#include <45d/low_overhead_string.hpp>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+namespace fs = std::filesystem;
+
+void usage(void) {
+	std::cout << "sharded-count /path/ pattern [# workers]" << std::endl;
+}
+
+/* @brief The worker callback, sending back the path of each matching file
+ *
+ * @param e Directory entry passed to callback from ShardedCrawlWorker
+ * @param record Record to send back to the coordinator, left empty to send nothing
+ * @param comp The pattern to match against passed via std::bind()
+ * @return true if e is a directory and is not a symlink (recurse in)
+ * @return false if e is a file or special file (do not recurse)
+ */
+bool callback(const fs::directory_entry &e, std::string &record, const char *comp) {
+	if (!fs::is_directory(e)) {
+		if (ffd::pattern_match(e.path().c_str(), comp))
+			record = e.path().string();
+		return false;
+	}
+	return !fs::is_symlink(e);
+}
+
+int main(int argc, char *argv[]) {
+	int workers;
+	if (argc == 3) {
+		workers = 4;
+	} else if (argc == 4) {
+		try {
+			workers = std::stoi(argv[3]);
+		} catch (const std::invalid_argument &) {
+			usage();
+			exit(1);
+		}
+	} else {
+		usage();
+		exit(1);
+	}
+	if (workers < 2)
+		workers = 2; // always exercise rebalancing between shards
+	std::string path = argv[1];
+	std::string pattern = argv[2];
+	const char *socket_path = "sharded_count.socket";
+	unlink(socket_path);
+
+	unsigned long count = 0;
+	try {
+		/* Create the coordinator first so its socket exists, fork the workers,
+		 * then crawl, counting the paths the workers send back.
+		 */
+		ffd::ShardedCrawlCoordinator coordinator(socket_path, workers);
+		coordinator.spawn_workers(
+			workers,
+			std::bind(callback, std::placeholders::_1, std::placeholders::_2, pattern.c_str()));
+		coordinator.run({ path }, [&count](const std::string &) { ++count; });
+	} catch (const ffd::Exception &e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
+	std::cout << count << std::endl;
+
+	return 0;
+}
+
+/**
+ * @endcode
+ *
+ */
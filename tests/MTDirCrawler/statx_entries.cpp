@@ -0,0 +1,85 @@
+/**
+ * @code
+ */
+
+#include <45d/MTDirCrawler.hpp>
+#include <atomic>
+#include <cassert>
+#include <filesystem>
+#include <iostream>
+namespace fs = std::filesystem;
+
+void usage(void) {
+	std::cout << "statx-entries /path/ pattern [# threads]" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+	int threads;
+	if (argc == 3) {
+		threads = 8;
+	} else if (argc == 4) {
+		try {
+			threads = std::stoi(argv[3]);
+		} catch (const std::invalid_argument &) {
+			usage();
+			exit(1);
+		}
+	} else {
+		usage();
+		exit(1);
+	}
+	std::string path = argv[1];
+	ffd::MTDirCrawler crawler{};
+
+	/* Type and size come from the single statx() the crawler does per entry */
+	std::atomic<unsigned long> files(0);
+	std::atomic<unsigned long long> bytes(0);
+	crawler.set_count_bytes(true);
+	crawler.crawl(
+		path,
+		STATX_SIZE | STATX_MTIME,
+		[&files, &bytes](const ffd::CrawlEntry &e) {
+			assert(e.has(STATX_TYPE));
+			assert(e.is_dir() == (fs::is_directory(e.symlink_status())));
+			assert(e.is_link() == fs::is_symlink(e.symlink_status()));
+			assert(e.mtime().tv_sec != 0);
+			if (e.is_file()) {
+				assert(e.size() == fs::file_size(e.path()));
+				bytes += e.size();
+			}
+			if (!e.is_dir())
+				++files;
+			return e.is_dir();
+		},
+		threads);
+	assert(crawler.progress().bytes_seen == bytes);
+
+	/* STATX_TYPE alone is answered from readdir() without a statx(); other fields fall back
+	 * to lstat()
+	 */
+	std::atomic<unsigned long> type_only_files(0);
+	crawler.crawl(
+		path,
+		0,
+		[&type_only_files](const ffd::CrawlEntry &e) {
+			assert(e.has(STATX_TYPE));
+			assert(e.is_dir() == (fs::is_directory(e.symlink_status())));
+			assert(e.is_link() == fs::is_symlink(e.symlink_status()));
+			if (e.is_file())
+				assert(e.size() == fs::file_size(e.path()));
+			if (!e.is_dir())
+				++type_only_files;
+			return e.is_dir();
+		},
+		threads);
+	assert(type_only_files == files);
+
+	std::cout << files << std::endl;
+
+	return 0;
+}
+
+/**
+ * @endcode
+ *
+ */
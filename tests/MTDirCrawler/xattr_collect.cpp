@@ -0,0 +1,95 @@
+/**
+ * @code
+ */
+
+#include <45d/MTDirCrawler.hpp>
+#include <45d/crawler/XattrCollector.hpp>
+#include <atomic>
+#include <cassert>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <set>
+namespace fs = std::filesystem;
+
+void usage(void) {
+	std::cout << "xattr-collect /path/ pattern [# threads]" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+	int threads;
+	if (argc == 3) {
+		threads = 8;
+	} else if (argc == 4) {
+		try {
+			threads = std::stoi(argv[3]);
+		} catch (const std::invalid_argument &) {
+			usage();
+			exit(1);
+		}
+	} else {
+		usage();
+		exit(1);
+	}
+	std::string path = argv[1];
+	char scratch_template[] = "/tmp/xattr_collect.XXXXXX";
+	fs::path scratch = mkdtemp(scratch_template);
+	fs::copy(path, scratch, fs::copy_options::recursive);
+
+	/* Tag every file, and give every entry the same "ACL" blob */
+	const std::string acl(200, 'A');
+	for (auto const &e : fs::recursive_directory_iterator(scratch)) {
+		if (setxattr(e.path().c_str(), "user.acl", acl.data(), acl.length(), 0) == -1
+			|| (!e.is_directory() && setxattr(e.path().c_str(), "user.tag", "file", 4, 0) == -1)) {
+			perror("setxattr");
+			return 1;
+		}
+	}
+
+	std::atomic<unsigned long> tagged(0);
+	std::mutex mt;
+	std::set<const std::string *> acl_values;
+	ffd::XattrCollector collector({ "user.*" }, { "user.acl" });
+	ffd::MTDirCrawler crawler{};
+	crawler.crawl(scratch,
+				  collector.wrap([&](const fs::directory_entry &e,
+									 const ffd::XattrCollector::xattr_list &attrs) {
+					  for (const ffd::XattrCollector::Xattr &attr : attrs) {
+						  if (*attr.name == "user.tag" && *attr.value == "file") {
+							  ++tagged;
+						  } else if (*attr.name == "user.acl") {
+							  assert(*attr.value == acl);
+							  std::lock_guard<std::mutex> lk(mt);
+							  acl_values.insert(attr.value.get());
+						  }
+					  }
+					  return e.is_directory() && !e.is_symlink();
+				  }),
+				  threads);
+
+	/* Identical blobs are shared, so only one copy exists */
+	assert(acl_values.size() == 1);
+	assert(collector.unique_blobs() == 1);
+	assert(collector.shared_hits() > 0);
+
+	/* Two distinct shared values don't fit a table of one */
+	ffd::XattrCollector bounded({ "user.*" }, { "user.*" }, 1);
+	crawler.crawl(scratch,
+				  bounded.wrap([](const fs::directory_entry &e,
+								  const ffd::XattrCollector::xattr_list &) {
+					  return e.is_directory() && !e.is_symlink();
+				  }),
+				  threads);
+	assert(bounded.unique_blobs() <= 1);
+
+	fs::remove_all(scratch);
+
+	std::cout << tagged << std::endl;
+
+	return 0;
+}
+
+/**
+ * @endcode
+ *
+ */
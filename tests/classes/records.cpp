@@ -0,0 +1,70 @@
+#include <45d/socket/RecordCodec.hpp>
+#include <cassert>
+#include <iostream>
+#include <string>
+
+void test_round_trip(void) {
+	ffd::RecordEncoder enc;
+	std::string binary("a\0b\x1E", 4);
+	enc.add("hello").add(binary).add((int64_t)-42).add(ffd::Bytes("1 MiB")).add("");
+	const std::string &msg = enc.encode();
+
+	ffd::RecordView view(msg.data(), msg.size());
+	std::cout << "asserting 5 fields decoded in place" << std::endl;
+	assert(view.size() == 5);
+	assert(view.type(0) == ffd::Records::STRING);
+	assert(std::string(view.string(0).data(), view.string(0).size()) == "hello");
+	assert(std::string(view.string(1).data(), view.string(1).size()) == binary);
+	assert(view.string(1).data() >= msg.data()
+		   && view.string(1).data() < msg.data() + msg.size()); // no copy
+	assert(view.type(2) == ffd::Records::INT64 && view.int64(2) == -42);
+	assert(view.type(3) == ffd::Records::BYTES && view.bytes(3).get() == 1024 * 1024);
+	assert(view.string(4).size() == 0); // trailing empty record survives
+	std::cout << "OK" << std::endl;
+
+	std::cout << "asserting wrong type and index throw" << std::endl;
+	bool threw = false;
+	try {
+		view.int64(0);
+	} catch (const ffd::RecordDecodeException &) {
+		threw = true;
+	}
+	assert(threw);
+	threw = false;
+	try {
+		view.string(5);
+	} catch (const ffd::RecordDecodeException &) {
+		threw = true;
+	}
+	assert(threw);
+	std::cout << "OK" << std::endl;
+
+	std::cout << "asserting encoder reuse and empty message" << std::endl;
+	enc.clear();
+	const std::string &empty = enc.encode();
+	assert(ffd::RecordView(empty.data(), empty.size()).size() == 0);
+	std::cout << "OK" << std::endl;
+}
+
+void test_malformed(void) {
+	ffd::RecordEncoder enc;
+	enc.add("some field").add((int64_t)7);
+	std::string msg = enc.encode();
+	std::cout << "asserting truncated messages are rejected" << std::endl;
+	for (size_t len = 0; len < msg.size(); ++len) {
+		bool threw = false;
+		try {
+			ffd::RecordView view(msg.data(), len);
+		} catch (const ffd::RecordDecodeException &) {
+			threw = true;
+		}
+		assert(threw);
+	}
+	std::cout << "OK" << std::endl;
+}
+
+int main() {
+	test_round_trip();
+	test_malformed();
+	return 0;
+}
@@ -0,0 +1,46 @@
+#include <45d/socket/TcpSocketClient.hpp>
+#include <fstream>
+#include <iostream>
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+int main(void) {
+	uint16_t port = 0;
+	for (int tries = 0; !(std::ifstream("test.port") >> port); ++tries) {
+		if (tries == 50) {
+			std::cerr << "server never started" << std::endl;
+			return -1;
+		}
+		usleep(100000); // server still starting
+	}
+
+	try {
+		for (int i = 0; i < 40; ++i) {
+			ffd::TcpSocketClient client("127.0.0.1", port);
+			client.set_buffer_sizes();
+			client.connect();
+			client.set_nodelay();
+			client.set_keepalive();
+
+			/* Partial segments are held back until uncorked */
+			client.set_cork(true);
+			client.send_data("Hello " + std::to_string(i), MSG_NOSIGNAL);
+			client.set_cork(false);
+
+			std::string reply;
+			client.receive_data_sync(reply);
+			if (i % 10 == 0)
+				std::cout << reply << std::endl;
+			client.close_connection();
+		}
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		return -1;
+	}
+	return 0;
+}
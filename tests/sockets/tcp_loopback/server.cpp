@@ -0,0 +1,87 @@
+#include <45d/socket/TcpSocketServer.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+#define ACCEPTORS 4
+#define CONNECTIONS 40
+
+std::mutex mutex;
+std::condition_variable cv;
+int served = 0;
+
+/* Each acceptor thread serves the connections the kernel hands its own listening socket */
+void acceptor(ffd::TcpSocketServer *server, int *count) {
+	try {
+		for (;;) {
+			server->wait_for_connection();
+			std::string msg;
+			server->receive_data_sync(msg);
+			server->send_data("echo " + msg, MSG_NOSIGNAL);
+			server->close_connection();
+			++*count;
+			std::lock_guard<std::mutex> lk(mutex);
+			++served;
+			cv.notify_one();
+		}
+	} catch (const ffd::SocketAcceptException &) {
+		// listener shut down
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+	}
+}
+
+int main(void) {
+	std::vector<std::unique_ptr<ffd::TcpSocketServer>> servers;
+	try {
+		/* The first server picks a port, the rest share it */
+		servers.emplace_back(new ffd::TcpSocketServer("127.0.0.1", 0, 50, true));
+		uint16_t port = servers[0]->get_port();
+		for (int i = 1; i < ACCEPTORS; ++i)
+			servers.emplace_back(new ffd::TcpSocketServer("127.0.0.1", port, 50, true));
+		for (auto &server : servers) {
+			server->set_nodelay();
+			server->set_buffer_sizes();
+			server->close_connection(); // nothing accepted yet, the listener stays open
+		}
+		std::ofstream("test.port.tmp") << port << std::endl;
+		std::rename("test.port.tmp", "test.port");
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		return -1;
+	}
+
+	int counts[ACCEPTORS] = { 0 };
+	std::vector<std::thread> threads;
+	for (int i = 0; i < ACCEPTORS; ++i)
+		threads.emplace_back(acceptor, servers[i].get(), &counts[i]);
+	{
+		std::unique_lock<std::mutex> lk(mutex);
+		while (served < CONNECTIONS)
+			cv.wait(lk);
+	}
+	for (auto &server : servers)
+		server->shutdown();
+	for (std::thread &t : threads)
+		t.join();
+	std::remove("test.port");
+
+	int busy = 0;
+	for (int i = 0; i < ACCEPTORS; ++i)
+		busy += counts[i] > 0;
+	std::cout << served << " connections served" << std::endl;
+	std::cout << (busy > 1 ? "spread across acceptors" : "all on one acceptor") << std::endl;
+	return 0;
+}
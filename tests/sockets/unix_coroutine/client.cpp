@@ -0,0 +1,58 @@
+#include <45d/socket/SocketLoop.hpp>
+#include <45d/socket/UnixSocketClient.hpp>
+#include <atomic>
+#include <iostream>
+#include <memory>
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+#define SESSIONS 500
+#define ROUNDS 10
+
+std::atomic<int> good(0);
+
+ffd::Task<void> session(ffd::SocketLoop &loop, int id) {
+	ffd::UnixSocketClient client("test.socket");
+	client.set_framing(true);
+	for (int tries = 0;; ++tries) {
+		bool connected = true;
+		try {
+			co_await loop.connect(client);
+		} catch (const ffd::SocketConnectException &) {
+			if (tries == 50)
+				throw;
+			connected = false;
+		}
+		if (connected)
+			break;
+		usleep(100000); // server still starting
+	}
+	for (int i = 0; i < ROUNDS; ++i) {
+		std::string msg = std::to_string(id) + ":" + std::to_string(i);
+		co_await loop.send_data(client, msg, MSG_NOSIGNAL);
+		std::string reply = co_await loop.receive_data(client);
+		if (reply == "echo " + msg)
+			++good;
+	}
+	co_await loop.send_data(client, "EOF", MSG_NOSIGNAL);
+	client.close_connection();
+}
+
+int main(void) {
+	try {
+		ffd::SocketLoop loop;
+		for (int i = 0; i < SESSIONS; ++i)
+			loop.spawn(session(loop, i));
+		loop.run();
+		std::cout << good << " replies matched" << std::endl;
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,62 @@
+#include <45d/socket/SocketLoop.hpp>
+#include <45d/socket/UnixSocketServer.hpp>
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+#define SESSIONS 500
+
+std::atomic<int> messages(0);
+
+/* Reads like blocking code, but only suspends this session while waiting */
+ffd::Task<void> session(ffd::SocketLoop &loop, ffd::UnixSocketServer &server, int fd) {
+	for (;;) {
+		std::string msg = co_await loop.receive_data(server, 0, fd);
+		if (msg.empty() || msg == "EOF")
+			break;
+		++messages;
+		co_await loop.send_data(server, "echo " + msg, MSG_NOSIGNAL, fd);
+	}
+	server.close_connection(fd);
+}
+
+ffd::Task<void> acceptor(ffd::SocketLoop &loop, ffd::UnixSocketServer &server) {
+	for (int i = 0; i < SESSIONS; ++i) {
+		int fd = co_await loop.wait_for_connection(server);
+		loop.spawn(session(loop, server, fd));
+	}
+}
+
+int main(void) {
+	ffd::UnixSocketServer *server;
+
+	try {
+		server = new ffd::UnixSocketServer("test.socket", 500);
+		server->set_framing(true);
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+
+	try {
+		ffd::SocketLoop loop;
+		loop.spawn(acceptor(loop, *server));
+		std::thread helper([&loop]() { loop.run(); });
+		loop.run();
+		helper.join();
+		std::cout << messages << " messages served" << std::endl;
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		delete server;
+		return -1;
+	}
+	delete server;
+	return 0;
+}
@@ -0,0 +1,64 @@
+#include <45d/socket/UnixSocketClient.hpp>
+#include <iostream>
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+int main(void) {
+	ffd::UnixSocketClient *client;
+
+	try {
+		client = new ffd::UnixSocketClient("test.socket", SOCK_DGRAM);
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+
+	try {
+		for (int tries = 0;; ++tries) {
+			try {
+				client->connect(); // only sets the destination
+				break;
+			} catch (const ffd::SocketConnectException &) {
+				if (tries == 50)
+					throw;
+				usleep(100000); // server still starting
+			}
+		}
+
+		/* There is no connection to carry an ACK back, so sync sends are refused up front */
+		try {
+			client->send_data_sync("sync");
+		} catch (const ffd::SocketException &e) {
+			if (e.get_errno() == EINVAL)
+				std::cout << "sync refused" << std::endl;
+		}
+
+		/* Fire and forget, 100 datagrams per sendmmsg() */
+		size_t sent = 0;
+		std::vector<std::string> batch;
+		for (int i = 0; i < 10000; ++i) {
+			batch.push_back("cpu=" + std::to_string(i % 100) + " seq=" + std::to_string(i));
+			if (batch.size() == 100) {
+				client->send_batch(batch);
+				sent += batch.size();
+				batch.clear();
+			}
+		}
+		client->send_data_async("EOF");
+		std::cout << "sent " << sent << std::endl;
+
+		client->close_connection();
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		client->close_connection();
+		delete client;
+		return -1;
+	}
+	delete client;
+	return 0;
+}
@@ -0,0 +1,57 @@
+#include <45d/socket/UnixSocketServer.hpp>
+#include <iostream>
+
+extern "C" {
+#include <fcntl.h>
+}
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+int main(void) {
+	ffd::UnixSocketServer *server;
+
+	try {
+		server =
+			new ffd::UnixSocketServer("test.socket", ffd::Socket::_backlog_default, SOCK_DGRAM);
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+
+	try {
+		/* No connections to accept, datagrams are read from the server socket */
+		size_t count = 0;
+		bool in_order = true;
+		std::vector<ffd::BufferView> batch;
+		for (bool done = false; !done;) {
+			server->receive_batch(batch, 256);
+			for (const ffd::BufferView &message : batch) {
+				if (message == std::string("EOF")) {
+					done = true;
+					break;
+				}
+				if (message != "cpu=" + std::to_string(count % 100) + " seq="
+								   + std::to_string(count))
+					in_order = false;
+				++count;
+			}
+		}
+		std::cout << "received " << count << (in_order ? " in order" : " out of order")
+				  << std::endl;
+		/* No connection to close, this must leave the bound socket alone */
+		server->close_connection();
+		bool still_open = fcntl(server->get_fd(), F_GETFD) != -1;
+		std::cout << "socket " << (still_open ? "still open" : "closed") << std::endl;
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		delete server;
+		return -1;
+	}
+	delete server;
+	return 0;
+}
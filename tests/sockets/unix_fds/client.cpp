@@ -0,0 +1,88 @@
+#include <45d/socket/UnixSocketClient.hpp>
+#include <iostream>
+#include <sys/mman.h>
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+int main(void) {
+	ffd::UnixSocketClient *client;
+
+	try {
+		client = new ffd::UnixSocketClient("test.socket");
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+
+	int pipe_fds[2];
+	int mem_fd = memfd_create("unix_fds", 0);
+	if (pipe(pipe_fds) == -1 || mem_fd == -1) {
+		std::cerr << "pipe/memfd failed" << std::endl;
+		delete client;
+		return -1;
+	}
+	std::string contents = "Hello from memfd";
+	if (write(mem_fd, contents.data(), contents.size()) != (ssize_t)contents.size()) {
+		std::cerr << "write failed" << std::endl;
+		delete client;
+		return -1;
+	}
+
+	try {
+		for (int tries = 0;; ++tries) {
+			try {
+				client->connect();
+				break;
+			} catch (const ffd::SocketConnectException &) {
+				if (tries == 50)
+					throw;
+				usleep(100000); // server still starting
+			}
+		}
+
+		/* The server gets its own copies, ours can be closed right away */
+		client->send_fds(std::vector<int>{ pipe_fds[1], mem_fd }, "pipe and memfd");
+		close(pipe_fds[1]);
+		close(mem_fd);
+
+		std::string reply;
+		client->receive_data_async(reply);
+		std::cout << reply << std::endl;
+
+		/* Back to back, each message must arrive separately with its own descriptor */
+		for (const char *msg : { "first", "second" }) {
+			int dup_fd = dup(STDOUT_FILENO);
+			client->send_fds(std::vector<int>{ dup_fd }, msg);
+			close(dup_fd);
+		}
+
+		client->set_framing(true);
+		int dup_fd = dup(STDOUT_FILENO);
+		client->send_fds(std::vector<int>{ dup_fd }, "framed");
+		close(dup_fd);
+		client->send_fds(std::vector<int>{});
+
+		char buff[64];
+		ssize_t len = read(pipe_fds[0], buff, sizeof(buff));
+		close(pipe_fds[0]);
+		if (len > 0)
+			std::cout << std::string(buff, len) << std::endl;
+
+		client->receive_data_sync(reply);
+		std::cout << reply << std::endl;
+
+		client->close_connection();
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		client->close_connection();
+		delete client;
+		return -1;
+	}
+	delete client;
+	return 0;
+}
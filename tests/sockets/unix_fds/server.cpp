@@ -0,0 +1,72 @@
+#include <45d/socket/UnixSocketServer.hpp>
+#include <fcntl.h>
+#include <iostream>
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+int main(void) {
+	ffd::UnixSocketServer *server;
+
+	try {
+		server = new ffd::UnixSocketServer("test.socket");
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+
+	try {
+		server->wait_for_connection();
+
+		std::vector<int> fds;
+		std::string msg;
+		server->receive_fds(fds, msg);
+		std::cout << msg << ": " << fds.size() << " fds" << std::endl;
+		if (fds.size() != 2)
+			throw ffd::SocketReadException("Wrong number of fds", EBADMSG);
+		std::cout << "close-on-exec: " << ((fcntl(fds[0], F_GETFD) & FD_CLOEXEC) != 0)
+				  << std::endl;
+
+		char buff[64];
+		ssize_t len = pread(fds[1], buff, sizeof(buff), 0);
+		std::cout << std::string(buff, len > 0 ? len : 0) << std::endl;
+		close(fds[1]);
+		int pipe_fd = fds[0];
+		server->send_data_async("got fds");
+
+		usleep(100000); // let both back to back messages queue up
+		for (int i = 0; i < 2; ++i) {
+			server->receive_fds(fds, msg);
+			std::cout << msg << ": " << fds.size() << " fds" << std::endl;
+			for (int fd : fds)
+				close(fd);
+		}
+
+		server->set_framing(true);
+		server->receive_fds(fds, msg);
+		std::cout << msg << ": " << fds.size() << " fds" << std::endl;
+		for (int fd : fds)
+			close(fd);
+		server->receive_fds(fds, msg);
+		std::cout << "[" << msg << "]: " << fds.size() << " fds" << std::endl;
+
+		std::string reply = "Hello through pipe";
+		if (write(pipe_fd, reply.data(), reply.size()) != (ssize_t)reply.size())
+			std::cerr << "write failed" << std::endl;
+		close(pipe_fd);
+		server->send_data("done");
+
+		server->close_connection();
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		server->close_connection();
+		delete server;
+		return -1;
+	}
+	delete server;
+	return 0;
+}
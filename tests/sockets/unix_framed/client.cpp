@@ -0,0 +1,61 @@
+#include <45d/socket/UnixSocketClient.hpp>
+#include <iostream>
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+int main(void) {
+	ffd::UnixSocketClient *client;
+
+	try {
+		client = new ffd::UnixSocketClient("test.socket");
+		client->set_framing(true);
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+
+	try {
+		for (int tries = 0;; ++tries) {
+			try {
+				client->connect();
+				break;
+			} catch (const ffd::SocketConnectException &) {
+				if (tries == 50)
+					throw;
+				usleep(100000); // server still starting
+			}
+		}
+
+		/* Back to back without waiting for ACKs, boundaries must still hold */
+		client->send_data_async("Hello from client 1");
+		client->send_data_async("Hello from client 2");
+		client->send_data_async(std::string(4 * 1024 * 1024 + 3, 'x'));
+		client->send_data_async(std::vector<std::string>{ "record 1", "record 2", "record 3" });
+		std::vector<std::string> many;
+		for (int i = 0; i < 100000; ++i)
+			many.push_back(std::to_string(i));
+		client->send_data_async(many); // more records than IOV_MAX
+		client->send_data_async("Hello from client 3");
+		client->send_data_async("EOF");
+
+		std::string message;
+		do {
+			client->receive_data(message);
+			std::cout << message << std::endl;
+		} while (!message.empty() && message != "EOF");
+
+		client->close_connection();
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		client->close_connection();
+		delete client;
+		return -1;
+	}
+	delete client;
+	return 0;
+}
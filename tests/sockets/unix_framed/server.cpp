@@ -0,0 +1,68 @@
+#include <45d/socket/UnixSocketServer.hpp>
+#include <algorithm>
+#include <iostream>
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+int main(void) {
+	ffd::UnixSocketServer *server;
+
+	try {
+		server = new ffd::UnixSocketServer("test.socket");
+		server->set_framing(true);
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+
+	try {
+		server->wait_for_connection();
+
+		std::string message;
+		do {
+			server->receive_data_async(message);
+			if (message.size() > 100 && message[0] == '0') {
+				std::vector<std::string> records;
+				size_t start = 0, end;
+				while ((end = message.find(ffd::Socket::_rec_delim, start)) != std::string::npos) {
+					records.push_back(message.substr(start, end - start));
+					start = end + 1;
+				}
+				records.push_back(message.substr(start));
+				bool intact = true;
+				for (size_t i = 0; i < records.size(); ++i)
+					intact = intact && records[i] == std::to_string(i);
+				std::cout << records.size() << " records" << (intact ? "" : " corrupt")
+						  << std::endl;
+			} else if (message.size() > 100) {
+				bool intact =
+					std::count(message.begin(), message.end(), 'x') == (long)message.size();
+				std::cout << message.size() << " bytes" << (intact ? "" : " corrupt") << std::endl;
+			} else {
+				std::replace(message.begin(), message.end(), ffd::Socket::_rec_delim, ',');
+				std::cout << message << std::endl;
+			}
+		} while (!message.empty() && message != "EOF");
+
+		std::string messages[4] = {
+			"Hello from server 1", "Hello from server 2", "Hello from server 3", "EOF"
+		};
+		for (int i = 0; i < 4; i++) {
+			server->send_data(messages[i]);
+		}
+
+		server->close_connection();
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		server->close_connection();
+		delete server;
+		return -1;
+	}
+	delete server;
+	return 0;
+}
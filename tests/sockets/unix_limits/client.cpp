@@ -0,0 +1,78 @@
+#include <45d/socket/UnixSocketClient.hpp>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+const size_t idle_clients = 4;
+const size_t busy_clients = 36;
+
+void connect(ffd::UnixSocketClient &client) {
+	for (int tries = 0;; ++tries) {
+		try {
+			client.connect();
+			return;
+		} catch (const ffd::SocketConnectException &) {
+			if (tries == 50)
+				throw;
+			usleep(100000); // server still starting
+		}
+	}
+}
+
+int main(void) {
+	try {
+		/* Take every slot without sending anything, the server has to time these out
+		 * before it accepts anyone else */
+		std::vector<std::unique_ptr<ffd::UnixSocketClient>> idle;
+		for (size_t i = 0; i < idle_clients; ++i) {
+			idle.emplace_back(new ffd::UnixSocketClient("test.socket"));
+			connect(*idle.back());
+		}
+
+		std::atomic<int> matched(0);
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < busy_clients; ++i) {
+			threads.emplace_back([&, i]() {
+				try {
+					ffd::UnixSocketClient client("test.socket");
+					connect(client);
+					for (int round = 0; round < 5; ++round) {
+						std::string msg = std::to_string(i) + ":" + std::to_string(round);
+						std::string reply;
+						client.send_data_async(msg);
+						client.receive_data_async(reply);
+						if (reply == "echo: " + msg)
+							++matched;
+					}
+				} catch (const ffd::SocketException &e) {
+					std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+				}
+			});
+		}
+		for (std::thread &thread : threads)
+			thread.join();
+		std::cout << matched << " replies matched" << std::endl;
+
+		int closed = 0;
+		for (auto &client : idle) {
+			std::string msg;
+			client->receive_data_async(msg);
+			if (msg.empty())
+				++closed;
+		}
+		std::cout << closed << " idle connections closed by server" << std::endl;
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,84 @@
+#include <45d/socket/UnixSocketServer.hpp>
+#include <atomic>
+#include <dirent.h>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+const size_t clients = 40;
+const size_t max_connections = 4;
+
+size_t open_fds(void) {
+	size_t n = 0;
+	DIR *dir = opendir("/proc/self/fd");
+	while (readdir(dir) != nullptr)
+		++n;
+	closedir(dir);
+	return n;
+}
+
+int main(void) {
+	ffd::UnixSocketServer *server;
+
+	try {
+		server = new ffd::UnixSocketServer("test.socket");
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+
+	try {
+		server->set_max_connections(max_connections);
+		server->set_idle_timeout(200);
+		size_t fds_before = open_fds();
+		std::atomic<size_t> peak(0);
+		std::atomic<int> echoed(0);
+		std::vector<std::thread> threads;
+
+		/* One thread per connection, echoing until the client leaves or the server shuts down
+		 * its connection for going quiet */
+		for (size_t i = 0; i < clients; ++i) {
+			int fd = server->wait_for_connection();
+			size_t now = server->connections();
+			if (now > peak)
+				peak = now;
+			threads.emplace_back([&, fd]() {
+				std::string msg;
+				try {
+					for (;;) {
+						server->receive_data_async(msg, 0, fd);
+						if (msg.empty())
+							break;
+						server->send_data_async("echo: " + msg, 0, fd);
+						++echoed;
+					}
+				} catch (const ffd::SocketException &e) {
+					std::cerr << e.what() << std::endl;
+				}
+				server->close_connection(fd);
+			});
+		}
+		for (std::thread &thread : threads)
+			thread.join();
+
+		std::cout << "echoed " << echoed << " messages" << std::endl;
+		std::cout << "shut down " << server->idle_closed() << " idle connections" << std::endl;
+		std::cout << "peak connections " << (peak <= max_connections ? "within" : "over")
+				  << " limit" << std::endl;
+		std::cout << server->connections() << " connections open" << std::endl;
+		std::cout << (open_fds() == fds_before ? "no fds leaked" : "fds leaked") << std::endl;
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		delete server;
+		return -1;
+	}
+	delete server;
+	return 0;
+}
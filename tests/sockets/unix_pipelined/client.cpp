@@ -0,0 +1,56 @@
+#include <45d/socket/UnixSocketClient.hpp>
+#include <iostream>
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+int main(void) {
+	ffd::UnixSocketClient *client;
+
+	try {
+		client = new ffd::UnixSocketClient("test.socket");
+		client->set_framing(true);
+		client->set_window(32);
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+
+	try {
+		for (int tries = 0;; ++tries) {
+			try {
+				client->connect();
+				break;
+			} catch (const ffd::SocketConnectException &) {
+				if (tries == 50)
+					throw;
+				usleep(100000); // server still starting
+			}
+		}
+
+		/* Up to 32 messages in flight, acknowledged in batches */
+		for (int i = 0; i < 10000; ++i)
+			client->send_data_pipelined("message " + std::to_string(i));
+		client->send_data_pipelined(std::vector<std::string>{ "record 1", "record 2" });
+		client->send_data_pipelined("EOF");
+		client->flush_pipeline();
+		std::cout << "all acknowledged" << std::endl;
+
+		std::string message;
+		client->receive_data(message);
+		std::cout << message << std::endl;
+
+		client->close_connection();
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		client->close_connection();
+		delete client;
+		return -1;
+	}
+	delete client;
+	return 0;
+}
@@ -0,0 +1,54 @@
+#include <45d/socket/UnixSocketServer.hpp>
+#include <iostream>
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+int main(void) {
+	ffd::UnixSocketServer *server;
+
+	try {
+		server = new ffd::UnixSocketServer("test.socket");
+		server->set_framing(true);
+		server->set_ack_batch(16);
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+
+	try {
+		server->wait_for_connection();
+
+		int in_order = 0;
+		std::string message;
+		for (int i = 0; i < 10000; ++i) {
+			server->receive_data_pipelined(message);
+			if (message == "message " + std::to_string(i))
+				++in_order;
+		}
+		std::cout << in_order << " messages in order" << std::endl;
+
+		std::vector<std::string> vec;
+		server->receive_data_pipelined(vec);
+		for (const std::string &str : vec)
+			std::cout << str << std::endl;
+
+		server->receive_data_pipelined(message);
+		std::cout << message << std::endl;
+
+		server->send_data("Hello from server");
+
+		server->close_connection();
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		server->close_connection();
+		delete server;
+		return -1;
+	}
+	delete server;
+	return 0;
+}
@@ -0,0 +1,111 @@
+#include <45d/socket/UnixSocketPool.hpp>
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+const int threads = 8;
+const int requests = 250;
+const size_t max_per_path = 4;
+
+/* Read one newline terminated reply */
+std::string exchange(ffd::UnixSocketClient &client, const std::string &line) {
+	client.send_data_async(line + "\n");
+	std::string reply, chunk;
+	while (reply.empty() || reply.back() != '\n') {
+		client.receive_data_async(chunk);
+		if (chunk.empty())
+			throw ffd::SocketReadException("Connection closed", ECONNRESET);
+		reply += chunk;
+	}
+	reply.pop_back();
+	return reply;
+}
+
+int main(void) {
+	try {
+		ffd::UnixSocketPool pool(max_per_path);
+
+		/* Wait for the server */
+		for (int tries = 0;; ++tries) {
+			try {
+				ffd::UnixSocketPool::Lease lease = pool.acquire("test.socket");
+				break;
+			} catch (const ffd::SocketConnectException &) {
+				if (tries == 50)
+					throw;
+				usleep(100000);
+			}
+		}
+
+		/* More threads than connections, each lease is one short exchange */
+		std::atomic<int> matched(0);
+		std::atomic<size_t> in_use(0);
+		std::atomic<size_t> peak(0);
+		std::vector<std::thread> workers;
+		for (int t = 0; t < threads; ++t) {
+			workers.emplace_back([&, t]() {
+				for (int i = 0; i < requests; ++i) {
+					ffd::UnixSocketPool::Lease lease = pool.acquire("test.socket");
+					size_t now = ++in_use;
+					size_t prev = peak.load();
+					while (now > prev && !peak.compare_exchange_weak(prev, now))
+						;
+					std::string msg = std::to_string(t) + ":" + std::to_string(i);
+					if (exchange(*lease, msg) == "echo: " + msg)
+						++matched;
+					--in_use;
+				}
+			});
+		}
+		for (std::thread &worker : workers)
+			worker.join();
+		std::cout << matched << " replies matched" << std::endl;
+		std::cout << "peak leases " << (peak <= max_per_path ? "within" : "over") << " cap"
+				  << std::endl;
+		size_t idle = pool.idle("test.socket");
+		std::cout << "idle connections " << (idle <= max_per_path ? "within" : "over") << " cap"
+				  << std::endl;
+
+		/* A connection the server closed is replaced on the next acquire */
+		std::string closed_id;
+		{
+			ffd::UnixSocketPool::Lease lease = pool.acquire("test.socket");
+			closed_id = exchange(*lease, "who");
+			exchange(*lease, "bye");
+		}
+		usleep(100000); // let the server's close arrive
+		{
+			ffd::UnixSocketPool::Lease lease = pool.acquire("test.socket");
+			std::string id = exchange(*lease, "who");
+			std::cout << "closed connection " << (id != closed_id ? "replaced" : "reused")
+					  << std::endl;
+		}
+
+		/* Waiting for a slot times out while every connection is leased */
+		{
+			ffd::UnixSocketPool single(1);
+			ffd::UnixSocketPool::Lease held = single.acquire("test.socket");
+			try {
+				single.acquire("test.socket", 100);
+				std::cout << "acquired past cap" << std::endl;
+			} catch (const ffd::SocketConnectException &e) {
+				std::cout << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+			}
+		}
+
+		ffd::UnixSocketPool::Lease lease = pool.acquire("test.socket");
+		exchange(*lease, "stop");
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,60 @@
+#include <45d/socket/SocketReactor.hpp>
+#include <45d/socket/UnixSocketServer.hpp>
+#include <iostream>
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+int main(void) {
+	ffd::UnixSocketServer *server;
+
+	try {
+		server = new ffd::UnixSocketServer("test.socket");
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+
+	try {
+		size_t served = 0;
+		ffd::SocketReactor *reactor_ptr = nullptr;
+		ffd::SocketReactor::Handlers handlers;
+		/* Echo lines. "who" answers with the connection id, "bye" replies then closes the
+		 * connection and "stop" replies then ends the server. */
+		handlers.on_data = [&](ffd::SocketReactor::Connection &connection) {
+			std::string &in = connection.input();
+			size_t end;
+			while ((end = in.find('\n')) != std::string::npos) {
+				std::string line = in.substr(0, end);
+				in.erase(0, end + 1);
+				if (line == "who") {
+					connection.send(std::to_string(connection.id()) + "\n");
+				} else if (line == "bye") {
+					connection.send("bye\n");
+					connection.close();
+				} else if (line == "stop") {
+					connection.send("stopping\n");
+					reactor_ptr->stop();
+				} else {
+					connection.send("echo: " + line + "\n");
+					++served;
+				}
+			}
+		};
+		ffd::SocketReactor reactor(*server, handlers);
+		reactor_ptr = &reactor;
+		reactor.run();
+
+		std::cout << "served " << served << " requests" << std::endl;
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		delete server;
+		return -1;
+	}
+	delete server;
+	return 0;
+}
@@ -0,0 +1,70 @@
+#include <45d/socket/UnixSocketClient.hpp>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+const size_t clients = 500;
+const size_t closers = 20;
+
+int main(void) {
+	std::vector<std::unique_ptr<ffd::UnixSocketClient>> conns;
+
+	try {
+		/* Hold every connection open at once so one server thread has to juggle them */
+		for (size_t i = 0; i < clients; ++i) {
+			conns.emplace_back(new ffd::UnixSocketClient("test.socket"));
+			for (int tries = 0;; ++tries) {
+				try {
+					conns.back()->connect();
+					break;
+				} catch (const ffd::SocketConnectException &) {
+					if (tries == 50)
+						throw;
+					usleep(100000); // server still starting
+				}
+			}
+		}
+		for (size_t i = 0; i < clients; ++i)
+			conns[i]->send_data_async("Hello from client " + std::to_string(i) + "\n");
+
+		size_t replies = 0;
+		for (size_t i = 0; i < clients; ++i) {
+			std::string reply, chunk;
+			while (reply.empty() || reply.back() != '\n') {
+				conns[i]->receive_data_async(chunk);
+				if (chunk.empty())
+					break;
+				reply += chunk;
+			}
+			if (reply == "echo: Hello from client " + std::to_string(i) + "\n")
+				++replies;
+			else
+				std::cout << "bad reply: " << reply << std::endl;
+		}
+		std::cout << replies << " replies" << std::endl;
+
+		for (size_t i = 0; i < clients; ++i)
+			conns[i]->close_connection();
+
+		/* Send a last message and close right away, the first one too big for one event */
+		for (size_t i = 0; i < closers; ++i) {
+			ffd::UnixSocketClient closer("test.socket");
+			closer.connect();
+			size_t len = i == 0 ? 4 * 1024 * 1024 : i * 100;
+			closer.send_data_async("Goodbye " + std::to_string(len) + " " + std::string(len, 'x')
+								   + "\n");
+			closer.close_connection();
+		}
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		return -1;
+	}
+	return 0;
+}
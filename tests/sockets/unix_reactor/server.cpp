@@ -0,0 +1,72 @@
+#include <45d/socket/SocketReactor.hpp>
+#include <45d/socket/UnixSocketServer.hpp>
+#include <iostream>
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+const size_t clients = 500;
+const size_t closers = 20;
+
+int main(void) {
+	ffd::UnixSocketServer *server;
+
+	try {
+		server = new ffd::UnixSocketServer("test.socket", clients);
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+
+	try {
+		size_t closed = 0;
+		size_t peak = 0;
+		size_t goodbyes = 0;
+		ffd::SocketReactor *reactor_ptr = nullptr;
+		ffd::SocketReactor::Handlers handlers;
+		handlers.on_connect = [&](ffd::SocketReactor::Connection &) {
+			if (reactor_ptr->connections() > peak)
+				peak = reactor_ptr->connections();
+		};
+		/* Echo back each complete line, leaving partial lines in the input buffer. Goodbye
+		 * lines come from clients that close right after sending, so only check them.
+		 */
+		handlers.on_data = [&](ffd::SocketReactor::Connection &connection) {
+			std::string &in = connection.input();
+			size_t end;
+			while ((end = in.find('\n')) != std::string::npos) {
+				std::string line = in.substr(0, end);
+				in.erase(0, end + 1);
+				if (line.compare(0, 8, "Goodbye ") != 0) {
+					connection.send("echo: " + line + "\n");
+					continue;
+				}
+				size_t space = line.find(' ', 8);
+				if (space != std::string::npos
+					&& line.size() - space - 1 == std::stoul(line.substr(8, space - 8)))
+					++goodbyes;
+			}
+		};
+		handlers.on_close = [&](ffd::SocketReactor::Connection &) {
+			if (++closed == clients + closers)
+				reactor_ptr->stop();
+		};
+		ffd::SocketReactor reactor(*server, handlers);
+		reactor_ptr = &reactor;
+		reactor.run();
+
+		std::cout << "peak connections: " << peak << std::endl;
+		std::cout << "served " << closed << " connections" << std::endl;
+		std::cout << "goodbyes: " << goodbyes << std::endl;
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		delete server;
+		return -1;
+	}
+	delete server;
+	return 0;
+}
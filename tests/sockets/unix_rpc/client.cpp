@@ -0,0 +1,78 @@
+#include <45d/socket/Rpc.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+int main(void) {
+	ffd::RpcClient *client = nullptr;
+
+	for (int tries = 0; client == nullptr; ++tries) {
+		try {
+			client = new ffd::RpcClient("test.socket");
+		} catch (const ffd::SocketConnectException &e) {
+			if (tries == 50) {
+				std::cerr << e.what() << std::endl;
+				return -1;
+			}
+			usleep(100000); // server still starting
+		}
+	}
+
+	try {
+		/* All outstanding on one connection at once, slowest first so replies come back out
+		 * of order */
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		std::vector<std::future<std::string>> replies;
+		int total_ms = 0;
+		for (int i = 0; i < 16; ++i) {
+			int ms = 200 - i * 10;
+			total_ms += ms;
+			replies.push_back(client->call("sleep " + std::to_string(ms)));
+		}
+		std::future<std::string> failed = client->call("fail");
+
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::string callback_reply;
+		client->call("sleep 1", [&](const std::string &reply, bool ok) {
+			std::lock_guard<std::mutex> lk(mutex);
+			callback_reply = (ok ? "ok: " : "error: ") + reply;
+			cv.notify_all();
+		});
+
+		for (std::future<std::string> &reply : replies)
+			std::cout << reply.get() << std::endl;
+		try {
+			failed.get();
+			std::cout << "fail did not fail" << std::endl;
+		} catch (const ffd::RpcException &e) {
+			std::cout << "error: " << e.what() << std::endl;
+		}
+		{
+			std::unique_lock<std::mutex> lk(mutex);
+			while (callback_reply.empty())
+				cv.wait(lk);
+			std::cout << callback_reply << std::endl;
+		}
+
+		std::chrono::milliseconds elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - start);
+		std::cout << (elapsed.count() < total_ms / 2 ? "handled concurrently" : "handled serially")
+				  << std::endl;
+		std::cout << client->pending() << " pending" << std::endl;
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		delete client;
+		return -1;
+	}
+	delete client;
+	return 0;
+}
@@ -0,0 +1,56 @@
+#include <45d/socket/Rpc.hpp>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+extern "C" {
+#include <signal.h>
+}
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+ffd::RpcServer *server = nullptr;
+
+void on_term(int) {
+	server->stop();
+}
+
+int main(void) {
+	std::atomic<int> handled(0);
+
+	/* "sleep N" replies after N ms, "fail" throws */
+	auto handler = [&handled](const std::string &request) -> std::string {
+		++handled;
+		if (request == "fail")
+			throw std::runtime_error("request failed");
+		int ms = std::stoi(request.substr(request.find(' ') + 1));
+		std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+		return "slept " + std::to_string(ms);
+	};
+
+	try {
+		server = new ffd::RpcServer("test.socket", handler, 8);
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+	signal(SIGTERM, on_term);
+
+	try {
+		server->run();
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		delete server;
+		return -1;
+	}
+	delete server;
+	std::cout << "handled " << handled << " requests" << std::endl;
+	return 0;
+}
@@ -0,0 +1,58 @@
+#include <45d/socket/UnixSocketClient.hpp>
+#include <iostream>
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+int main(void) {
+	ffd::UnixSocketClient *client;
+
+	try {
+		client = new ffd::UnixSocketClient("test.socket", SOCK_SEQPACKET);
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+
+	try {
+		for (int tries = 0;; ++tries) {
+			try {
+				client->connect();
+				break;
+			} catch (const ffd::SocketConnectException &) {
+				if (tries == 50)
+					throw;
+				usleep(100000); // server still starting
+			}
+		}
+
+		client->send_data("Hello from client 1");
+		client->send_data(std::vector<std::string>{ "record 1", "", "record 3" });
+		client->send_data_async(std::string(100000, 'x')); // still one message
+
+		/* Each string is its own message, many per sendmmsg() */
+		std::vector<std::string> telemetry;
+		for (int i = 0; i < 1000; ++i)
+			telemetry.push_back("telemetry " + std::to_string(i));
+		client->send_batch(telemetry);
+		client->send_data_async("EOF");
+
+		std::vector<std::string> reply;
+		client->receive_data_sync(reply);
+		for (const std::string &record : reply)
+			std::cout << record << std::endl;
+
+		client->close_connection();
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		client->close_connection();
+		delete client;
+		return -1;
+	}
+	delete client;
+	return 0;
+}
@@ -0,0 +1,68 @@
+#include <45d/socket/UnixSocketServer.hpp>
+#include <iostream>
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+int main(void) {
+	ffd::UnixSocketServer *server;
+
+	try {
+		server = new ffd::UnixSocketServer("test.socket", ffd::Socket::_backlog_default,
+										   SOCK_SEQPACKET);
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+
+	try {
+		server->wait_for_connection();
+
+		std::string msg;
+		server->receive_data_sync(msg);
+		std::cout << msg << std::endl;
+
+		std::vector<std::string> records;
+		server->receive_data_sync(records);
+		std::cout << records.size() << " records:";
+		for (const std::string &record : records)
+			std::cout << " [" << record << "]";
+		std::cout << std::endl;
+
+		ffd::BufferView view = server->receive_view_async();
+		std::cout << view.size() << " bytes" << std::endl;
+
+		size_t count = 0;
+		bool in_order = true;
+		std::vector<ffd::BufferView> batch;
+		for (bool done = false; !done;) {
+			if (server->receive_batch(batch) == 0)
+				break;
+			for (const ffd::BufferView &message : batch) {
+				if (message == std::string("EOF") || message.empty()) {
+					done = true;
+					break;
+				}
+				if (message != "telemetry " + std::to_string(count++))
+					in_order = false;
+			}
+		}
+		std::cout << count << " batched messages " << (in_order ? "in order" : "out of order")
+				  << std::endl;
+
+		server->send_data(std::vector<std::string>{ "Hello from server 1", "EOF" });
+
+		server->close_connection();
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		server->close_connection();
+		delete server;
+		return -1;
+	}
+	delete server;
+	return 0;
+}
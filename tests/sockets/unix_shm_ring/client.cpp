@@ -0,0 +1,61 @@
+#include <45d/socket/ShmRing.hpp>
+#include <45d/socket/UnixSocketClient.hpp>
+#include <iostream>
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+int main(void) {
+	ffd::UnixSocketClient *client;
+
+	try {
+		client = new ffd::UnixSocketClient("test.socket");
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+
+	try {
+		for (int tries = 0;; ++tries) {
+			try {
+				client->connect();
+				break;
+			} catch (const ffd::SocketConnectException &) {
+				if (tries == 50)
+					throw;
+				usleep(100000); // server still starting
+			}
+		}
+		client->set_framing(true);
+
+		/* A small ring so it fills up and wraps around many times */
+		ffd::ShmRingProducer ring(*client, 65536);
+		std::cout << "capacity " << ring.capacity() << ", max message " << ring.max_message()
+				  << std::endl;
+
+		ring.send("");
+		for (int i = 0; i < 200000; ++i) {
+			if (i % 50000 == 0)
+				ring.send(std::string(100000, 'a' + i / 50000)); // goes over the socket
+			ring.send("message " + std::to_string(i));
+		}
+		ring.close();
+
+		std::string reply;
+		client->receive_data_async(reply);
+		std::cout << reply << std::endl;
+
+		client->close_connection();
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		client->close_connection();
+		delete client;
+		return -1;
+	}
+	delete client;
+	return 0;
+}
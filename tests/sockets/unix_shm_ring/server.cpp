@@ -0,0 +1,61 @@
+#include <45d/socket/ShmRing.hpp>
+#include <45d/socket/UnixSocketServer.hpp>
+#include <iostream>
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+int main(void) {
+	ffd::UnixSocketServer *server;
+
+	try {
+		server = new ffd::UnixSocketServer("test.socket");
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+
+	try {
+		server->wait_for_connection();
+		server->set_framing(true);
+
+		size_t count = 0;
+		size_t big = 0;
+		int next = 0;
+		bool in_order = true;
+		{
+			ffd::ShmRingConsumer ring(*server);
+			/* Views point into shared memory, valid until the next receive */
+			ffd::BufferView view;
+			if (!ring.receive_view(view) || !view.empty())
+				in_order = false;
+			while (ring.receive_view(view)) {
+				++count;
+				if (view.size() > ring.max_message()) {
+					++big;
+					if (view.size() != 100000 || view[0] != 'a' + next / 50000)
+						in_order = false;
+				} else if (view != "message " + std::to_string(next++)) {
+					in_order = false;
+				}
+			}
+		}
+		std::cout << count << " messages, " << big << " over the socket" << std::endl;
+		std::cout << (in_order ? "in order" : "out of order") << std::endl;
+
+		server->send_data_async("done");
+
+		server->close_connection();
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		server->close_connection();
+		delete server;
+		return -1;
+	}
+	delete server;
+	return 0;
+}
@@ -0,0 +1,62 @@
+#include <45d/socket/UnixSocketServer.hpp>
+#include <45d/socket/UringReactor.hpp>
+#include <iostream>
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+const size_t clients = 500;
+
+int main(int argc, char *argv[]) {
+	ffd::UnixSocketServer *server;
+
+	if (argc > 1 && std::string(argv[1]) == "--supported")
+		return ffd::UringReactor::supported() ? 0 : 1;
+
+	try {
+		server = new ffd::UnixSocketServer("test.socket", clients);
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+
+	try {
+		size_t closed = 0;
+		size_t peak = 0;
+		ffd::UringReactor *reactor_ptr = nullptr;
+		ffd::UringReactor::Handlers handlers;
+		handlers.on_connect = [&](ffd::UringReactor::Connection &) {
+			if (reactor_ptr->connections() > peak)
+				peak = reactor_ptr->connections();
+		};
+		/* Echo back each complete line, leaving partial lines in the input buffer */
+		handlers.on_data = [](ffd::UringReactor::Connection &connection) {
+			std::string &in = connection.input();
+			size_t end;
+			while ((end = in.find('\n')) != std::string::npos) {
+				connection.send("echo: " + in.substr(0, end + 1));
+				in.erase(0, end + 1);
+			}
+		};
+		handlers.on_close = [&](ffd::UringReactor::Connection &) {
+			if (++closed == clients)
+				reactor_ptr->stop();
+		};
+		ffd::UringReactor reactor(*server, handlers);
+		reactor_ptr = &reactor;
+		reactor.run();
+
+		std::cout << "peak connections: " << peak << std::endl;
+		std::cout << "served " << closed << " connections" << std::endl;
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		delete server;
+		return -1;
+	}
+	delete server;
+	return 0;
+}
@@ -0,0 +1,33 @@
+#!/usr/bin/env bash
+
+pids=()
+
+cleanup() {
+    kill ${pids[@]} 
+    rm -f test.socket
+    exit 1
+}
+
+trap 'cleanup' INT
+
+if ! ./server.test --supported; then
+    echo -n "(skipped, kernel has no io_uring support) "
+    exit 0
+fi
+
+./server.test > server.out 2>&1 &
+pids+=$!
+
+ps -p ${pids[0]} > /dev/null 2>&1 || exit 1
+
+./client.test > client.out 2>&1
+res=$?
+if [[ "$res" != "0" ]]; then
+    exit $res
+fi
+
+wait ${pids[0]} # server exits once every client has closed
+
+diff client.out client.gold
+diff server.out server.gold
+exit $?
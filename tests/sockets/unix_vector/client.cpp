@@ -21,6 +21,13 @@ int main(void) {
 	try {
 		client->connect();
 
+		try {
+			client->send_data(std::vector<std::string>());
+		} catch (const ffd::SocketException &e) {
+			if (e.get_errno() == EINVAL)
+				std::cout << "empty refused" << std::endl;
+		}
+
 		std::vector<std::string> send = {
 			"Hello from client 1", "Hello from client 2", "Hello from client 3", "EOF"
 		};
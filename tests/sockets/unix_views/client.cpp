@@ -0,0 +1,53 @@
+#include <45d/socket/UnixSocketClient.hpp>
+#include <iostream>
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+int main(void) {
+	ffd::UnixSocketClient *client;
+
+	try {
+		client = new ffd::UnixSocketClient("test.socket");
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+
+	try {
+		for (int tries = 0;; ++tries) {
+			try {
+				client->connect();
+				break;
+			} catch (const ffd::SocketConnectException &) {
+				if (tries == 50)
+					throw;
+				usleep(100000); // server still starting
+			}
+		}
+
+		client->send_data("Hello from client 1");
+		client->send_data(std::vector<std::string>{ "record 1", "", "record 3" });
+		client->send_data(std::string(20000, 'x')); // grows the receive buffer
+		client->send_data("Hello from client 2");
+		client->send_data("EOF");
+
+		std::vector<ffd::BufferView> records;
+		client->receive_view_sync(records);
+		for (size_t i = 0; i < records.size(); ++i)
+			std::cout << std::string(records[i].data(), records[i].size()) << std::endl;
+
+		client->close_connection();
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		client->close_connection();
+		delete client;
+		return -1;
+	}
+	delete client;
+	return 0;
+}
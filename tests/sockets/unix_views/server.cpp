@@ -0,0 +1,55 @@
+#include <45d/socket/UnixSocketServer.hpp>
+#include <iostream>
+
+#if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 32)
+char *strerrorname_np(int err) {
+	(void)err;
+	return nullptr;
+}
+#endif
+
+int main(void) {
+	ffd::UnixSocketServer *server;
+
+	try {
+		server = new ffd::UnixSocketServer("test.socket");
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+
+	try {
+		server->wait_for_connection();
+
+		/* Views point into the connection's receive buffer, valid until the next receive */
+		ffd::BufferView view = server->receive_view_sync();
+		std::cout << std::string(view.data(), view.size()) << std::endl;
+
+		std::vector<ffd::BufferView> records;
+		server->receive_view_sync(records);
+		std::cout << records.size() << " records:";
+		for (size_t i = 0; i < records.size(); ++i)
+			std::cout << " [" << std::string(records[i].data(), records[i].size()) << "]";
+		std::cout << std::endl;
+
+		view = server->receive_view_sync();
+		std::cout << view.size() << " bytes" << std::endl;
+
+		do {
+			view = server->receive_view_sync();
+			std::cout << std::string(view.data(), view.size()) << std::endl;
+		} while (!view.empty() && view != std::string("EOF"));
+
+		server->send_data(std::vector<std::string>{
+			"Hello from server 1", "Hello from server 2", "Hello from server 3", "EOF" });
+
+		server->close_connection();
+	} catch (const ffd::SocketException &e) {
+		std::cerr << e.what() << " " << strerrorname_np(e.get_errno()) << std::endl;
+		server->close_connection();
+		delete server;
+		return -1;
+	}
+	delete server;
+	return 0;
+}